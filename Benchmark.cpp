@@ -0,0 +1,1894 @@
+/**********************************************************************
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+// Microbenchmarks of the CPU implementation of the work graph.
+// This executable does not depend on D3D12 or Windows and can be built on any platform, e.g.
+//   g++ -O2 -std=c++14 -pthread Benchmark.cpp CpuWorkGraph.cpp CpuRasterizer.cpp GeometryFile.cpp GeometryStream.cpp GpuPerfModel.cpp PngWriter.cpp Profiling.cpp VideoWriter.cpp -o HelloMeshNodesBenchmark
+//
+// Every benchmark runs for each combination of --depths and --threads and the results are
+// written as JSON (default) or CSV to stdout or the file given with --output.
+//
+// With --frames N, whole frames (graph execution, mesh nodes and rasterization) are rendered N times
+// instead and frame time percentiles are reported, in the same format as the D3D12 --benchmark mode.
+//
+// With --baseline <file>, the suite runs --repeats times and the repeats of every benchmark (its mean time per iteration) are
+// compared against the confidence interval of the baseline median with the tolerance given per benchmark. A benchmark regressed
+// if --required-repeats (default a majority) of the repeats are slower. The process exits with 1 on a regression.
+// Unless given, --depths, --threads and --repeats default to those of the baseline.
+// --write-baseline <file> writes the median and its confidence interval of the repeat runs as a new baseline.
+//
+// --perf-model prints the estimates of the GPU performance model (GpuPerfModel.h) for the sample graph
+// and for variants of its topology, ranked by their estimated cost relative to the sample.
+//
+// --mesh-lanes prints the wave lane utilization of the CPU mesh node emulation with and without triangle batching.
+//
+// --culling compares the mesh node output with and without culling (MESH_NODE_CULLING in ShaderSource.h).
+//
+// --export-geometry <file> writes the geometry of every depth with the memory-mapped exporter (GeometryFile.h),
+// reports its throughput and compares the file against the executor output.
+// With --frames N, --geometry <file> maps such a file instead of running the executor in every frame (PrecomputedGeometry).
+// With --frames N, --write-frames <prefix> writes every frame as <prefix>0000.png, ... with the background PNG writer (PngWriter.h).
+//
+// --stream-produce <name> publishes --frames passes of the geometry of the first of --depths to the shared memory ring buffer <name>
+// (GeometryStream.h), once --stream-consumers consumers are attached. --stream-consume <name> is the reference consumer,
+// which reads the stream until it ends and checks the first frame against the executor. --stream-benchmark measures the
+// throughput of the ring buffer between threads for each of --depths.
+//
+// --video <file> renders an animated sweep of --frames frames (default 240) and writes it as Y4M video (VideoWriter.h)
+// to the file, or to stdout with "-", e.g. for piping into an encoder. The sweep steps through --depths, rotates
+// by 120 degrees and zooms in to --video-zoom and back out, towards the top corner of the snowflake. Frames are
+// converted and written on a background thread while the next frame is rendered. Status is printed to stderr.
+
+#include "CpuRasterizer.h"
+#include "CpuWorkGraph.h"
+#include "GeometryFile.h"
+#include "GeometryStream.h"
+#include "GpuPerfModel.h"
+#include "PngWriter.h"
+#include "Profiling.h"
+#include "VideoWriter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    constexpr uint32_t ImageSize = 720;
+
+    struct Options
+    {
+        std::vector<uint32_t> depths  = { 3, 6, 8 };
+        std::vector<uint32_t> threads = { 1, std::max(std::thread::hardware_concurrency(), 1u) };
+        // Each benchmark repeats until this much time has passed (and at least MinIterations times)
+        double      minTimeMs = 200.0;
+        std::string format    = "json";
+        std::string output;
+        // Only benchmarks containing this string in their name are run
+        std::string filter;
+        // If non-zero, run the headless frame benchmark with this many frames instead of the microbenchmarks
+        uint32_t    frames = 0;
+
+        // Regression gate
+        std::string baseline;
+        std::string writeBaseline;
+        // Number of runs of the whole suite, the gate compares every run against the baseline
+        uint32_t    repeats   = 1;
+        // Allowed slowdown beyond the confidence interval of the baseline, unless the baseline sets a tolerance for a benchmark
+        double      tolerance = 0.10;
+        // Number of repeats beyond the interval for a regression, 0 is a majority of the repeats
+        uint32_t    requiredRepeats = 0;
+        // Whether --depths, --threads and --repeats were given, otherwise the gate uses those of the baseline
+        bool        depthsSet  = false;
+        bool        threadsSet = false;
+        bool        repeatsSet = false;
+
+        bool perfModel = false;
+        bool meshLanes = false;
+        bool culling   = false;
+        std::string exportGeometryPath;
+        // Precomputed geometry for the frame benchmark, instead of the executor
+        std::string geometryPath;
+        // Prefix of the PNG files written by the frame benchmark
+        std::string writeFramesPrefix;
+
+        // Geometry stream
+        std::string streamProduceName;
+        std::string streamConsumeName;
+        uint32_t    streamConsumers = 1;
+        bool        streamBenchmark = false;
+
+        // Y4M video of the animated sweep, "-" is stdout
+        std::string videoPath;
+        uint32_t    videoFps  = 30;
+        // Largest zoom of the sweep
+        float       videoZoom = 8.f;
+    };
+
+    // Triangles per batched triangle mesh node group in the benchmarks, see TRIANGLE_BATCH_SIZE in ShaderSource.h
+    constexpr uint32_t TriangleBatchSizes[] = { 32, 64, shader::MaxTriangleBatchSize };
+
+    constexpr uint64_t MinIterations = 3;
+
+    struct Result
+    {
+        std::string name;
+        uint32_t    depth;
+        uint32_t    threads;
+        uint64_t    iterations;
+        double      meanMs;
+        double      minMs;
+        double      maxMs;
+        // Number of processed items (records, primitives, ...) per iteration
+        uint64_t    items;
+    };
+
+    std::vector<uint32_t> ParseList(const std::string& list)
+    {
+        std::vector<uint32_t> values;
+        std::stringstream stream(list);
+        std::string value;
+        while (std::getline(stream, value, ','))
+        {
+            values.push_back(static_cast<uint32_t>(std::stoul(value)));
+        }
+        return values;
+    }
+
+    class Suite
+    {
+    public:
+        explicit Suite(const Options& options) : options_(options) {}
+
+        // Runs function repeatedly and adds the timing statistics to the results
+        template<typename Function>
+        void Measure(const std::string& name, uint32_t depth, uint32_t threads, uint64_t items, Function&& function)
+        {
+            if (!options_.filter.empty() && name.find(options_.filter) == std::string::npos)
+            {
+                return;
+            }
+
+            // Warm up caches and allocations
+            function();
+
+            Result result = { name, depth, threads, 0, 0.0, 1e30, 0.0, items };
+            const profiling::CpuTimer totalTimer;
+            while ((result.iterations < MinIterations) || (totalTimer.ElapsedMs() < options_.minTimeMs))
+            {
+                const profiling::CpuTimer timer;
+                function();
+                const double elapsedMs = timer.ElapsedMs();
+
+                result.meanMs += elapsedMs;
+                result.minMs   = std::min(result.minMs, elapsedMs);
+                result.maxMs   = std::max(result.maxMs, elapsedMs);
+                result.iterations++;
+            }
+            result.meanMs /= result.iterations;
+
+            fprintf(stderr, "%-28s depth %2u threads %2u: %10.4f ms\n", name.c_str(), depth, threads, result.meanMs);
+            results_.push_back(result);
+        }
+
+        const std::vector<Result>& GetResults() const { return results_; }
+
+        void Write(std::ostream& stream) const
+        {
+            if (options_.format == "csv")
+            {
+                stream << "name,depth,threads,iterations,mean_ms,min_ms,max_ms,items,items_per_second\n";
+                for (const Result& r : results_)
+                {
+                    stream << r.name << ',' << r.depth << ',' << r.threads << ',' << r.iterations << ','
+                           << r.meanMs << ',' << r.minMs << ',' << r.maxMs << ',' << r.items << ','
+                           << ItemsPerSecond(r) << '\n';
+                }
+                return;
+            }
+
+            stream << "{\n  \"benchmarks\": [";
+            for (size_t i = 0; i < results_.size(); ++i)
+            {
+                const Result& r = results_[i];
+                stream << ((i == 0) ? "\n" : ",\n")
+                       << "    {\"name\": \"" << r.name << "\", \"depth\": " << r.depth << ", \"threads\": " << r.threads
+                       << ", \"iterations\": " << r.iterations << ", \"mean_ms\": " << r.meanMs
+                       << ", \"min_ms\": " << r.minMs << ", \"max_ms\": " << r.maxMs
+                       << ", \"items\": " << r.items << ", \"items_per_second\": " << ItemsPerSecond(r) << "}";
+            }
+            stream << "\n  ]\n}\n";
+        }
+
+    private:
+        static double ItemsPerSecond(const Result& result)
+        {
+            return (result.meanMs > 0.0) ? result.items / (result.meanMs / 1000.0) : 0.0;
+        }
+
+        const Options& options_;
+        std::vector<Result> results_;
+    };
+
+    // Koch subdivision of all lines of the last recursion level, split evenly across the threads
+    void BenchmarkKochSubdivision(Suite& suite, uint32_t depth, uint32_t threads)
+    {
+        cpu::ExecutorDesc desc = {};
+        desc.maxRecursionDepth = depth;
+        cpu::Executor executor(desc);
+        cpu::GraphOutput graph;
+        executor.Run(graph);
+
+        const std::vector<cpu::LineRecord>& lines = graph.lines;
+        cpu::WorkerPool pool(threads);
+        std::vector<cpu::NodeOutputs> outputs(threads);
+
+        suite.Measure("koch_subdivision", depth, threads, lines.size(), [&] {
+            pool.ParallelFor(threads, [&](uint32_t index, uint32_t) {
+                cpu::NodeOutputs& output = outputs[index];
+                output.snowflakeRecords.clear();
+                output.draws.Clear();
+
+                const size_t first = lines.size() * index / threads;
+                const size_t last  = lines.size() * (index + 1) / threads;
+                for (size_t i = first; i < last; ++i)
+                {
+                    cpu::SnowflakeNode(lines[i], 1, depth + 1, output);
+                }
+            });
+        });
+    }
+
+    // Full graph execution with small and large batches of records per worker task
+    void BenchmarkExecutor(Suite& suite, uint32_t depth, uint32_t threads)
+    {
+        for (const uint32_t batchSize : { 64u, 1024u })
+        {
+            cpu::ExecutorDesc desc = {};
+            desc.maxRecursionDepth = depth;
+            desc.threadCount       = threads;
+            desc.batchSize         = batchSize;
+            cpu::Executor executor(desc);
+            cpu::GraphOutput graph;
+
+            const uint64_t invocations = cpu::ExpectedNodeCounters(depth)[cpu::SnowflakeNodeInvocations];
+            suite.Measure("executor_batch" + std::to_string(batchSize), depth, threads, invocations, [&] {
+                executor.Run(graph);
+            });
+        }
+
+        // Several Koch iterations per SnowflakeNode invocation, 4^k child lines per invocation.
+        // Items are draw records, which do not depend on k.
+        const cpu::NodeCounters expected = cpu::ExpectedNodeCounters(depth);
+        const uint64_t drawRecords = expected[cpu::TriangleMeshNodeInvocations] + expected[cpu::LineMeshNodeInvocations];
+        for (uint32_t expansionLevels = 1; expansionLevels <= shader::MaxSnowflakeExpansionLevels; ++expansionLevels)
+        {
+            cpu::ExecutorDesc desc = {};
+            desc.maxRecursionDepth = depth;
+            desc.threadCount       = threads;
+            desc.expansionLevels   = expansionLevels;
+            cpu::Executor executor(desc);
+            cpu::GraphOutput graph;
+
+            suite.Measure("executor_expansion" + std::to_string(expansionLevels), depth, threads, drawRecords, [&] {
+                executor.Run(graph);
+            });
+        }
+
+        // Coalescing launch SnowflakeNode, outputs are allocated once per group.
+        // Groups are limited to shader::MaxSnowflakeGroupSize records by the node output limits.
+        for (const uint32_t groupSize : { 16u, 32u })
+        {
+            cpu::ExecutorDesc desc = {};
+            desc.maxRecursionDepth  = depth;
+            desc.threadCount        = threads;
+            desc.snowflakeGroupSize = groupSize;
+            cpu::Executor executor(desc);
+            cpu::GraphOutput graph;
+
+            const uint64_t invocations = cpu::ExpectedNodeCounters(depth)[cpu::SnowflakeNodeInvocations];
+            suite.Measure("executor_coalescing" + std::to_string(groupSize), depth, threads, invocations, [&] {
+                executor.Run(graph);
+            });
+        }
+
+        // Unrolled chain of one node per recursion level, compared to executor_expansion1 with the recursive SnowflakeNode
+        {
+            cpu::ExecutorDesc desc = {};
+            desc.maxRecursionDepth = depth;
+            desc.threadCount       = threads;
+            desc.unrolledChain     = true;
+            cpu::Executor executor(desc);
+            cpu::GraphOutput graph;
+
+            suite.Measure("executor_unrolled", depth, threads, drawRecords, [&] {
+                executor.Run(graph);
+            });
+        }
+
+        // Compact records, all records are passed through their 8 byte encoding
+        {
+            cpu::ExecutorDesc desc = {};
+            desc.maxRecursionDepth = depth;
+            desc.threadCount       = threads;
+            desc.compactRecords    = true;
+            cpu::Executor executor(desc);
+            cpu::GraphOutput graph;
+
+            suite.Measure("executor_compact", depth, threads, drawRecords, [&] {
+                executor.Run(graph);
+            });
+        }
+    }
+
+    // Appending records to per-thread queues and gathering them into a single queue, as the executor does per level
+    void BenchmarkRecordQueues(Suite& suite, uint32_t depth, uint32_t threads)
+    {
+        const uint64_t recordCount = cpu::ExpectedNodeCounters(depth)[cpu::SnowflakeToLineRecords];
+        cpu::WorkerPool pool(threads);
+        std::vector<std::vector<cpu::LineRecord>> queues(threads);
+        std::vector<cpu::LineRecord> gathered;
+
+        suite.Measure("record_queue", depth, threads, recordCount, [&] {
+            pool.ParallelFor(threads, [&](uint32_t index, uint32_t) {
+                std::vector<cpu::LineRecord>& queue = queues[index];
+                queue.clear();
+
+                const uint64_t first = recordCount * index / threads;
+                const uint64_t last  = recordCount * (index + 1) / threads;
+                for (uint64_t i = first; i < last; ++i)
+                {
+                    const float value = static_cast<float>(i);
+                    queue.push_back({ { value, value }, { value, value } });
+                }
+            });
+
+            gathered.clear();
+            for (const std::vector<cpu::LineRecord>& queue : queues)
+            {
+                gathered.insert(gathered.end(), queue.begin(), queue.end());
+            }
+        });
+    }
+
+    // Allocation of per-batch output storage: fresh allocations for every batch against storage reused across runs
+    void BenchmarkAllocation(Suite& suite, uint32_t depth, uint32_t threads)
+    {
+        constexpr uint32_t BatchSize = 256;
+        const uint64_t recordCount = cpu::ExpectedNodeCounters(depth)[cpu::SnowflakeToLineRecords];
+        const uint32_t batchCount  = static_cast<uint32_t>((recordCount + BatchSize - 1) / BatchSize);
+        cpu::WorkerPool pool(threads);
+        std::vector<cpu::NodeOutputs> reused(batchCount);
+
+        const auto fillBatch = [](cpu::NodeOutputs& output) {
+            for (uint32_t i = 0; i < BatchSize * 4; ++i)
+            {
+                output.snowflakeRecords.push_back({});
+            }
+        };
+
+        suite.Measure("allocation_fresh", depth, threads, batchCount, [&] {
+            pool.ParallelFor(batchCount, [&](uint32_t, uint32_t) {
+                cpu::NodeOutputs output;
+                fillBatch(output);
+            });
+        });
+
+        suite.Measure("allocation_reused", depth, threads, batchCount, [&] {
+            pool.ParallelFor(batchCount, [&](uint32_t batch, uint32_t) {
+                reused[batch].snowflakeRecords.clear();
+                fillBatch(reused[batch]);
+            });
+        });
+    }
+
+    // Rasterization of the fill triangles and the line quads of the outline
+    void BenchmarkRaster(Suite& suite, uint32_t depth, uint32_t threads)
+    {
+        cpu::ExecutorDesc desc = {};
+        desc.maxRecursionDepth = depth;
+        cpu::Executor executor(desc);
+        cpu::GraphOutput graph;
+        executor.Run(graph);
+
+        cpu::MeshOutput triangles;
+        for (const cpu::TriangleDrawRecord& record : graph.triangles)
+        {
+            cpu::TriangleMeshNode(record, triangles);
+        }
+
+        cpu::MeshOutput lines;
+        for (const cpu::LineRecord& record : graph.lines)
+        {
+            cpu::LineMeshNode(record, lines);
+        }
+
+        cpu::Rasterizer rasterizer(ImageSize, ImageSize, threads);
+
+        suite.Measure("raster_triangles", depth, threads, triangles.primitives.size(), [&] {
+            rasterizer.Clear(0xffffffff, 1.f);
+            rasterizer.Draw(triangles);
+        });
+
+        suite.Measure("raster_lines", depth, threads, lines.primitives.size(), [&] {
+            rasterizer.Clear(0xffffffff, 1.f);
+            rasterizer.Draw(lines);
+        });
+    }
+
+    // PNG encoding of a rendered frame, with strips compressed in parallel and as a single strip
+    void BenchmarkPngEncode(Suite& suite, uint32_t depth, uint32_t threads)
+    {
+        cpu::ExecutorDesc desc = {};
+        desc.maxRecursionDepth = depth;
+        cpu::Executor executor(desc);
+        cpu::GraphOutput graph;
+        executor.Run(graph);
+
+        cpu::MeshOutput mesh;
+        cpu::EmitMeshes(graph, mesh);
+        cpu::Rasterizer rasterizer(ImageSize, ImageSize, threads);
+        rasterizer.Clear(0xffffffff, 1.f);
+        rasterizer.Draw(mesh);
+        const cpu::Image& image = rasterizer.GetImage();
+
+        cpu::WorkerPool pool(threads);
+        std::vector<uint8_t> png;
+
+        suite.Measure("png_encode", depth, threads, static_cast<uint64_t>(ImageSize) * ImageSize, [&] {
+            png::Encode(image.color.data(), image.width, image.height, image.width * sizeof(uint32_t), pool, png);
+        });
+
+        suite.Measure("png_encode_single_strip", depth, threads, static_cast<uint64_t>(ImageSize) * ImageSize, [&] {
+            png::Encode(image.color.data(), image.width, image.height, image.width * sizeof(uint32_t), pool, png, image.height);
+        });
+    }
+
+    void BenchmarkVideoConvert(Suite& suite, uint32_t depth, uint32_t threads)
+    {
+        cpu::ExecutorDesc desc = {};
+        desc.maxRecursionDepth = depth;
+        cpu::Executor executor(desc);
+        cpu::GraphOutput graph;
+        executor.Run(graph);
+
+        cpu::MeshOutput mesh;
+        cpu::EmitMeshes(graph, mesh);
+        cpu::Rasterizer rasterizer(ImageSize, ImageSize, threads);
+        rasterizer.Clear(0xffffffff, 1.f);
+        rasterizer.Draw(mesh);
+        const cpu::Image& image = rasterizer.GetImage();
+
+        // The conversion runs on the writer thread of the Y4M writer, thus it is single threaded
+        const size_t lumaSize   = static_cast<size_t>(ImageSize) * ImageSize;
+        const size_t chromaSize = lumaSize / 4;
+        std::vector<uint8_t> planes(lumaSize + 2 * chromaSize);
+        const auto convert = [&](bool simd) {
+            video::ConvertToI420(image.color.data(), image.width, image.height, image.width * sizeof(uint32_t),
+                planes.data(), planes.data() + lumaSize, planes.data() + lumaSize + chromaSize, simd);
+        };
+
+        suite.Measure("video_convert", depth, threads, lumaSize, [&] { convert(true); });
+        suite.Measure("video_convert_scalar", depth, threads, lumaSize, [&] { convert(false); });
+    }
+
+    // Mesh node emulation of all draw records, with one group per triangle and with batched triangles
+    void BenchmarkMeshNodes(Suite& suite, uint32_t depth, uint32_t threads)
+    {
+        cpu::ExecutorDesc desc = {};
+        desc.maxRecursionDepth = depth;
+        cpu::Executor executor(desc);
+        cpu::GraphOutput graph;
+        executor.Run(graph);
+
+        cpu::MeshOutput mesh;
+        const uint64_t drawRecords = graph.triangles.size() + graph.lines.size();
+
+        suite.Measure("mesh_nodes", depth, threads, drawRecords, [&] {
+            mesh.Clear();
+            cpu::EmitMeshes(graph, mesh, 0);
+        });
+
+        suite.Measure("mesh_nodes_triangle_batch64", depth, threads, drawRecords, [&] {
+            mesh.Clear();
+            cpu::EmitMeshes(graph, mesh, 64);
+        });
+
+        // MESH_NODE_CULLING, with the viewport of the sample
+        cpu::CullingDesc culling;
+        culling.enabled      = true;
+        culling.viewportSize = ImageSize;
+
+        suite.Measure("mesh_nodes_culled", depth, threads, drawRecords, [&] {
+            mesh.Clear();
+            cpu::EmitMeshes(graph, mesh, 0, culling);
+        });
+
+        // LINE_STRIP, the lines of the last Koch iteration are drawn as one strip per subdivided line
+        desc.lineStrips = true;
+        cpu::Executor stripExecutor(desc);
+        cpu::GraphOutput stripGraph;
+        stripExecutor.Run(stripGraph);
+
+        suite.Measure("mesh_nodes_line_strips", depth, threads, drawRecords, [&] {
+            mesh.Clear();
+            cpu::EmitMeshes(stripGraph, mesh, 0);
+        });
+    }
+
+    // Prints groups, waves and lane utilization of the mesh nodes, emulated on the CPU
+    void RunMeshLaneReport(const Options& options)
+    {
+        for (const uint32_t depth : options.depths)
+        {
+            cpu::ExecutorDesc desc = {};
+            desc.maxRecursionDepth = depth;
+            cpu::Executor executor(desc);
+            cpu::GraphOutput graph;
+            executor.Run(graph);
+
+            printf("Depth %u, %zu triangles, %zu lines, wave size %u\n", depth, graph.triangles.size(), graph.lines.size(), cpu::MeshWaveSize);
+            printf("%-24s %10s %10s %12s %10s %8s\n", "variant", "groups", "waves", "active lanes", "lanes", "gain");
+
+            // Lines are drawn the same way by all triangle variants and are reported separately
+            cpu::GraphOutput lineDraws;
+            lineDraws.lines = graph.lines;
+            cpu::MeshOutput lines;
+            cpu::EmitMeshes(lineDraws, lines, 0);
+
+            desc.lineStrips = true;
+            cpu::Executor stripExecutor(desc);
+            cpu::GraphOutput stripDraws;
+            stripExecutor.Run(stripDraws);
+            stripDraws.triangles.clear();
+            cpu::MeshOutput lineStrips;
+            cpu::EmitMeshes(stripDraws, lineStrips, 0);
+
+            double unbatchedUtilization = 0.0;
+            const auto printRow = [&](const std::string& name, uint32_t triangleBatchSize) {
+                cpu::GraphOutput triangleDraws;
+                triangleDraws.triangles = graph.triangles;
+                cpu::MeshOutput triangles;
+                cpu::EmitMeshes(triangleDraws, triangles, triangleBatchSize);
+
+                const double utilization = triangles.GetLaneUtilization();
+                if (triangleBatchSize == 0)
+                {
+                    unbatchedUtilization = utilization;
+                }
+                printf("%-24s %10llu %10llu %12llu %9.1f%% %7.2fx\n", name.c_str(),
+                    static_cast<unsigned long long>(triangles.groupCount), static_cast<unsigned long long>(triangles.waveCount),
+                    static_cast<unsigned long long>(triangles.activeThreadCount), utilization * 100.0,
+                    (unbatchedUtilization > 0.0) ? utilization / unbatchedUtilization : 0.0);
+            };
+
+            printRow("triangles", 0);
+            for (const uint32_t triangleBatchSize : TriangleBatchSizes)
+            {
+                printRow("triangles batch " + std::to_string(triangleBatchSize), triangleBatchSize);
+            }
+            for (const cpu::MeshOutput* output : { &lines, &lineStrips })
+            {
+                printf("%-24s %10llu %10llu %12llu %9.1f%%  %zu vertices, %zu primitives\n", (output == &lines) ? "lines" : "line strips",
+                    static_cast<unsigned long long>(output->groupCount), static_cast<unsigned long long>(output->waveCount),
+                    static_cast<unsigned long long>(output->activeThreadCount), output->GetLaneUtilization() * 100.0,
+                    output->vertices.size(), output->primitives.size());
+            }
+            printf("\n");
+        }
+    }
+
+    // Compares mesh nodes with and without culling (MESH_NODE_CULLING in ShaderSource.h), emulated on the CPU.
+    // Smaller viewports stand in for zooming out, as the sample itself always draws the snowflake at the window size.
+    void RunCullingReport(const Options& options)
+    {
+        const uint32_t viewportSizes[] = { ImageSize, ImageSize / 4 };
+        const float    minPixelAreas[] = { 0.f, 1.f };
+        const uint32_t threads         = options.threads.back();
+
+        // Mean raster time of a few frames, after a warm-up frame
+        const auto measureRaster = [](cpu::Rasterizer& rasterizer, const cpu::MeshOutput& mesh) {
+            const uint32_t frames = 5;
+            rasterizer.Clear(0xffffffff, 1.f);
+            rasterizer.Draw(mesh);
+            const profiling::CpuTimer timer;
+            for (uint32_t frame = 0; frame < frames; ++frame)
+            {
+                rasterizer.Clear(0xffffffff, 1.f);
+                rasterizer.Draw(mesh);
+            }
+            return timer.ElapsedMs() / frames;
+        };
+
+        for (const uint32_t depth : options.depths)
+        {
+            cpu::ExecutorDesc desc = {};
+            desc.maxRecursionDepth = depth;
+            cpu::Executor executor(desc);
+            cpu::GraphOutput graph;
+            executor.Run(graph);
+
+            printf("Depth %u, %zu triangles, %zu lines, %u threads\n", depth, graph.triangles.size(), graph.lines.size(), threads);
+            printf("%-10s %9s %12s %12s %12s %11s %11s %10s\n", "viewport", "min area", "primitives", "culled", "vertices", "raster ms", "culled ms", "diff px");
+
+            cpu::MeshOutput mesh;
+            cpu::EmitMeshes(graph, mesh);
+
+            for (const uint32_t viewportSize : viewportSizes)
+            {
+                cpu::Rasterizer rasterizer(viewportSize, viewportSize, threads);
+                const double rasterMs = measureRaster(rasterizer, mesh);
+                const std::vector<uint32_t> reference = rasterizer.GetImage().color;
+
+                for (const float minPixelArea : minPixelAreas)
+                {
+                    cpu::CullingDesc culling;
+                    culling.enabled      = true;
+                    culling.viewportSize = viewportSize;
+                    culling.minPixelArea = minPixelArea;
+
+                    cpu::MeshOutput culledMesh;
+                    cpu::EmitMeshes(graph, culledMesh, shader::TriangleBatchSize, culling);
+                    const double culledMs = measureRaster(rasterizer, culledMesh);
+
+                    const std::vector<uint32_t>& color = rasterizer.GetImage().color;
+                    size_t differentPixels = 0;
+                    for (size_t i = 0; i < color.size(); ++i)
+                    {
+                        differentPixels += color[i] != reference[i];
+                    }
+
+                    printf("%-10u %9.2f %12zu %12llu %12zu %11.3f %11.3f %10zu\n", viewportSize, minPixelArea, culledMesh.primitives.size(),
+                        static_cast<unsigned long long>(culledMesh.culledPrimitives), culledMesh.vertices.size(), rasterMs, culledMs, differentPixels);
+                }
+            }
+            printf("\n");
+        }
+    }
+
+    // Exports the geometry of each depth and compares the files against the executor, up to the depth the executor can hold in memory
+    bool RunGeometryExport(const Options& options)
+    {
+        const uint32_t maxCompareDepth = 10;
+        const uint32_t threads         = options.threads.back();
+
+        printf("%-6s %12s %12s %12s %8s %11s %10s %13s %10s\n", "depth", "lines", "triangles", "MiB", "chunks", "export ms", "MiB/s", "executor ms", "identical");
+        bool success = true;
+        for (const uint32_t depth : options.depths)
+        {
+            geometry::ExportReport report;
+            const profiling::CpuTimer timer;
+            if (!geometry::ExportGeometry(options.exportGeometryPath, depth, threads, &report))
+            {
+                fprintf(stderr, "ERROR: Failed to export depth %u to %s\n", depth, options.exportGeometryPath.c_str());
+                return false;
+            }
+            const double exportMs = timer.ElapsedMs();
+            const double mib      = report.fileBytes / (1024.0 * 1024.0);
+
+            if (depth > maxCompareDepth)
+            {
+                printf("%-6u %12llu %12llu %12.1f %8u %11.2f %10.0f %13s %10s\n", depth, static_cast<unsigned long long>(report.lines),
+                    static_cast<unsigned long long>(report.triangles), mib, report.chunks, exportMs, mib * 1000.0 / exportMs, "-", "-");
+                continue;
+            }
+
+            cpu::ExecutorDesc desc = {};
+            desc.maxRecursionDepth = depth;
+            desc.threadCount       = threads;
+            cpu::Executor executor(desc);
+            cpu::GraphOutput graph;
+            const profiling::CpuTimer executorTimer;
+            executor.Run(graph);
+            const double executorMs = executorTimer.ElapsedMs();
+
+            geometry::PrecomputedGeometry file;
+            cpu::GraphOutput exported;
+            if (file.Open(options.exportGeometryPath, depth))
+            {
+                const cpu::DrawRecordView records = file.GetDrawRecords();
+                exported.lines.assign(records.lines, records.lines + records.lineCount);
+                exported.triangles.assign(records.triangles, records.triangles + records.triangleCount);
+            }
+            const bool identical = cpu::HasEquivalentGeometry(graph, exported);
+            success = success && identical;
+
+            printf("%-6u %12llu %12llu %12.1f %8u %11.2f %10.0f %13.2f %10s\n", depth, static_cast<unsigned long long>(report.lines),
+                static_cast<unsigned long long>(report.triangles), mib, report.chunks, exportMs, mib * 1000.0 / exportMs, executorMs, identical ? "yes" : "NO");
+        }
+        return success;
+    }
+
+    // Timeouts of the geometry stream, a consumer which does not release its chunks for this long is considered gone
+    constexpr uint32_t StreamAttachTimeoutMs = 30000;
+    constexpr uint32_t StreamChunkTimeoutMs  = 10000;
+
+    // Reads every chunk of a geometry stream like a consumer process would, appends the records of the first
+    // complete frame to firstFrame (if not null) and returns the number of bytes read in complete frames
+    bool ConsumeStream(geometry::StreamConsumer& consumer, cpu::GraphOutput* firstFrame, geometry::StreamReport& report)
+    {
+        // A consumer attached in the middle of a frame skips to the next one
+        bool inFrame        = false;
+        bool firstFrameDone = false;
+        geometry::StreamChunk chunk;
+        for (;;)
+        {
+            if (!consumer.Acquire(chunk, StreamChunkTimeoutMs))
+            {
+                if (!consumer.IsEndOfStream())
+                {
+                    fprintf(stderr, "ERROR: No chunk was published within %u ms\n", StreamChunkTimeoutMs);
+                    return false;
+                }
+                return true;
+            }
+
+            inFrame = inFrame || (chunk.chunk == 0);
+            if (inFrame)
+            {
+                const cpu::DrawRecordView& records = chunk.records;
+                if (firstFrame && !firstFrameDone)
+                {
+                    firstFrame->lines.insert(firstFrame->lines.end(), records.lines, records.lines + records.lineCount);
+                    firstFrame->triangles.insert(firstFrame->triangles.end(), records.triangles, records.triangles + records.triangleCount);
+                }
+                firstFrameDone = firstFrameDone || chunk.lastChunkOfFrame;
+
+                report.chunks    += 1;
+                report.lines     += records.lineCount;
+                report.triangles += records.triangleCount;
+                report.bytes     += records.lineCount * sizeof(cpu::LineRecord) + records.triangleCount * sizeof(cpu::TriangleDrawRecord);
+            }
+            consumer.Release();
+        }
+    }
+
+    // Publishes --frames passes of the geometry of the first of --depths to the geometry stream <name>
+    bool RunStreamProducer(const Options& options)
+    {
+        const uint32_t depth  = options.depths.front();
+        const uint32_t frames = std::max(options.frames, 1u);
+
+        geometry::StreamProducer producer;
+        if (!producer.Create(options.streamProduceName, depth))
+        {
+            fprintf(stderr, "ERROR: Failed to create the geometry stream %s\n", options.streamProduceName.c_str());
+            return false;
+        }
+
+        printf("Waiting for %u consumers of %s\n", options.streamConsumers, options.streamProduceName.c_str());
+        if (!producer.WaitForConsumers(options.streamConsumers, StreamAttachTimeoutMs))
+        {
+            fprintf(stderr, "ERROR: Only %u of %u consumers attached within %u ms\n", producer.GetAttachedConsumers(), options.streamConsumers, StreamAttachTimeoutMs);
+            return false;
+        }
+
+        geometry::StreamReport total;
+        const profiling::CpuTimer timer;
+        for (uint32_t frame = 0; frame < frames; ++frame)
+        {
+            geometry::StreamReport report;
+            if (!geometry::StreamGeometry(producer, frame, StreamChunkTimeoutMs, &report))
+            {
+                fprintf(stderr, "ERROR: A consumer did not release its chunks within %u ms\n", StreamChunkTimeoutMs);
+                return false;
+            }
+            total.chunks += report.chunks;
+            total.bytes  += report.bytes;
+        }
+        const double ms = timer.ElapsedMs();
+        producer.Close();
+
+        printf("Published %u frames of depth %u: %llu chunks, %.1f MiB in %.1f ms (%.0f MiB/s)\n", frames, depth,
+            static_cast<unsigned long long>(total.chunks), total.bytes / (1024.0 * 1024.0), ms, total.bytes / (1024.0 * 1024.0) * 1000.0 / ms);
+        return true;
+    }
+
+    // Reference consumer: reads the geometry stream <name> until it ends and checks the first frame against the executor
+    bool RunStreamConsumer(const Options& options)
+    {
+        const uint32_t depth = options.depths.front();
+        const uint32_t maxCompareDepth = 10;
+
+        geometry::StreamConsumer consumer;
+        std::string error;
+        if (!consumer.Open(options.streamConsumeName, depth, StreamAttachTimeoutMs, &error))
+        {
+            fprintf(stderr, "ERROR: %s\n", error.c_str());
+            return false;
+        }
+
+        cpu::GraphOutput firstFrame;
+        geometry::StreamReport report;
+        const profiling::CpuTimer timer;
+        const bool success = ConsumeStream(consumer, (depth <= maxCompareDepth) ? &firstFrame : nullptr, report);
+        const double ms = timer.ElapsedMs();
+        consumer.Close();
+        if (!success)
+        {
+            return false;
+        }
+
+        printf("Read %llu chunks with %llu lines and %llu triangles, %.1f MiB in %.1f ms (%.0f MiB/s)\n",
+            static_cast<unsigned long long>(report.chunks), static_cast<unsigned long long>(report.lines), static_cast<unsigned long long>(report.triangles),
+            report.bytes / (1024.0 * 1024.0), ms, report.bytes / (1024.0 * 1024.0) * 1000.0 / ms);
+
+        if (depth > maxCompareDepth)
+        {
+            return true;
+        }
+
+        cpu::ExecutorDesc desc = {};
+        desc.maxRecursionDepth = depth;
+        cpu::Executor executor(desc);
+        cpu::GraphOutput graph;
+        executor.Run(graph);
+        const bool identical = cpu::HasEquivalentGeometry(graph, firstFrame);
+        printf("First frame %s the executor output\n", identical ? "matches" : "DOES NOT match");
+        return identical;
+    }
+
+    // Throughput of the geometry stream between threads of this process, which map the shared memory like separate processes
+    bool RunStreamBenchmark(const Options& options)
+    {
+        const uint32_t slotCounts[]     = { 4, 32 };
+        const uint32_t consumerCounts[] = { 1, 2 };
+        // Names are unique per run, such that concurrent runs do not share their streams
+        const std::string name = "HelloMeshNodesStream" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count() % 1000000007);
+
+        printf("%-6s %6s %10s %8s %10s %12s %12s %16s %10s\n", "depth", "slots", "consumers", "frames", "MiB/frame", "stream MiB/s", "chunks/s", "generate MiB/s", "identical");
+        bool success = true;
+        for (const uint32_t depth : options.depths)
+        {
+            // Generation without the ring buffer, into one private slot
+            geometry::StreamDesc streamDesc;
+            const uint32_t chunkRecursionLevels = std::min(streamDesc.chunkRecursionLevels, depth);
+            std::vector<cpu::LineRecord>         lines(geometry::GetTriangleCount(chunkRecursionLevels));
+            std::vector<cpu::TriangleDrawRecord> triangles(std::max<size_t>((lines.size() - 1) / 3, 1));
+            uint64_t generatedBytes = 0;
+            const profiling::CpuTimer generateTimer;
+            while (generateTimer.ElapsedMs() < options.minTimeMs)
+            {
+                std::vector<cpu::TriangleDrawRecord> topTriangles(geometry::GetTriangleCount(depth - chunkRecursionLevels));
+                for (const cpu::LineRecord& root : geometry::GenerateTopLevels(depth - chunkRecursionLevels, topTriangles.data()))
+                {
+                    geometry::GenerateSubtree(root, chunkRecursionLevels, depth, lines.data(), triangles.data());
+                }
+                generatedBytes += geometry::GetLineCount(depth) * sizeof(cpu::LineRecord) + geometry::GetTriangleCount(depth) * sizeof(cpu::TriangleDrawRecord);
+            }
+            const double generateMibPerSecond = generatedBytes / (1024.0 * 1024.0) * 1000.0 / generateTimer.ElapsedMs();
+
+            // Consumers copy their first frame for the comparison, which would distort the throughput of larger depths
+            cpu::GraphOutput expected;
+            if (depth <= 8)
+            {
+                cpu::ExecutorDesc desc = {};
+                desc.maxRecursionDepth = depth;
+                cpu::Executor executor(desc);
+                executor.Run(expected);
+            }
+
+            for (const uint32_t slotCount : slotCounts)
+            {
+                for (const uint32_t consumerCount : consumerCounts)
+                {
+                    streamDesc.slotCount = slotCount;
+                    geometry::StreamProducer producer;
+                    if (!producer.Create(name, depth, streamDesc))
+                    {
+                        fprintf(stderr, "ERROR: Failed to create the geometry stream %s\n", name.c_str());
+                        return false;
+                    }
+
+                    std::vector<cpu::GraphOutput>       firstFrames(consumerCount);
+                    std::vector<geometry::StreamReport> reports(consumerCount);
+                    std::vector<uint32_t>               results(consumerCount, 0);
+                    std::vector<std::thread>            consumers;
+                    for (uint32_t i = 0; i < consumerCount; ++i)
+                    {
+                        consumers.emplace_back([&, i] {
+                            geometry::StreamConsumer consumer;
+                            std::string error;
+                            if (!consumer.Open(name, depth, StreamAttachTimeoutMs, &error))
+                            {
+                                fprintf(stderr, "ERROR: %s\n", error.c_str());
+                                return;
+                            }
+                            results[i] = ConsumeStream(consumer, expected.lines.empty() ? nullptr : &firstFrames[i], reports[i]) ? 1 : 0;
+                        });
+                    }
+
+                    bool published = producer.WaitForConsumers(consumerCount, StreamAttachTimeoutMs);
+                    uint32_t frames = 0;
+                    uint64_t chunks = 0;
+                    uint64_t bytes  = 0;
+                    const profiling::CpuTimer timer;
+                    while (published && ((frames < 2) || (timer.ElapsedMs() < options.minTimeMs)))
+                    {
+                        geometry::StreamReport report;
+                        published = geometry::StreamGeometry(producer, frames++, StreamChunkTimeoutMs, &report);
+                        chunks += report.chunks;
+                        bytes  += report.bytes;
+                    }
+                    producer.Close();
+                    for (std::thread& consumer : consumers)
+                    {
+                        consumer.join();
+                    }
+                    const double ms = timer.ElapsedMs();
+
+                    bool identical = published;
+                    for (uint32_t i = 0; i < consumerCount; ++i)
+                    {
+                        identical = identical && results[i] && (reports[i].bytes == bytes) &&
+                            (expected.lines.empty() || cpu::HasEquivalentGeometry(expected, firstFrames[i]));
+                    }
+                    success = success && identical;
+
+                    const double mib = bytes / (1024.0 * 1024.0);
+                    printf("%-6u %6u %10u %8u %10.2f %12.0f %12.0f %16.0f %10s\n", depth, slotCount, consumerCount, frames, mib / frames,
+                        mib * 1000.0 / ms, chunks * 1000.0 / ms, generateMibPerSecond, identical ? "yes" : (expected.lines.empty() ? "-" : "NO"));
+                }
+            }
+        }
+        return success;
+    }
+
+    // Renders frames like the D3D12 sample, but with the CPU executor and rasterizer.
+    // With geometryPath, the records are read from a mapped geometry file instead of being generated in every frame.
+    bool RunFrameBenchmark(uint32_t depth, uint32_t threads, uint32_t frames, const Options& options, profiling::FrameBenchmarkReport& report)
+    {
+        const std::string& geometryPath = options.geometryPath;
+        const profiling::CpuTimer startupTimer;
+
+        geometry::PrecomputedGeometry precomputed;
+        if (!geometryPath.empty())
+        {
+            std::string error;
+            if (!precomputed.Open(geometryPath, depth, &error))
+            {
+                fprintf(stderr, "ERROR: %s\n", error.c_str());
+                return false;
+            }
+        }
+
+        cpu::ExecutorDesc desc = {};
+        desc.maxRecursionDepth = depth;
+        desc.threadCount       = threads;
+        cpu::Executor executor(desc);
+        cpu::GraphOutput graph;
+        cpu::MeshOutput mesh;
+        cpu::Rasterizer rasterizer(ImageSize, ImageSize, threads);
+
+        const auto renderFrame = [&](double& generationMs, double& rasterMs) {
+            profiling::CpuTimer timer;
+            // Precomputed records are not generated, their pages are read by the mesh nodes
+            if (!precomputed.IsOpen())
+            {
+                executor.Run(graph);
+            }
+            generationMs = precomputed.IsOpen() ? 0.0 : timer.Lap();
+
+            mesh.Clear();
+            if (precomputed.IsOpen())
+            {
+                cpu::EmitMeshes(precomputed.GetDrawRecords(), mesh);
+            }
+            else
+            {
+                cpu::EmitMeshes(graph, mesh);
+            }
+            rasterizer.Clear(0xffffffff, 1.f);
+            rasterizer.Draw(mesh);
+            rasterMs = timer.Lap();
+        };
+
+        // Warm up caches and allocations
+        double generationMs = 0.0;
+        double rasterMs     = 0.0;
+        renderFrame(generationMs, rasterMs);
+        const double startupMs = startupTimer.ElapsedMs();
+
+        // Frames are encoded while the next ones are rendered, Submit only copies the image
+        std::unique_ptr<png::FrameWriter> frameWriter;
+        if (!options.writeFramesPrefix.empty())
+        {
+            frameWriter.reset(new png::FrameWriter(threads));
+        }
+
+        std::vector<double> frameSamples;
+        std::vector<double> generationSamples;
+        std::vector<double> rasterSamples;
+        for (uint32_t frame = 0; frame < frames; ++frame)
+        {
+            const profiling::CpuTimer frameTimer;
+            renderFrame(generationMs, rasterMs);
+            if (frameWriter)
+            {
+                char index[16];
+                snprintf(index, sizeof(index), "%04u", frame);
+                frameWriter->Submit(options.writeFramesPrefix + index + ".png", rasterizer.GetImage());
+            }
+            frameSamples.push_back(frameTimer.ElapsedMs());
+            if (!precomputed.IsOpen())
+            {
+                generationSamples.push_back(generationMs);
+            }
+            rasterSamples.push_back(rasterMs);
+        }
+
+        if (frameWriter)
+        {
+            const profiling::CpuTimer flushTimer;
+            if (!frameWriter->Flush())
+            {
+                return false;
+            }
+            const png::FrameWriter::Statistics& statistics = frameWriter->GetStatistics();
+            printf("Wrote %llu frames (%.1f MiB) to %s*.png: %.2f ms encoding per frame, %.2f ms stalled in total, %.2f ms waiting for the last frames\n",
+                static_cast<unsigned long long>(statistics.frames), statistics.bytes / (1024.0 * 1024.0), options.writeFramesPrefix.c_str(),
+                statistics.encodeMs / std::max<uint64_t>(statistics.frames, 1), statistics.submitStallMs, flushTimer.ElapsedMs());
+        }
+
+        const cpu::DrawRecordView precomputedRecords = precomputed.GetDrawRecords();
+
+        report = {};
+        report.backend      = "cpu";
+        report.variant      = precomputed.IsOpen() ? "mapped" : "thread";
+        report.depth        = depth;
+        report.threads      = threads;
+        report.frameMs      = profiling::ComputeLatencyStatistics(frameSamples);
+        report.generationMs = profiling::ComputeLatencyStatistics(generationSamples);
+        report.rasterMs     = profiling::ComputeLatencyStatistics(rasterSamples);
+        report.drawRecords  = precomputed.IsOpen() ? precomputedRecords.triangleCount + precomputedRecords.lineCount : graph.triangles.size() + graph.lines.size();
+        report.primitives   = mesh.primitives.size();
+        report.startupMs    = startupMs;
+        return true;
+    }
+
+    // Baseline time of a benchmark, identified by name, depth and threads
+    struct BaselineEntry
+    {
+        std::string name;
+        uint32_t    depth     = 0;
+        uint32_t    threads   = 0;
+        // Median of the repeats of the mean time per iteration and its confidence interval, see RepeatedResult
+        double      medianMs  = 0.0;
+        double      lowMs     = 0.0;
+        double      highMs    = 0.0;
+        uint32_t    repeats   = 0;
+        double      tolerance = 0.0;
+    };
+
+    std::string GetBenchmarkKey(const std::string& name, uint32_t depth, uint32_t threads)
+    {
+        return name + "/" + std::to_string(depth) + "/" + std::to_string(threads);
+    }
+
+    // Reads the baseline written by WriteBaseline. This is not a general JSON parser, it only handles
+    // a flat object per benchmark with string and number values.
+    bool ReadBaseline(const std::string& path, double defaultTolerance, std::map<std::string, BaselineEntry>& baseline)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            return false;
+        }
+        std::stringstream content;
+        content << file.rdbuf();
+        const std::string text = content.str();
+
+        size_t position = text.find("\"benchmarks\"");
+        if (position == std::string::npos)
+        {
+            return false;
+        }
+
+        while ((position = text.find('{', position)) != std::string::npos)
+        {
+            const size_t end = text.find('}', position);
+            if (end == std::string::npos)
+            {
+                return false;
+            }
+
+            // Split "key": value pairs
+            std::map<std::string, std::string> fields;
+            std::stringstream object(text.substr(position + 1, end - position - 1));
+            std::string field;
+            while (std::getline(object, field, ','))
+            {
+                const size_t colon = field.find(':');
+                if (colon == std::string::npos)
+                {
+                    continue;
+                }
+                const auto trim = [](const std::string& value) {
+                    const size_t first = value.find_first_not_of(" \t\r\n\"");
+                    const size_t last  = value.find_last_not_of(" \t\r\n\"");
+                    return (first == std::string::npos) ? std::string() : value.substr(first, last - first + 1);
+                };
+                fields[trim(field.substr(0, colon))] = trim(field.substr(colon + 1));
+            }
+
+            for (const char* required : { "name", "depth", "threads", "median_ms", "low_ms", "high_ms", "repeats" })
+            {
+                if (!fields.count(required))
+                {
+                    return false;
+                }
+            }
+
+            BaselineEntry entry;
+            entry.name      = fields["name"];
+            entry.depth     = static_cast<uint32_t>(std::stoul(fields["depth"]));
+            entry.threads   = static_cast<uint32_t>(std::stoul(fields["threads"]));
+            entry.medianMs  = std::stod(fields["median_ms"]);
+            entry.lowMs     = std::stod(fields["low_ms"]);
+            entry.highMs    = std::stod(fields["high_ms"]);
+            entry.repeats   = static_cast<uint32_t>(std::stoul(fields["repeats"]));
+            entry.tolerance = fields.count("tolerance") ? std::stod(fields["tolerance"]) : defaultTolerance;
+            baseline[GetBenchmarkKey(entry.name, entry.depth, entry.threads)] = entry;
+
+            position = end + 1;
+        }
+
+        return true;
+    }
+
+    // Confidence of the interval around the median of the repeats
+    constexpr double MedianConfidence = 0.9;
+
+    // Mean times of one benchmark over all repeat runs of the suite
+    struct RepeatedResult
+    {
+        std::string name;
+        uint32_t    depth;
+        uint32_t    threads;
+        std::vector<double> meanMs;
+
+        double GetMedianMs() const
+        {
+            std::vector<double> sorted = meanMs;
+            std::sort(sorted.begin(), sorted.end());
+            return sorted[sorted.size() / 2];
+        }
+
+        // Distribution-free confidence interval of the median: the k-th smallest and k-th largest repeat, with the
+        // largest k for which the median lies between them with at least MedianConfidence, i.e. 1 - 2 * P(Binomial(n, 1/2) < k).
+        // Five repeats give the whole range of the repeats (94%), nine repeats drop the fastest and slowest (96%).
+        // With too few repeats for the confidence, the interval is the whole range.
+        void GetMedianInterval(double& lowMs, double& highMs) const
+        {
+            std::vector<double> sorted = meanMs;
+            std::sort(sorted.begin(), sorted.end());
+            const size_t n = sorted.size();
+
+            size_t k = 1;
+            double tail = std::pow(0.5, static_cast<double>(n));  // P(Binomial(n, 1/2) < 1)
+            double term = tail;
+            while (2 * (k + 1) <= n)
+            {
+                term *= static_cast<double>(n - k + 1) / static_cast<double>(k);  // P(Binomial(n, 1/2) = k)
+                if (1.0 - 2.0 * (tail + term) < MedianConfidence)
+                {
+                    break;
+                }
+                tail += term;
+                k++;
+            }
+
+            lowMs  = sorted[k - 1];
+            highMs = sorted[n - k];
+        }
+    };
+
+    std::vector<RepeatedResult> GatherRepeats(const std::vector<Suite>& suites)
+    {
+        std::vector<RepeatedResult> repeated;
+        std::map<std::string, size_t> indices;
+        for (const Suite& suite : suites)
+        {
+            for (const Result& result : suite.GetResults())
+            {
+                const std::string key = GetBenchmarkKey(result.name, result.depth, result.threads);
+                if (!indices.count(key))
+                {
+                    indices[key] = repeated.size();
+                    repeated.push_back({ result.name, result.depth, result.threads, {} });
+                }
+                repeated[indices[key]].meanMs.push_back(result.meanMs);
+            }
+        }
+        return repeated;
+    }
+
+    bool WriteBaseline(const std::string& path, const std::vector<RepeatedResult>& results, double tolerance)
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            return false;
+        }
+
+        file << "{\n  \"benchmarks\": [";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const RepeatedResult& r = results[i];
+            double low, high;
+            r.GetMedianInterval(low, high);
+            file << ((i == 0) ? "\n" : ",\n")
+                 << "    {\"name\": \"" << r.name << "\", \"depth\": " << r.depth << ", \"threads\": " << r.threads
+                 << ", \"median_ms\": " << r.GetMedianMs() << ", \"low_ms\": " << low << ", \"high_ms\": " << high
+                 << ", \"repeats\": " << r.meanMs.size() << ", \"tolerance\": " << tolerance << "}";
+        }
+        file << "\n  ]\n}\n";
+
+        return static_cast<bool>(file);
+    }
+
+    // Number of repeats that have to be beyond the baseline interval for a regression or an improvement, by default a majority
+    uint32_t GetRequiredRepeats(const Options& options, size_t repeats)
+    {
+        const uint32_t majority = static_cast<uint32_t>(repeats / 2 + 1);
+        return (options.requiredRepeats > 0) ? std::min(options.requiredRepeats, static_cast<uint32_t>(repeats)) : majority;
+    }
+
+    // Compares the repeats of every benchmark against the confidence interval of the baseline median and prints a table of the differences.
+    // A benchmark regressed if the required number of repeats is slower than the upper end of the interval plus the tolerance,
+    // so the noise of the baseline widens the interval and a single repeat slowed down by other processes does not fail the gate.
+    // Returns the number of regressions. Baseline benchmarks selected by the options, but missing from the results, count as regressions.
+    uint32_t CompareWithBaseline(const Options& options, const std::vector<RepeatedResult>& results, const std::map<std::string, BaselineEntry>& baseline)
+    {
+        printf("%-28s %5s %7s %12s %12s %12s %9s %9s %8s %8s  %s\n",
+            "benchmark", "depth", "threads", "baseline ms", "interval ms", "median ms", "change", "tolerance", "slower", "faster", "status");
+
+        uint32_t regressions = 0;
+        std::map<std::string, bool> found;
+        for (const RepeatedResult& r : results)
+        {
+            const std::string key = GetBenchmarkKey(r.name, r.depth, r.threads);
+            const auto entry = baseline.find(key);
+            if (entry == baseline.end())
+            {
+                printf("%-28s %5u %7u %12s %12s %12.4f %9s %9s %8s %8s  not in baseline\n",
+                    r.name.c_str(), r.depth, r.threads, "-", "-", r.GetMedianMs(), "-", "-", "-", "-");
+                continue;
+            }
+            found[key] = true;
+
+            const BaselineEntry& e = entry->second;
+            const double median = r.GetMedianMs();
+            const double change = median / e.medianMs - 1.0;
+
+            uint32_t slower = 0;
+            uint32_t faster = 0;
+            for (const double ms : r.meanMs)
+            {
+                slower += (ms > e.highMs * (1.0 + e.tolerance)) ? 1 : 0;
+                faster += (ms < e.lowMs * (1.0 - e.tolerance)) ? 1 : 0;
+            }
+            const uint32_t required = GetRequiredRepeats(options, r.meanMs.size());
+
+            const char* status = "ok";
+            if (slower >= required)
+            {
+                status = "REGRESSION";
+                regressions++;
+            }
+            else if (faster >= required)
+            {
+                status = "improved";
+            }
+
+            char interval[32];
+            snprintf(interval, sizeof(interval), "%.3f-%.3f", e.lowMs, e.highMs);
+            char slowerText[16];
+            char fasterText[16];
+            snprintf(slowerText, sizeof(slowerText), "%u/%zu", slower, r.meanMs.size());
+            snprintf(fasterText, sizeof(fasterText), "%u/%zu", faster, r.meanMs.size());
+
+            printf("%-28s %5u %7u %12.4f %12s %12.4f %+8.1f%% %8.1f%% %8s %8s  %s\n",
+                r.name.c_str(), r.depth, r.threads, e.medianMs, interval, median,
+                change * 100.0, e.tolerance * 100.0, slowerText, fasterText, status);
+        }
+
+        const auto contains = [](const std::vector<uint32_t>& values, uint32_t value) {
+            return std::find(values.begin(), values.end(), value) != values.end();
+        };
+        for (const auto& entry : baseline)
+        {
+            const BaselineEntry& e = entry.second;
+            const bool selected = contains(options.depths, e.depth) && contains(options.threads, e.threads) &&
+                (options.filter.empty() || (e.name.find(options.filter) != std::string::npos));
+            if (selected && !found.count(entry.first))
+            {
+                printf("%-28s %s\n", entry.first.c_str(), "MISSING");
+                regressions++;
+            }
+        }
+
+        return regressions;
+    }
+
+    // Runs the gate with the depths, thread counts and number of repeats of the baseline, unless given on the command line
+    void ApplyBaselineDefaults(Options& options, const std::map<std::string, BaselineEntry>& baseline)
+    {
+        std::vector<uint32_t> depths;
+        std::vector<uint32_t> threads;
+        uint32_t repeats = 0;
+        for (const auto& entry : baseline)
+        {
+            depths.push_back(entry.second.depth);
+            threads.push_back(entry.second.threads);
+            repeats = std::max(repeats, entry.second.repeats);
+        }
+        const auto unique = [](std::vector<uint32_t>& values) {
+            std::sort(values.begin(), values.end());
+            values.erase(std::unique(values.begin(), values.end()), values.end());
+        };
+        unique(depths);
+        unique(threads);
+
+        if (!options.depthsSet && !depths.empty())
+        {
+            options.depths = depths;
+        }
+        if (!options.threadsSet && !threads.empty())
+        {
+            options.threads = threads;
+        }
+        if (!options.repeatsSet && (repeats > 0))
+        {
+            options.repeats = repeats;
+        }
+    }
+
+    // Estimates the GPU cost of the sample graph and of variants of its topology
+    void RunPerfModel(const Options& options)
+    {
+        const perf::Model model;
+
+        for (const uint32_t depth : options.depths)
+        {
+            printf("Depth %u\n", depth);
+
+            const std::vector<perf::NodeWorkload> sample = perf::GetSampleWorkload(depth);
+            std::vector<perf::Estimate> estimates = { model.Evaluate("sample", sample) };
+            estimates.front().Print();
+
+            // LineMeshShader only needs 6 of its 32 threads, a group could draw 5 lines instead
+            std::vector<perf::NodeWorkload> batchedLines = sample;
+            perf::NodeWorkload& line = *perf::FindNode(batchedLines, "LineMeshNode");
+            line.launch                = perf::LaunchMode::Coalescing;
+            line.recordsPerGroup       = 5;
+            line.activeThreadsPerGroup = 30;
+            line.verticesPerGroup      = 30;
+            line.primitivesPerGroup    = 20;
+            estimates.push_back(model.Evaluate("LineMeshNode 5 lines per group", batchedLines));
+
+            // SNOWFLAKE_COALESCING, one group of up to 16 or 32 records with a single output allocation
+            for (const uint32_t groupSize : { 16u, 32u })
+            {
+                std::vector<perf::NodeWorkload> coalescing = sample;
+                for (const char* name : { "SnowflakeNode", "SnowflakeNode leaf" })
+                {
+                    perf::NodeWorkload& snowflake = *perf::FindNode(coalescing, name);
+                    snowflake.launch                = perf::LaunchMode::Coalescing;
+                    snowflake.threadsPerGroup       = groupSize;
+                    snowflake.recordsPerGroup       = groupSize;
+                    snowflake.activeThreadsPerGroup = groupSize;
+                }
+                estimates.push_back(model.Evaluate("SnowflakeNode coalescing " + std::to_string(groupSize), coalescing));
+            }
+
+            // TRIANGLE_BATCH_SIZE, triangle records are gathered by a coalescing node and drawn by one mesh node group per batch.
+            // With LINE_DISPATCH_GRID, the gathered record launches one group per groupSize triangles instead.
+            const auto gatherTriangles = [](std::vector<perf::NodeWorkload>& workloads, uint32_t gatherSize, uint32_t groupSize) {
+                perf::NodeWorkload& gather = *perf::FindNode(workloads, "TriangleMeshNode");
+                perf::NodeWorkload  mesh   = gather;
+
+                gather.name                  = "TriangleBatchNode";
+                gather.launch                = perf::LaunchMode::Coalescing;
+                gather.threadsPerGroup       = gatherSize;
+                gather.activeThreadsPerGroup = gatherSize;
+                gather.recordsPerGroup       = gatherSize;
+                gather.cyclesPerThread       = 10.0;
+                gather.allocationsPerGroup   = 1;
+                gather.verticesPerGroup      = 0;
+                gather.primitivesPerGroup    = 0;
+
+                mesh.name                  = "TriangleBatchMeshNode";
+                mesh.threadsPerGroup       = groupSize;
+                mesh.activeThreadsPerGroup = groupSize;
+                mesh.inputRecordBytes      = ((gatherSize > groupSize) ? 8 : 4) + 28 * gatherSize;
+                mesh.verticesPerGroup      = 3 * groupSize;
+                mesh.primitivesPerGroup    = groupSize;
+                // Assumes full grids, the last record of a level launches fewer groups
+                mesh.groupsPerRecord       = gatherSize / groupSize;
+                // Batches are drawn one level after the triangle records are gathered, at most at the level of the lines
+                mesh.recordsPerLevel.assign(gather.recordsPerLevel.size(), 0);
+                for (size_t level = 0; level + 1 < gather.recordsPerLevel.size(); ++level)
+                {
+                    mesh.recordsPerLevel[level + 1] = (gather.recordsPerLevel[level] + gatherSize - 1) / gatherSize;
+                }
+                workloads.push_back(mesh);
+            };
+
+            for (const uint32_t triangleBatchSize : TriangleBatchSizes)
+            {
+                std::vector<perf::NodeWorkload> batchedTriangles = sample;
+                gatherTriangles(batchedTriangles, triangleBatchSize, triangleBatchSize);
+
+                estimates.push_back(model.Evaluate("TriangleMeshNode batch " + std::to_string(triangleBatchSize), batchedTriangles));
+            }
+
+            // LINE_STRIP, the parents of the leaf invocations draw their four lines as one strip of 12 vertices and 10 triangles
+            if (depth > 0)
+            {
+                std::vector<perf::NodeWorkload> strips = sample;
+                perf::NodeWorkload& leaf = *perf::FindNode(strips, "SnowflakeNode leaf");
+                perf::NodeWorkload& line = *perf::FindNode(strips, "LineMeshNode");
+                line.activeThreadsPerGroup = 12;
+                line.inputRecordBytes      = 44;
+                line.verticesPerGroup      = 12;
+                line.primitivesPerGroup    = 10;
+
+                // Strips are drawn at the level of the leaf invocations, which are removed along with the last level
+                const size_t leafLevel = depth + 1;
+                line.recordsPerLevel[leafLevel] = leaf.recordsPerLevel[leafLevel] / 4;
+                leaf.recordsPerLevel[leafLevel] = 0;
+                for (perf::NodeWorkload& node : strips)
+                {
+                    node.recordsPerLevel.resize(leafLevel + 1);
+                }
+                estimates.push_back(model.Evaluate("LineMeshNode strips", strips));
+
+                // LINE_DISPATCH_GRID, the same records launch one LineMeshShader group per line,
+                // and the gathered triangle records one TriangleBatchMeshShader group per TriangleGridGroupSize triangles
+                std::vector<perf::NodeWorkload> dispatchGrid = sample;
+                perf::NodeWorkload& gridLeaf = *perf::FindNode(dispatchGrid, "SnowflakeNode leaf");
+                perf::NodeWorkload& gridLine = *perf::FindNode(dispatchGrid, "LineMeshNode");
+                gridLine.inputRecordBytes = 44;
+                gridLine.groupsPerRecord  = 4;
+                gridLine.recordsPerLevel[leafLevel] = gridLeaf.recordsPerLevel[leafLevel] / 4;
+                gridLeaf.recordsPerLevel[leafLevel] = 0;
+                for (perf::NodeWorkload& node : dispatchGrid)
+                {
+                    node.recordsPerLevel.resize(leafLevel + 1);
+                }
+                gatherTriangles(dispatchGrid, shader::TriangleGridGroupSize * shader::TriangleMaxDispatchGrid, shader::TriangleGridGroupSize);
+                estimates.push_back(model.Evaluate("mesh node dispatch grids", dispatchGrid));
+            }
+
+            // SNOWFLAKE_UNROLLED, every node of the chain only allocates the outputs of its level
+            // and the last node forwards its record without computing the Koch iteration
+            {
+                std::vector<perf::NodeWorkload> unrolled = sample;
+                perf::FindNode(unrolled, "SnowflakeNode")->allocationsPerGroup = 2;
+                perf::NodeWorkload& leaf = *perf::FindNode(unrolled, "SnowflakeNode leaf");
+                leaf.allocationsPerGroup = 1;
+                leaf.cyclesPerThread     = 8.0;
+                estimates.push_back(model.Evaluate("SnowflakeNode unrolled", unrolled));
+            }
+
+            // COMPACT_RECORDS, 8 byte records, which are packed by the producers and unpacked by the consumers
+            {
+                std::vector<perf::NodeWorkload> compact = sample;
+                for (const char* name : { "SnowflakeNode", "SnowflakeNode leaf", "LineMeshNode" })
+                {
+                    perf::NodeWorkload& node = *perf::FindNode(compact, name);
+                    node.inputRecordBytes = 8;
+                    node.cyclesPerThread += 4.0;
+                }
+                // Expanding invocations pack four lines and a triangle
+                perf::FindNode(compact, "SnowflakeNode")->cyclesPerThread += 10.0;
+                // The apex of a triangle is reconstructed from its base
+                perf::NodeWorkload& triangle = *perf::FindNode(compact, "TriangleMeshNode");
+                triangle.inputRecordBytes = 8;
+                triangle.cyclesPerThread += 12.0;
+                estimates.push_back(model.Evaluate("compact records", compact));
+            }
+
+            // MESH_NODE_ARRAY, SnowflakeNode allocates one draw record of the mesh node array instead of a triangle or a line.
+            // Line records grow to the size of triangle records.
+            {
+                std::vector<perf::NodeWorkload> meshNodeArray = sample;
+                for (const char* name : { "SnowflakeNode", "SnowflakeNode leaf" })
+                {
+                    perf::FindNode(meshNodeArray, name)->allocationsPerGroup = 2;
+                }
+                perf::FindNode(meshNodeArray, "LineMeshNode")->inputRecordBytes = 28;
+                estimates.push_back(model.Evaluate("mesh node array", meshNodeArray));
+            }
+
+            // SNOWFLAKE_EXPANSION_LEVELS, 16 or 64 child lines per invocation
+            for (uint32_t expansionLevels = 2; expansionLevels <= shader::MaxSnowflakeExpansionLevels; ++expansionLevels)
+            {
+                estimates.push_back(model.Evaluate("SnowflakeNode expansion " + std::to_string(expansionLevels),
+                    perf::GetSampleWorkload(depth, expansionLevels)));
+            }
+
+            printf("\n");
+            perf::PrintComparison(estimates);
+            printf("\n");
+        }
+    }
+
+    // View of frame index of count in the sweep of RunVideo: one third of a turn, which maps the snowflake onto itself,
+    // and a zoom in to maxZoom and back out. The zoom keeps the top corner of the snowflake, a point of the curve at every depth, in place.
+    cpu::ViewTransform SweepView(uint32_t index, uint32_t count, float maxZoom)
+    {
+        const float pi     = 3.14159265f;
+        const float t      = static_cast<float>(index) / count;
+        const float zoom   = 1.f + (maxZoom - 1.f) * (.5f - .5f * std::cos(2.f * pi * t));
+        const cpu::float2 target = { 0.f, .9f };
+
+        cpu::ViewTransform view;
+        view.rotation = t * 2.f * pi / 3.f;
+        view.zoom     = zoom;
+        view.center   = { target.x * (1.f - 1.f / zoom), target.y * (1.f - 1.f / zoom) };
+        return view;
+    }
+
+    bool RunVideo(const Options& options)
+    {
+        const uint32_t frames  = (options.frames > 0) ? options.frames : 240;
+        const uint32_t threads = options.threads.back();
+        const uint32_t depthCount = static_cast<uint32_t>(options.depths.size());
+
+        video::Y4mWriter writer;
+        if (!writer.Open(options.videoPath, ImageSize, ImageSize, options.videoFps))
+        {
+            return false;
+        }
+
+        cpu::Rasterizer rasterizer(ImageSize, ImageSize, threads);
+        cpu::GraphOutput graph;
+        cpu::MeshOutput  mesh;
+        uint32_t meshDepthIndex = depthCount;
+
+        double generationMs = 0.0;
+        double rasterMs     = 0.0;
+        const profiling::CpuTimer totalTimer;
+        for (uint32_t frame = 0; frame < frames; ++frame)
+        {
+            // The geometry does not depend on the view, thus it is generated once per depth
+            const uint32_t depthIndex = static_cast<uint32_t>(static_cast<uint64_t>(frame) * depthCount / frames);
+            profiling::CpuTimer timer;
+            if (depthIndex != meshDepthIndex)
+            {
+                cpu::ExecutorDesc desc = {};
+                desc.maxRecursionDepth = options.depths[depthIndex];
+                desc.threadCount       = threads;
+                cpu::Executor executor(desc);
+                executor.Run(graph);
+
+                mesh.Clear();
+                cpu::EmitMeshes(graph, mesh);
+                meshDepthIndex = depthIndex;
+                generationMs += timer.Lap();
+            }
+
+            rasterizer.Clear(0xffffffff, 1.f);
+            rasterizer.Draw(mesh, SweepView(frame, frames, options.videoZoom));
+            rasterMs += timer.Lap();
+
+            writer.Submit(rasterizer.GetImage());
+        }
+
+        const profiling::CpuTimer closeTimer;
+        if (!writer.Close())
+        {
+            return false;
+        }
+        const double closeMs = closeTimer.ElapsedMs();
+        const double totalMs = totalTimer.ElapsedMs();
+
+        // stdout may hold the video
+        const video::Y4mWriter::Statistics& statistics = writer.GetStatistics();
+        const double perFrame = 1.0 / std::max<uint64_t>(statistics.frames, 1);
+        fprintf(stderr, "Wrote %llu frames (%.1f MiB) of %ux%u Y4M video to %s in %.1f ms, %.1f frames/s\n",
+            static_cast<unsigned long long>(statistics.frames), statistics.bytes / (1024.0 * 1024.0), ImageSize, ImageSize,
+            (options.videoPath == "-") ? "stdout" : options.videoPath.c_str(), totalMs, statistics.frames * 1000.0 / totalMs);
+        fprintf(stderr, "  render thread: %.2f ms generation per depth, %.2f ms rasterization per frame, %.2f ms stalled in total\n",
+            generationMs / std::max(depthCount, 1u), rasterMs / frames, statistics.submitStallMs);
+        fprintf(stderr, "  writer thread: %.2f ms %s conversion and %.2f ms writing per frame, %.2f ms waiting for the last frames\n",
+            statistics.convertMs * perFrame, video::HasSimdConversion() ? "SSE2" : "scalar", statistics.writeMs * perFrame, closeMs);
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if ((argument == "--depths") && hasValue)
+        {
+            options.depths    = ParseList(argv[++i]);
+            options.depthsSet = true;
+        }
+        else if ((argument == "--threads") && hasValue)
+        {
+            options.threads    = ParseList(argv[++i]);
+            options.threadsSet = true;
+        }
+        else if ((argument == "--min-time-ms") && hasValue)
+        {
+            options.minTimeMs = std::stod(argv[++i]);
+        }
+        else if ((argument == "--format") && hasValue)
+        {
+            options.format = argv[++i];
+        }
+        else if ((argument == "--output") && hasValue)
+        {
+            options.output = argv[++i];
+        }
+        else if ((argument == "--filter") && hasValue)
+        {
+            options.filter = argv[++i];
+        }
+        else if ((argument == "--frames") && hasValue)
+        {
+            options.frames = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if ((argument == "--baseline") && hasValue)
+        {
+            options.baseline = argv[++i];
+        }
+        else if ((argument == "--write-baseline") && hasValue)
+        {
+            options.writeBaseline = argv[++i];
+        }
+        else if ((argument == "--repeats") && hasValue)
+        {
+            options.repeats    = std::max(static_cast<uint32_t>(std::stoul(argv[++i])), 1u);
+            options.repeatsSet = true;
+        }
+        else if ((argument == "--tolerance") && hasValue)
+        {
+            options.tolerance = std::stod(argv[++i]);
+        }
+        else if ((argument == "--required-repeats") && hasValue)
+        {
+            options.requiredRepeats = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (argument == "--perf-model")
+        {
+            options.perfModel = true;
+        }
+        else if (argument == "--mesh-lanes")
+        {
+            options.meshLanes = true;
+        }
+        else if (argument == "--culling")
+        {
+            options.culling = true;
+        }
+        else if ((argument == "--export-geometry") && hasValue)
+        {
+            options.exportGeometryPath = argv[++i];
+        }
+        else if ((argument == "--geometry") && hasValue)
+        {
+            options.geometryPath = argv[++i];
+        }
+        else if ((argument == "--write-frames") && hasValue)
+        {
+            options.writeFramesPrefix = argv[++i];
+        }
+        else if ((argument == "--stream-produce") && hasValue)
+        {
+            options.streamProduceName = argv[++i];
+        }
+        else if ((argument == "--stream-consume") && hasValue)
+        {
+            options.streamConsumeName = argv[++i];
+        }
+        else if ((argument == "--stream-consumers") && hasValue)
+        {
+            options.streamConsumers = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (argument == "--stream-benchmark")
+        {
+            options.streamBenchmark = true;
+        }
+        else if ((argument == "--video") && hasValue)
+        {
+            options.videoPath = argv[++i];
+        }
+        else if ((argument == "--video-fps") && hasValue)
+        {
+            options.videoFps = std::max(static_cast<uint32_t>(std::stoul(argv[++i])), 1u);
+        }
+        else if ((argument == "--video-zoom") && hasValue)
+        {
+            options.videoZoom = std::max(std::stof(argv[++i]), 1.f);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--depths 3,6,8] [--threads 1,8] [--min-time-ms 200] [--format json|csv] [--output file] [--filter name] [--frames N]\n"
+                            "       [--baseline file] [--write-baseline file] [--repeats 5] [--tolerance 0.1] [--required-repeats N] [--perf-model] [--mesh-lanes] [--culling]\n"
+                            "       [--export-geometry file] [--geometry file] [--write-frames prefix]\n"
+                            "       [--stream-produce name] [--stream-consumers 1] [--stream-consume name] [--stream-benchmark]\n"
+                            "       [--video file|-] [--video-fps 30] [--video-zoom 8]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (options.perfModel)
+    {
+        RunPerfModel(options);
+        return 0;
+    }
+
+    if (options.meshLanes)
+    {
+        RunMeshLaneReport(options);
+        return 0;
+    }
+
+    if (options.culling)
+    {
+        RunCullingReport(options);
+        return 0;
+    }
+
+    if (!options.exportGeometryPath.empty())
+    {
+        return RunGeometryExport(options) ? 0 : 1;
+    }
+
+    if (!options.streamProduceName.empty())
+    {
+        return RunStreamProducer(options) ? 0 : 1;
+    }
+
+    if (!options.streamConsumeName.empty())
+    {
+        return RunStreamConsumer(options) ? 0 : 1;
+    }
+
+    if (options.streamBenchmark)
+    {
+        return RunStreamBenchmark(options) ? 0 : 1;
+    }
+
+    if (!options.videoPath.empty())
+    {
+        return RunVideo(options) ? 0 : 1;
+    }
+
+    if (options.frames > 0)
+    {
+        std::vector<profiling::FrameBenchmarkReport> reports;
+        for (const uint32_t depth : options.depths)
+        {
+            for (const uint32_t threads : options.threads)
+            {
+                profiling::FrameBenchmarkReport report;
+                if (!RunFrameBenchmark(depth, threads, options.frames, options, report))
+                {
+                    return 1;
+                }
+                report.Print();
+                reports.push_back(report);
+            }
+        }
+
+        if (!options.output.empty() && !profiling::WriteFrameBenchmarks(options.output, reports))
+        {
+            fprintf(stderr, "ERROR: Failed to write %s\n", options.output.c_str());
+            return 1;
+        }
+
+        return 0;
+    }
+
+    std::map<std::string, BaselineEntry> baseline;
+    if (!options.baseline.empty())
+    {
+        if (!ReadBaseline(options.baseline, options.tolerance, baseline))
+        {
+            fprintf(stderr, "ERROR: Failed to read %s\n", options.baseline.c_str());
+            return 1;
+        }
+        ApplyBaselineDefaults(options, baseline);
+    }
+
+    std::vector<Suite> suites;
+    for (uint32_t repeat = 0; repeat < options.repeats; ++repeat)
+    {
+        suites.emplace_back(options);
+        Suite& suite = suites.back();
+        for (const uint32_t depth : options.depths)
+        {
+            for (const uint32_t threads : options.threads)
+            {
+                BenchmarkKochSubdivision(suite, depth, threads);
+                BenchmarkExecutor(suite, depth, threads);
+                BenchmarkRecordQueues(suite, depth, threads);
+                BenchmarkAllocation(suite, depth, threads);
+                BenchmarkRaster(suite, depth, threads);
+                BenchmarkMeshNodes(suite, depth, threads);
+                BenchmarkPngEncode(suite, depth, threads);
+                BenchmarkVideoConvert(suite, depth, threads);
+            }
+        }
+    }
+    const Suite& suite = suites.back();
+
+    if (!options.writeBaseline.empty() || !options.baseline.empty())
+    {
+        const std::vector<RepeatedResult> repeated = GatherRepeats(suites);
+
+        if (!options.writeBaseline.empty() && !WriteBaseline(options.writeBaseline, repeated, options.tolerance))
+        {
+            fprintf(stderr, "ERROR: Failed to write %s\n", options.writeBaseline.c_str());
+            return 1;
+        }
+
+        if (!options.baseline.empty())
+        {
+            const uint32_t regressions = CompareWithBaseline(options, repeated, baseline);
+            if (regressions > 0)
+            {
+                printf("%u regression(s) against %s\n", regressions, options.baseline.c_str());
+                return 1;
+            }
+            printf("No regressions against %s\n", options.baseline.c_str());
+        }
+
+        return 0;
+    }
+
+    if (options.output.empty())
+    {
+        suite.Write(std::cout);
+    }
+    else
+    {
+        std::ofstream file(options.output);
+        if (!file)
+        {
+            fprintf(stderr, "ERROR: Failed to open %s\n", options.output.c_str());
+            return 1;
+        }
+        suite.Write(file);
+    }
+
+    return 0;
+}
@@ -0,0 +1,490 @@
+/**********************************************************************
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+#include "CpuRasterizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace cpu {
+    namespace {
+        // Color palette for different depth levels, see GetTriangleColor in ShaderSource.h
+        uint32_t GetTriangleColor(uint32_t depth)
+        {
+            switch (depth % 4) {
+                case 0:  return PackColor(0.13f, 0.44f, 0.71f, 1.0f);
+                case 1:  return PackColor(0.42f, 0.68f, 0.84f, 1.0f);
+                case 2:  return PackColor(0.74f, 0.84f, 0.91f, 1.0f);
+                default: return PackColor(0.94f, 0.95f, 1.00f, 1.0f);
+            }
+        }
+
+        // Number of rows rasterized by one worker task
+        constexpr uint32_t StripHeight = 16;
+
+        void AddGroup(MeshOutput& output, uint32_t threadCount, uint32_t activeThreadCount)
+        {
+            output.groupCount        += 1;
+            output.threadCount       += threadCount;
+            output.waveCount         += (threadCount + MeshWaveSize - 1) / MeshWaveSize;
+            output.activeThreadCount += activeThreadCount;
+        }
+
+        bool CoversPixelCenter(float minPixel, float maxPixel)
+        {
+            const float firstCenter = std::ceil(minPixel - .5f) + .5f;
+            return firstCenter <= maxPixel;
+        }
+
+        bool IsBoundsVisible(float2 minPosition, float2 maxPosition, const CullingDesc& culling)
+        {
+            // Viewport transform, with y pointing down in pixel coordinates
+            const float  size     = static_cast<float>(culling.viewportSize);
+            const float2 minPixel = float2{ minPosition.x + 1.f, 1.f - maxPosition.y } * (.5f * size);
+            const float2 maxPixel = float2{ maxPosition.x + 1.f, 1.f - minPosition.y } * (.5f * size);
+
+            const bool onScreen = (maxPixel.x >= 0.f) && (maxPixel.y >= 0.f) && (minPixel.x <= size) && (minPixel.y <= size);
+            return onScreen && CoversPixelCenter(minPixel.x, maxPixel.x) && CoversPixelCenter(minPixel.y, maxPixel.y);
+        }
+    }
+
+    bool IsTriangleVisible(const float2 (&verts)[3], const CullingDesc& culling)
+    {
+        if (!culling.enabled)
+        {
+            return true;
+        }
+
+        const float  scale = .5f * culling.viewportSize;
+        const float2 edge1 = (verts[1] - verts[0]) * scale;
+        const float2 edge2 = (verts[2] - verts[0]) * scale;
+        const float  area  = std::abs(edge1.x * edge2.y - edge1.y * edge2.x) * .5f;
+
+        const float2 minPosition = { std::min({ verts[0].x, verts[1].x, verts[2].x }), std::min({ verts[0].y, verts[1].y, verts[2].y }) };
+        const float2 maxPosition = { std::max({ verts[0].x, verts[1].x, verts[2].x }), std::max({ verts[0].y, verts[1].y, verts[2].y }) };
+        return IsBoundsVisible(minPosition, maxPosition, culling) && (area >= culling.minPixelArea);
+    }
+
+    bool IsLineVisible(float2 start, float2 end, float lineWidth, const CullingDesc& culling)
+    {
+        if (!culling.enabled)
+        {
+            return true;
+        }
+
+        // The vertices of a line are at most 2 * lineWidth away from its end points
+        const float  extent      = 2.f * lineWidth;
+        const float2 minPosition = { std::min(start.x, end.x) - extent, std::min(start.y, end.y) - extent };
+        const float2 maxPosition = { std::max(start.x, end.x) + extent, std::max(start.y, end.y) + extent };
+        return IsBoundsVisible(minPosition, maxPosition, culling);
+    }
+
+    bool IsLineStripVisible(const LineStripRecord& record, float lineWidth, const CullingDesc& culling)
+    {
+        if (!culling.enabled)
+        {
+            return true;
+        }
+
+        // The joints of a Koch curve turn by at most 120 degrees, so the miter vertices are at most 2 * lineWidth away from the points as well
+        const uint32_t pointCount  = record.segmentCount + 1;
+        float2         minPosition = record.points[0];
+        float2         maxPosition = record.points[0];
+        for (uint32_t j = 1; j < pointCount; ++j)
+        {
+            minPosition = { std::min(minPosition.x, record.points[j].x), std::min(minPosition.y, record.points[j].y) };
+            maxPosition = { std::max(maxPosition.x, record.points[j].x), std::max(maxPosition.y, record.points[j].y) };
+        }
+
+        const float extent = 2.f * lineWidth;
+        return IsBoundsVisible({ minPosition.x - extent, minPosition.y - extent }, { maxPosition.x + extent, maxPosition.y + extent }, culling);
+    }
+
+    uint32_t PackColor(float r, float g, float b, float a)
+    {
+        const auto toUnorm8 = [](float value) {
+            return static_cast<uint32_t>(std::lround(std::min(std::max(value, 0.f), 1.f) * 255.f));
+        };
+        return toUnorm8(r) | (toUnorm8(g) << 8) | (toUnorm8(b) << 16) | (toUnorm8(a) << 24);
+    }
+
+    void LineMeshNode(const LineRecord& record, MeshOutput& output, const CullingDesc& culling)
+    {
+        const float lineWidth = 0.0075f;
+
+        // A culled line calls SetMeshOutputCounts(0, 0)
+        if (!IsLineVisible(record.start, record.end, lineWidth, culling))
+        {
+            AddGroup(output, 32, 0);
+            output.culledPrimitives += 4;
+            return;
+        }
+
+        // SetMeshOutputCounts(6, 4) of a [NumThreads(32, 1, 1)] group
+        // 6 threads write a vertex, the first 4 of them also a primitive
+        const uint32_t baseVertex = static_cast<uint32_t>(output.vertices.size());
+        AddGroup(output, 32, 6);
+
+        const uint32_t lineColor = PackColor(0.03f, 0.19f, 0.42f, 1.0f);
+        for (uint32_t gtid = 0; gtid < 4; ++gtid)
+        {
+            output.primitives.push_back({ { baseVertex, baseVertex + gtid + 1, baseVertex + gtid + 2 }, lineColor });
+        }
+
+        const float2 delta      = record.end - record.start;
+        const float  length     = std::sqrt(delta.x * delta.x + delta.y * delta.y);
+        const float2 direction  = delta * (1.f / length);
+        const float2 perpendicular = { direction.y, -direction.x };
+
+        const float2 offsets[3] = {
+            perpendicular,
+            direction * (std::sqrt(3.f) / 3.f),
+            perpendicular * -1.f,
+        };
+
+        for (uint32_t gtid = 0; gtid < 6; ++gtid)
+        {
+            // Shift entire line end outwards by sqrt(3) / 3.0 to align with connecting line
+            const float2 offset   = (direction * (std::sqrt(3.f) / 3.f)) + offsets[gtid % 3];
+            const float2 position = (gtid < 3) ? record.start - offset * lineWidth
+                                               : record.end   + offset * lineWidth;
+
+            output.vertices.push_back({ position.x, position.y, 0.25f });
+        }
+    }
+
+    void LineStripMeshNode(const LineStripRecord& record, MeshOutput& output, const CullingDesc& culling)
+    {
+        const float lineWidth = 0.0075f;
+
+        // A culled strip calls SetMeshOutputCounts(0, 0)
+        const uint32_t pointCount     = record.segmentCount + 1;
+        if (!IsLineStripVisible(record, lineWidth, culling))
+        {
+            AddGroup(output, 32, 0);
+            output.culledPrimitives += 2 * pointCount;
+            return;
+        }
+
+        // SetMeshOutputCounts(2 * pointCount + 2, 2 * pointCount) of a [NumThreads(32, 1, 1)] group
+        const uint32_t vertexCount    = 2 * pointCount + 2;
+        const uint32_t baseVertex     = static_cast<uint32_t>(output.vertices.size());
+        AddGroup(output, 32, vertexCount);
+
+        // Vertex on the perpendicular (side 0) or the opposite side (side 1) of point j, see GetStripVertex in ShaderSource.h
+        const auto stripVertex = [&](uint32_t j, uint32_t side) {
+            if (j == 0)
+            {
+                return baseVertex + ((side == 0) ? 2 : 0);
+            }
+            if (j == pointCount - 1)
+            {
+                return baseVertex + 2 * pointCount - 1 + 2 * side;
+            }
+            return baseVertex + 2 * j + 1 + side;
+        };
+
+        const uint32_t lineColor = PackColor(0.03f, 0.19f, 0.42f, 1.0f);
+        const uint32_t endVertex = baseVertex + vertexCount - 3;
+        output.primitives.push_back({ { baseVertex, baseVertex + 1, baseVertex + 2 }, lineColor });
+        for (uint32_t j = 0; j + 1 < pointCount; ++j)
+        {
+            output.primitives.push_back({ { stripVertex(j, 1), stripVertex(j, 0), stripVertex(j + 1, 0) }, lineColor });
+            output.primitives.push_back({ { stripVertex(j, 1), stripVertex(j + 1, 0), stripVertex(j + 1, 1) }, lineColor });
+        }
+        output.primitives.push_back({ { endVertex + 2, endVertex, endVertex + 1 }, lineColor });
+
+        const auto getDirection = [&](uint32_t segment) {
+            const float2 delta  = record.points[segment + 1] - record.points[segment];
+            const float  length = std::sqrt(delta.x * delta.x + delta.y * delta.y);
+            return delta * (1.f / length);
+        };
+
+        // Ends of the strip are shaped like the ends of a single line
+        const auto addEnd = [&](const float2 point, const float2 direction, float sign) {
+            const float2 perpendicular = { direction.y, -direction.x };
+            const float2 offsets[3] = {
+                perpendicular,
+                direction * (std::sqrt(3.f) / 3.f),
+                perpendicular * -1.f,
+            };
+            for (uint32_t i = 0; i < 3; ++i)
+            {
+                const float2 position = point + ((direction * (std::sqrt(3.f) / 3.f)) + offsets[i]) * (sign * lineWidth);
+                output.vertices.push_back({ position.x, position.y, 0.25f });
+            }
+        };
+
+        addEnd(record.points[0], getDirection(0), -1.f);
+
+        // Miter vertices of the joints between consecutive lines
+        for (uint32_t j = 1; j + 1 < pointCount; ++j)
+        {
+            const float2 d0 = getDirection(j - 1);
+            const float2 d1 = getDirection(j);
+            const float2 n0 = { d0.y, -d0.x };
+            const float2 sum = n0 + float2{ d1.y, -d1.x };
+            const float2 miter  = sum * (1.f / std::sqrt(sum.x * sum.x + sum.y * sum.y));
+            const float  length = lineWidth / (miter.x * n0.x + miter.y * n0.y);
+
+            for (const float side : { 1.f, -1.f })
+            {
+                const float2 position = record.points[j] + miter * (side * length);
+                output.vertices.push_back({ position.x, position.y, 0.25f });
+            }
+        }
+
+        addEnd(record.points[pointCount - 1], getDirection(record.segmentCount - 1), 1.f);
+    }
+
+    void TriangleMeshNode(const TriangleDrawRecord& record, MeshOutput& output, const CullingDesc& culling)
+    {
+        // A culled triangle calls SetMeshOutputCounts(0, 0)
+        if (!IsTriangleVisible(record.verts, culling))
+        {
+            AddGroup(output, 3, 0);
+            output.culledPrimitives += 1;
+            return;
+        }
+
+        // SetMeshOutputCounts(3, 1) of a [NumThreads(3, 1, 1)] group
+        const uint32_t baseVertex = static_cast<uint32_t>(output.vertices.size());
+        AddGroup(output, 3, 3);
+
+        output.primitives.push_back({ { baseVertex, baseVertex + 1, baseVertex + 2 }, GetTriangleColor(record.depth) });
+
+        for (uint32_t gtid = 0; gtid < 3; ++gtid)
+        {
+            output.vertices.push_back({ record.verts[gtid].x, record.verts[gtid].y, 0.5f });
+        }
+    }
+
+    void TriangleBatchMeshNode(const TriangleDrawRecord* records, uint32_t count, uint32_t batchSize, MeshOutput& output, const CullingDesc& culling)
+    {
+        // SetMeshOutputCounts(3 * visible, visible), one thread per triangle
+        uint32_t visibleCount = 0;
+        for (uint32_t gtid = 0; gtid < count; ++gtid)
+        {
+            visibleCount += IsTriangleVisible(records[gtid].verts, culling);
+        }
+        AddGroup(output, batchSize, visibleCount);
+        output.culledPrimitives += count - visibleCount;
+
+        for (uint32_t gtid = 0; gtid < count; ++gtid)
+        {
+            const TriangleDrawRecord& record = records[gtid];
+            if (!IsTriangleVisible(record.verts, culling))
+            {
+                continue;
+            }
+            const uint32_t vertex = static_cast<uint32_t>(output.vertices.size());
+            output.primitives.push_back({ { vertex, vertex + 1, vertex + 2 }, GetTriangleColor(record.depth) });
+
+            for (uint32_t i = 0; i < 3; ++i)
+            {
+                output.vertices.push_back({ record.verts[i].x, record.verts[i].y, 0.5f });
+            }
+        }
+    }
+
+    void EmitMeshes(const GraphOutput& draws, MeshOutput& output, uint32_t triangleBatchSize, const CullingDesc& culling)
+    {
+        output.vertices.reserve(output.vertices.size() + draws.triangles.size() * 3 + draws.lines.size() * 6 + draws.lineStrips.size() * 12);
+        output.primitives.reserve(output.primitives.size() + draws.triangles.size() + draws.lines.size() * 4 + draws.lineStrips.size() * 10);
+
+        DrawRecordView view;
+        view.triangles     = draws.triangles.data();
+        view.triangleCount = draws.triangles.size();
+        view.lines         = draws.lines.data();
+        view.lineCount     = draws.lines.size();
+        EmitMeshes(view, output, triangleBatchSize, culling);
+
+        for (const LineStripRecord& record : draws.lineStrips)
+        {
+            LineStripMeshNode(record, output, culling);
+        }
+    }
+
+    void EmitMeshes(const DrawRecordView& draws, MeshOutput& output, uint32_t triangleBatchSize, const CullingDesc& culling)
+    {
+        output.vertices.reserve(output.vertices.size() + draws.triangleCount * 3 + draws.lineCount * 6);
+        output.primitives.reserve(output.primitives.size() + draws.triangleCount + draws.lineCount * 4);
+
+        if (triangleBatchSize > 0)
+        {
+            // On the GPU, TriangleBatchNode gathers the records of a coalescing group in any order
+            const uint32_t triangleCount = static_cast<uint32_t>(draws.triangleCount);
+            for (uint32_t first = 0; first < triangleCount; first += triangleBatchSize)
+            {
+                const uint32_t count = std::min(triangleBatchSize, triangleCount - first);
+                TriangleBatchMeshNode(draws.triangles + first, count, triangleBatchSize, output, culling);
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < draws.triangleCount; ++i)
+            {
+                TriangleMeshNode(draws.triangles[i], output, culling);
+            }
+        }
+        for (size_t i = 0; i < draws.lineCount; ++i)
+        {
+            LineMeshNode(draws.lines[i], output, culling);
+        }
+    }
+
+    Rasterizer::Rasterizer(uint32_t width, uint32_t height, uint32_t threadCount)
+        : pool_(threadCount)
+    {
+        image_.width  = width;
+        image_.height = height;
+        image_.color.resize(static_cast<size_t>(width) * height);
+        image_.depth.resize(static_cast<size_t>(width) * height);
+    }
+
+    void Rasterizer::Clear(uint32_t color, float depth)
+    {
+        std::fill(image_.color.begin(), image_.color.end(), color);
+        std::fill(image_.depth.begin(), image_.depth.end(), depth);
+    }
+
+    void Rasterizer::Draw(const MeshOutput& mesh, const ViewTransform& view)
+    {
+        // View and viewport transform, with y pointing down in pixel coordinates
+        const bool  identity = (view.rotation == 0.f) && (view.zoom == 1.f) && (view.center.x == 0.f) && (view.center.y == 0.f);
+        const float cosZoom  = std::cos(view.rotation) * view.zoom;
+        const float sinZoom  = std::sin(view.rotation) * view.zoom;
+        screenVertices_.resize(mesh.vertices.size());
+        for (size_t i = 0; i < mesh.vertices.size(); ++i)
+        {
+            const MeshVertex& vertex = mesh.vertices[i];
+            float x = vertex.x;
+            float y = vertex.y;
+            if (!identity)
+            {
+                const float dx = x - view.center.x;
+                const float dy = y - view.center.y;
+                x = cosZoom * dx - sinZoom * dy;
+                y = sinZoom * dx + cosZoom * dy;
+            }
+            screenVertices_[i] = { (x + 1.f) * .5f * image_.width, (1.f - y) * .5f * image_.height, vertex.z };
+        }
+
+        // Bin primitives to the strips they overlap
+        const uint32_t stripCount = (image_.height + StripHeight - 1) / StripHeight;
+        stripPrimitives_.resize(stripCount);
+        for (std::vector<uint32_t>& primitives : stripPrimitives_)
+        {
+            primitives.clear();
+        }
+
+        for (uint32_t i = 0; i < static_cast<uint32_t>(mesh.primitives.size()); ++i)
+        {
+            const MeshPrimitive& primitive = mesh.primitives[i];
+            const float minY = std::min({ screenVertices_[primitive.indices[0]].y, screenVertices_[primitive.indices[1]].y, screenVertices_[primitive.indices[2]].y });
+            const float maxY = std::max({ screenVertices_[primitive.indices[0]].y, screenVertices_[primitive.indices[1]].y, screenVertices_[primitive.indices[2]].y });
+            if ((maxY < 0.f) || (minY >= image_.height))
+            {
+                continue;
+            }
+
+            const uint32_t firstStrip = static_cast<uint32_t>(std::max(minY, 0.f)) / StripHeight;
+            const uint32_t lastStrip  = std::min(static_cast<uint32_t>(maxY) / StripHeight, stripCount - 1);
+            for (uint32_t strip = firstStrip; strip <= lastStrip; ++strip)
+            {
+                stripPrimitives_[strip].push_back(i);
+            }
+        }
+
+        pool_.ParallelFor(stripCount, [&](uint32_t strip, uint32_t) {
+            DrawStrip(mesh, strip);
+        });
+    }
+
+    void Rasterizer::DrawStrip(const MeshOutput& mesh, uint32_t strip)
+    {
+        const uint32_t rowBegin = strip * StripHeight;
+        const uint32_t rowEnd   = std::min(rowBegin + StripHeight, image_.height);
+
+        for (const uint32_t primitiveIndex : stripPrimitives_[strip])
+        {
+            const MeshPrimitive& primitive = mesh.primitives[primitiveIndex];
+            MeshVertex v0 = screenVertices_[primitive.indices[0]];
+            MeshVertex v1 = screenVertices_[primitive.indices[1]];
+            MeshVertex v2 = screenVertices_[primitive.indices[2]];
+
+            float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+            if (area == 0.f)
+            {
+                continue;
+            }
+            // Culling is disabled, thus both windings are rasterized with the same edge functions
+            if (area < 0.f)
+            {
+                std::swap(v1, v2);
+                area = -area;
+            }
+
+            const float minY = std::min({ v0.y, v1.y, v2.y });
+            const float maxY = std::max({ v0.y, v1.y, v2.y });
+            const int   yBegin = std::max(static_cast<int>(std::floor(minY)), static_cast<int>(rowBegin));
+            const int   yEnd   = std::min(static_cast<int>(std::ceil(maxY)), static_cast<int>(rowEnd));
+            if (yBegin >= yEnd)
+            {
+                continue;
+            }
+
+            const float minX = std::min({ v0.x, v1.x, v2.x });
+            const float maxX = std::max({ v0.x, v1.x, v2.x });
+            const int   xBegin = std::max(static_cast<int>(std::floor(minX)), 0);
+            const int   xEnd   = std::min(static_cast<int>(std::ceil(maxX)), static_cast<int>(image_.width));
+
+            const float invArea = 1.f / area;
+
+            for (int y = yBegin; y < yEnd; ++y)
+            {
+                const float py = y + .5f;
+                for (int x = xBegin; x < xEnd; ++x)
+                {
+                    const float px = x + .5f;
+
+                    // Edge functions, positive inside
+                    const float w0 = (v2.x - v1.x) * (py - v1.y) - (v2.y - v1.y) * (px - v1.x);
+                    const float w1 = (v0.x - v2.x) * (py - v2.y) - (v0.y - v2.y) * (px - v2.x);
+                    const float w2 = (v1.x - v0.x) * (py - v0.y) - (v1.y - v0.y) * (px - v0.x);
+                    if ((w0 < 0.f) || (w1 < 0.f) || (w2 < 0.f))
+                    {
+                        continue;
+                    }
+
+                    const float z = (w0 * v0.z + w1 * v1.z + w2 * v2.z) * invArea;
+                    const size_t pixel = static_cast<size_t>(y) * image_.width + x;
+                    if (z < image_.depth[pixel])
+                    {
+                        image_.depth[pixel] = z;
+                        image_.color[pixel] = primitive.color;
+                    }
+                }
+            }
+        }
+    }
+}
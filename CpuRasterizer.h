@@ -0,0 +1,155 @@
+/**********************************************************************
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+#pragma once
+
+// CPU emulation of the two mesh nodes in ShaderSource.h and a simple rasterizer for their output.
+// Together with the executor in CpuWorkGraph.h, this renders the same image as the D3D12 sample.
+
+#include "CpuWorkGraph.h"
+
+namespace cpu {
+    // Wave size assumed for the lane utilization of the mesh node groups
+    constexpr uint32_t MeshWaveSize = 32;
+
+    struct MeshVertex
+    {
+        float x;
+        float y;
+        float z;
+    };
+
+    struct MeshPrimitive
+    {
+        uint32_t indices[3];
+        // RGBA8 color, red in the lowest byte
+        uint32_t color;
+    };
+
+    // Output of all mesh node groups, as written with SetMeshOutputCounts and the out vertices/indices/primitives arrays
+    struct MeshOutput
+    {
+        std::vector<MeshVertex>    vertices;
+        std::vector<MeshPrimitive> primitives;
+
+        // Number of launched mesh shader groups and threads
+        uint64_t groupCount  = 0;
+        uint64_t threadCount = 0;
+        // Waves occupied by the groups, each group starts a new wave, and threads writing a vertex or primitive
+        uint64_t waveCount         = 0;
+        uint64_t activeThreadCount = 0;
+        // Primitives not output by the groups with culling
+        uint64_t culledPrimitives  = 0;
+
+        void Clear()
+        {
+            vertices.clear();
+            primitives.clear();
+            groupCount        = 0;
+            threadCount       = 0;
+            waveCount         = 0;
+            activeThreadCount = 0;
+            culledPrimitives  = 0;
+        }
+
+        // Fraction of the wave lanes that write output
+        double GetLaneUtilization() const
+        {
+            return (waveCount > 0) ? static_cast<double>(activeThreadCount) / (waveCount * MeshWaveSize) : 0.0;
+        }
+    };
+
+    uint32_t PackColor(float r, float g, float b, float a);
+
+    // Culling of mesh node primitives (MESH_NODE_CULLING in ShaderSource.h)
+    struct CullingDesc
+    {
+        bool     enabled      = false;
+        // Size of the square viewport in pixels
+        uint32_t viewportSize = 0;
+        // Triangles with a smaller area in pixels are culled, even if they cover a pixel center
+        float    minPixelArea = shader::CullMinPixelArea;
+    };
+
+    // False if the primitive is off-screen or does not cover any pixel center, the same test as IsTriangleVisible, IsLineVisible and IsLineStripVisible in the HLSL source.
+    // Only primitives which cannot change the image are culled, unless minPixelArea is set.
+    bool IsTriangleVisible(const float2 (&verts)[3], const CullingDesc& culling);
+    bool IsLineVisible(float2 start, float2 end, float lineWidth, const CullingDesc& culling);
+    bool IsLineStripVisible(const LineStripRecord& record, float lineWidth, const CullingDesc& culling);
+
+    // Mesh node functions, mirroring the HLSL mesh shaders
+    void LineMeshNode(const LineRecord& record, MeshOutput& output, const CullingDesc& culling = {});
+    // Strip variant of the line mesh node (LINE_STRIP in ShaderSource.h), with shared miter vertices at the joints
+    void LineStripMeshNode(const LineStripRecord& record, MeshOutput& output, const CullingDesc& culling = {});
+    void TriangleMeshNode(const TriangleDrawRecord& record, MeshOutput& output, const CullingDesc& culling = {});
+    // Batched variant (TRIANGLE_BATCH_SIZE in ShaderSource.h), drawing count <= batchSize triangles with a [NumThreads(batchSize, 1, 1)] group.
+    // With culling, the visible triangles are compacted in order.
+    void TriangleBatchMeshNode(const TriangleDrawRecord* records, uint32_t count, uint32_t batchSize, MeshOutput& output, const CullingDesc& culling = {});
+
+    // Runs the mesh nodes for all draw records of a graph execution.
+    // With triangleBatchSize > 0, consecutive triangle records are drawn in batches of that size.
+    // Line strips are culled as a whole with their bounds.
+    void EmitMeshes(const GraphOutput& draws, MeshOutput& output, uint32_t triangleBatchSize = shader::TriangleBatchSize, const CullingDesc& culling = {});
+    // Same for records which are not held in a GraphOutput, e.g. precomputed geometry
+    void EmitMeshes(const DrawRecordView& draws, MeshOutput& output, uint32_t triangleBatchSize = shader::TriangleBatchSize, const CullingDesc& culling = {});
+
+    // RGBA8 color and 32 bit float depth render target
+    struct Image
+    {
+        uint32_t width  = 0;
+        uint32_t height = 0;
+        std::vector<uint32_t> color;
+        std::vector<float>    depth;
+    };
+
+    // 2D view transform applied to clip space positions before the viewport transform:
+    // positions are moved by -center, rotated counter-clockwise by rotation radians and scaled by zoom.
+    struct ViewTransform
+    {
+        float rotation = 0.f;
+        float zoom     = 1.f;
+        float2 center  = { 0.f, 0.f };
+    };
+
+    // Rasterizes mesh output with a depth test (less) and without culling, like the graphics state in CreateGWGStateObject.
+    // The image is split into horizontal strips, which are rasterized in parallel.
+    class Rasterizer
+    {
+    public:
+        Rasterizer(uint32_t width, uint32_t height, uint32_t threadCount);
+
+        void Clear(uint32_t color, float depth);
+        void Draw(const MeshOutput& mesh, const ViewTransform& view = {});
+
+        const Image& GetImage() const { return image_; }
+
+    private:
+        void DrawStrip(const MeshOutput& mesh, uint32_t strip);
+
+        Image      image_;
+        WorkerPool pool_;
+        // Vertex positions in pixel coordinates, transformed once per draw
+        std::vector<MeshVertex> screenVertices_;
+        // Indices of the primitives overlapping each strip, in draw order
+        std::vector<std::vector<uint32_t>> stripPrimitives_;
+    };
+}
@@ -0,0 +1,1135 @@
+/**********************************************************************
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+#include "CpuWorkGraph.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace cpu {
+    const char* GetCounterName(CounterSlot slot)
+    {
+        switch (slot) {
+            case EntryNodeInvocations:        return "EntryNode invocations";
+            case SnowflakeNodeInvocations:    return "SnowflakeNode invocations";
+            case TriangleMeshNodeInvocations: return "TriangleMeshNode invocations";
+            case LineMeshNodeInvocations:     return "LineMeshNode invocations";
+            case EntryToSnowflakeRecords:     return "EntryNode -> SnowflakeNode records";
+            case EntryToTriangleRecords:      return "EntryNode -> TriangleMeshNode records";
+            case SnowflakeToSnowflakeRecords: return "SnowflakeNode -> SnowflakeNode records";
+            case SnowflakeToTriangleRecords:  return "SnowflakeNode -> TriangleMeshNode records";
+            case SnowflakeToLineRecords:      return "SnowflakeNode -> LineMeshNode records";
+            default:                          return "unknown";
+        }
+    }
+
+    NodeCounters& NodeCounters::operator+=(const NodeCounters& other)
+    {
+        for (uint32_t i = 0; i < CounterCount; ++i)
+        {
+            values[i] += other.values[i];
+        }
+        return *this;
+    }
+
+    uint32_t GetSnowflakeRecursionDepth(uint32_t maxRecursionDepth, uint32_t expansionLevels)
+    {
+        expansionLevels = std::max(expansionLevels, 1u);
+        return (maxRecursionDepth + expansionLevels - 1) / expansionLevels;
+    }
+
+    NodeCounters ExpectedNodeCounters(uint32_t maxRecursionDepth, uint32_t expansionLevels, bool lineStrips)
+    {
+        // Each of the three initial lines forms a complete 4-ary tree of SnowflakeNode invocations:
+        // every level but the last emits four lines and a triangle, the last level emits a line draw.
+        const uint64_t leafCount     = 3ull << (2 * maxRecursionDepth);   // 3 * 4^depth
+        const uint64_t interiorCount = (1ull << (2 * maxRecursionDepth)) - 1; // 3 * (4^depth - 1) / 3
+
+        NodeCounters counters;
+        counters[EntryNodeInvocations]        = 1;
+        counters[EntryToSnowflakeRecords]     = 3;
+        counters[EntryToTriangleRecords]      = 1;
+        counters[SnowflakeNodeInvocations]    = interiorCount + leafCount;
+        counters[SnowflakeToSnowflakeRecords] = 4 * interiorCount;
+        counters[SnowflakeToTriangleRecords]  = interiorCount;
+        counters[SnowflakeToLineRecords]      = leafCount;
+        counters[TriangleMeshNodeInvocations] = interiorCount + 1;
+        counters[LineMeshNodeInvocations]     = leafCount;
+
+        // Expanding k iterations at once skips the invocations and records of the intermediate iterations.
+        // Draw records are not affected.
+        if (expansionLevels > 1)
+        {
+            uint64_t records     = 3;
+            uint64_t invocations = 0;
+            uint64_t children    = 0;
+            for (uint32_t iteration = 0; iteration < maxRecursionDepth; iteration += expansionLevels)
+            {
+                const uint32_t iterations = std::min(expansionLevels, maxRecursionDepth - iteration);
+                invocations += records;
+                records    <<= 2 * iterations;
+                children    += records;
+            }
+
+            counters[SnowflakeNodeInvocations]    = invocations + leafCount;
+            counters[SnowflakeToSnowflakeRecords] = children;
+        }
+
+        // Line strips replace the invocations of the last level, whose parents draw one strip each instead
+        if (lineStrips && (maxRecursionDepth > 0))
+        {
+            counters[SnowflakeNodeInvocations]    = interiorCount;
+            counters[SnowflakeToSnowflakeRecords] = 4 * interiorCount - leafCount;
+            counters[SnowflakeToLineRecords]      = leafCount / 4;
+            counters[LineMeshNodeInvocations]     = leafCount / 4;
+        }
+
+        return counters;
+    }
+
+    bool CompareNodeCounters(const char* nameA, const NodeCounters& a, const char* nameB, const NodeCounters& b)
+    {
+        bool equal = true;
+
+        printf("%-42s %12s %12s\n", "Counter", nameA, nameB);
+        for (uint32_t i = 0; i < CounterCount; ++i)
+        {
+            const CounterSlot slot = static_cast<CounterSlot>(i);
+            const bool match = a[slot] == b[slot];
+            printf("%-42s %12llu %12llu%s\n", GetCounterName(slot),
+                static_cast<unsigned long long>(a[slot]), static_cast<unsigned long long>(b[slot]), match ? "" : "  MISMATCH");
+            equal = equal && match;
+        }
+
+        return equal;
+    }
+
+    const char* GetNodeName(NodeId node)
+    {
+        switch (node) {
+            case EntryNodeId:        return "EntryNode";
+            case SnowflakeNodeId:    return "SnowflakeNode";
+            case TriangleMeshNodeId: return "TriangleMeshNode";
+            case LineMeshNodeId:     return "LineMeshNode";
+            default:                 return "unknown";
+        }
+    }
+
+    namespace {
+        // Node outputs as declared in ShaderSource.h
+        struct GraphEdge
+        {
+            NodeId      from;
+            NodeId      to;
+            uint32_t    maxRecords;
+            // The [MaxRecords(...)] budget is shared with the other edges of the same output (NodeOutputArray)
+            bool        sharedMaxRecords;
+            uint32_t    recordSize;
+            CounterSlot records;
+        };
+
+        // Outputs of the variant selected by desc. Variants are resolved in the same order as in Executor::Run.
+        std::vector<GraphEdge> GetGraphEdges(const ExecutorDesc& desc)
+        {
+            const bool     unrolledChain   = !desc.lineStrips && desc.unrolledChain;
+            const uint32_t expansionLevels = (desc.lineStrips || unrolledChain) ? 1 : std::max(desc.expansionLevels, 1u);
+            const uint32_t groupSize       = (desc.lineStrips || unrolledChain || (expansionLevels > 1)) ? 0 : desc.snowflakeGroupSize;
+
+            const uint32_t lineRecordSize     = desc.compactRecords ? sizeof(CompactLineRecord) : sizeof(LineRecord);
+            const uint32_t triangleRecordSize = desc.compactRecords ? sizeof(CompactTriangleRecord) : sizeof(TriangleDrawRecord);
+            // Entries of the mesh node array share the triangle record, line strips replace the lines of the last Koch iteration
+            uint32_t lineDrawRecordSize = desc.lineStrips ? sizeof(LineStripRecord) : lineRecordSize;
+            if (desc.meshNodeArray)
+            {
+                lineDrawRecordSize = sizeof(TriangleDrawRecord);
+            }
+
+            // Per thread, or per group with coalescing launch
+            uint32_t childRecords    = 4;
+            uint32_t triangleRecords = 1;
+            uint32_t lineRecords     = 1;
+            if (groupSize > 0)
+            {
+                childRecords    = 4 * groupSize;
+                triangleRecords = groupSize;
+                lineRecords     = groupSize;
+            }
+            else if (expansionLevels > 1)
+            {
+                childRecords    = 1u << (2 * expansionLevels);
+                triangleRecords = (childRecords - 1) / 3;
+            }
+
+            return {
+                { EntryNodeId,     SnowflakeNodeId,    3,               false,              lineRecordSize,     EntryToSnowflakeRecords },
+                { EntryNodeId,     TriangleMeshNodeId, 1,               desc.meshNodeArray, triangleRecordSize, EntryToTriangleRecords },
+                { SnowflakeNodeId, SnowflakeNodeId,    childRecords,    false,              lineRecordSize,     SnowflakeToSnowflakeRecords },
+                { SnowflakeNodeId, TriangleMeshNodeId, triangleRecords, desc.meshNodeArray, triangleRecordSize, SnowflakeToTriangleRecords },
+                { SnowflakeNodeId, LineMeshNodeId,     lineRecords,     desc.meshNodeArray, lineDrawRecordSize, SnowflakeToLineRecords },
+            };
+        }
+
+        const CounterSlot kNodeInvocations[NodeCount] = {
+            EntryNodeInvocations, SnowflakeNodeInvocations, TriangleMeshNodeInvocations, LineMeshNodeInvocations
+        };
+    }
+
+    bool WriteGraphviz(const std::string& path, const char* title, const ExecutorDesc& desc, const NodeCounters& counters, const NodeTimings& timings)
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            return false;
+        }
+
+        file << "digraph WorkGraph {\n"
+             << "    label=\"" << title << "\";\n"
+             << "    node [shape=box, style=rounded];\n";
+
+        for (uint32_t i = 0; i < NodeCount; ++i)
+        {
+            const NodeId node = static_cast<NodeId>(i);
+            file << "    " << GetNodeName(node) << " [label=\"" << GetNodeName(node)
+                 << "\\ninvocations: " << counters[kNodeInvocations[node]];
+            if (timings.ms[node] >= 0)
+            {
+                file << "\\ntime: " << timings.ms[node] << " ms";
+            }
+            else
+            {
+                file << "\\ntime: n/a";
+            }
+            // Mesh nodes are drawn with a different shape
+            file << "\"" << ((node == TriangleMeshNodeId || node == LineMeshNodeId) ? ", shape=ellipse" : "") << "];\n";
+        }
+
+        for (const GraphEdge& edge : GetGraphEdges(desc))
+        {
+            const uint64_t records = counters[edge.records];
+            file << "    " << GetNodeName(edge.from) << " -> " << GetNodeName(edge.to)
+                 << " [label=\"MaxRecords(" << edge.maxRecords << ")" << (edge.sharedMaxRecords ? " shared" : "") << "\\nrecords: " << records
+                 << "\\nbytes: " << records * edge.recordSize << "\"];\n";
+        }
+
+        file << "}\n";
+
+        return static_cast<bool>(file);
+    }
+
+    void PrintHighWaterMarks(const HighWaterMarks& marks, uint64_t minBackingMemoryBytes, uint64_t maxBackingMemoryBytes)
+    {
+        printf("%-20s %14s %14s\n", "Node queue", "peak records", "peak bytes");
+        for (uint32_t i = 0; i < NodeCount; ++i)
+        {
+            printf("%-20s %14llu %14llu\n", GetNodeName(static_cast<NodeId>(i)),
+                static_cast<unsigned long long>(marks.nodeRecords[i]), static_cast<unsigned long long>(marks.nodeBytes[i]));
+        }
+
+        printf("%-20s %14s %14s\n", "SnowflakeNode level", "records", "bytes");
+        for (size_t level = 0; level < marks.levelRecords.size(); ++level)
+        {
+            printf("%-20zu %14llu %14llu\n", level,
+                static_cast<unsigned long long>(marks.levelRecords[level]), static_cast<unsigned long long>(marks.levelBytes[level]));
+        }
+
+        printf("Peak open output allocations: %llu holding %llu records (%llu open invocations)\n",
+            static_cast<unsigned long long>(marks.openOutputAllocations), static_cast<unsigned long long>(marks.openOutputRecords),
+            static_cast<unsigned long long>(marks.openInvocations));
+        printf("Peak in-flight record bytes:  %llu\n", static_cast<unsigned long long>(marks.inFlightBytes));
+
+        if (maxBackingMemoryBytes > 0)
+        {
+            printf("Backing memory: min %llu bytes, max %llu bytes. Peak in-flight records use %.2f%% of the maximum.\n",
+                static_cast<unsigned long long>(minBackingMemoryBytes), static_cast<unsigned long long>(maxBackingMemoryBytes),
+                100.0 * marks.inFlightBytes / maxBackingMemoryBytes);
+        }
+    }
+
+    void EntryNode(NodeOutputs& outputs)
+    {
+        const float2 v0 = { 0.f, .9f };
+        const float2 v1 = { +std::sqrt(3.f) * .45f, -.45f };
+        const float2 v2 = { -std::sqrt(3.f) * .45f, -.45f };
+
+        outputs.snowflakeRecords.push_back({ v0, v1 });
+        outputs.snowflakeRecords.push_back({ v1, v2 });
+        outputs.snowflakeRecords.push_back({ v2, v0 });
+
+        outputs.draws.triangles.push_back({ { v0, v1, v2 }, 0 });
+
+        outputs.counters[EntryNodeInvocations] += 1;
+        outputs.counters[EntryToSnowflakeRecords] += 3;
+        outputs.counters[EntryToTriangleRecords] += 1;
+    }
+
+    void SnowflakeNode(const LineRecord& record, uint32_t remainingRecursionLevels, uint32_t maxRecursionDepth, NodeOutputs& outputs)
+    {
+        const float2 start = record.start;
+        const float2 end   = record.end;
+
+        const bool hasOutput = remainingRecursionLevels != 0;
+
+        if (hasOutput) {
+            const float2 perpendicular = float2{ start.y - end.y, end.x - start.x } * (std::sqrt(3.f) / 6.f);
+
+            const float2 triangleLeft  = lerp(start, end, 1.f / 3.f);
+            const float2 triangleMid   = lerp(start, end, .5f) + perpendicular;
+            const float2 triangleRight = lerp(start, end, 2.f / 3.f);
+
+            outputs.snowflakeRecords.push_back({ start, triangleLeft });
+            outputs.snowflakeRecords.push_back({ triangleLeft, triangleMid });
+            outputs.snowflakeRecords.push_back({ triangleMid, triangleRight });
+            outputs.snowflakeRecords.push_back({ triangleRight, end });
+
+            outputs.draws.triangles.push_back({ { triangleLeft, triangleMid, triangleRight }, 1 + (maxRecursionDepth - remainingRecursionLevels) });
+        } else {
+            outputs.draws.lines.push_back({ start, end });
+        }
+
+        outputs.counters[SnowflakeNodeInvocations] += 1;
+        outputs.counters[SnowflakeToSnowflakeRecords] += hasOutput * 4;
+        outputs.counters[SnowflakeToTriangleRecords] += hasOutput;
+        outputs.counters[SnowflakeToLineRecords] += !hasOutput;
+    }
+
+    void SnowflakeChainNode(const LineRecord& record, uint32_t depth, NodeOutputs& outputs)
+    {
+        const float2 start = record.start;
+        const float2 end   = record.end;
+
+        const float2 perpendicular = float2{ start.y - end.y, end.x - start.x } * (std::sqrt(3.f) / 6.f);
+
+        const float2 triangleLeft  = lerp(start, end, 1.f / 3.f);
+        const float2 triangleMid   = lerp(start, end, .5f) + perpendicular;
+        const float2 triangleRight = lerp(start, end, 2.f / 3.f);
+
+        outputs.snowflakeRecords.push_back({ start, triangleLeft });
+        outputs.snowflakeRecords.push_back({ triangleLeft, triangleMid });
+        outputs.snowflakeRecords.push_back({ triangleMid, triangleRight });
+        outputs.snowflakeRecords.push_back({ triangleRight, end });
+
+        outputs.draws.triangles.push_back({ { triangleLeft, triangleMid, triangleRight }, depth });
+
+        outputs.counters[SnowflakeNodeInvocations] += 1;
+        outputs.counters[SnowflakeToSnowflakeRecords] += 4;
+        outputs.counters[SnowflakeToTriangleRecords] += 1;
+    }
+
+    void SnowflakeChainLeaf(const LineRecord& record, NodeOutputs& outputs)
+    {
+        outputs.draws.lines.push_back(record);
+
+        outputs.counters[SnowflakeNodeInvocations] += 1;
+        outputs.counters[SnowflakeToLineRecords] += 1;
+    }
+
+    void SnowflakeNodeGroup(const LineRecord* records, uint32_t recordCount, uint32_t remainingRecursionLevels, uint32_t maxRecursionDepth, NodeOutputs& outputs)
+    {
+        const bool hasOutput = remainingRecursionLevels != 0;
+
+        // GetGroupNodeOutputRecords for all records of the group
+        const size_t firstSnowflake = outputs.snowflakeRecords.size();
+        const size_t firstTriangle  = outputs.draws.triangles.size();
+        const size_t firstLine      = outputs.draws.lines.size();
+        outputs.snowflakeRecords.resize(firstSnowflake + hasOutput * 4 * recordCount);
+        outputs.draws.triangles.resize(firstTriangle + hasOutput * recordCount);
+        outputs.draws.lines.resize(firstLine + !hasOutput * recordCount);
+
+        for (uint32_t gtid = 0; gtid < recordCount; ++gtid)
+        {
+            const float2 start = records[gtid].start;
+            const float2 end   = records[gtid].end;
+
+            if (hasOutput) {
+                const float2 perpendicular = float2{ start.y - end.y, end.x - start.x } * (std::sqrt(3.f) / 6.f);
+
+                const float2 triangleLeft  = lerp(start, end, 1.f / 3.f);
+                const float2 triangleMid   = lerp(start, end, .5f) + perpendicular;
+                const float2 triangleRight = lerp(start, end, 2.f / 3.f);
+
+                LineRecord* children = &outputs.snowflakeRecords[firstSnowflake + 4 * gtid];
+                children[0] = { start, triangleLeft };
+                children[1] = { triangleLeft, triangleMid };
+                children[2] = { triangleMid, triangleRight };
+                children[3] = { triangleRight, end };
+
+                outputs.draws.triangles[firstTriangle + gtid] = { { triangleLeft, triangleMid, triangleRight }, 1 + (maxRecursionDepth - remainingRecursionLevels) };
+            } else {
+                outputs.draws.lines[firstLine + gtid] = { start, end };
+            }
+        }
+
+        outputs.counters[SnowflakeNodeInvocations] += recordCount;
+        outputs.counters[SnowflakeToSnowflakeRecords] += hasOutput * 4 * recordCount;
+        outputs.counters[SnowflakeToTriangleRecords] += hasOutput * recordCount;
+        outputs.counters[SnowflakeToLineRecords] += !hasOutput * recordCount;
+    }
+
+    void SnowflakeNodeExpanded(const LineRecord& record, uint32_t remainingRecursionLevels, uint32_t maxRecursionDepth, uint32_t expansionLevels, NodeOutputs& outputs)
+    {
+        const float2 start = record.start;
+        const float2 end   = record.end;
+
+        const bool hasOutput = remainingRecursionLevels != 0;
+
+        const uint32_t iteration  = (GetSnowflakeRecursionDepth(maxRecursionDepth, expansionLevels) - remainingRecursionLevels) * expansionLevels;
+        const uint32_t iterations = hasOutput ? std::min(expansionLevels, maxRecursionDepth - iteration) : 0;
+        const uint32_t childCount    = hasOutput * (1u << (2 * iterations));
+        const uint32_t triangleCount = hasOutput * ((1u << (2 * iterations)) - 1) / 3;
+
+        // Returns segment 'index' of the 4^segmentIterations segments, see GetKochSegment in ShaderSource.h
+        const auto getSegment = [&](uint32_t segmentIterations, uint32_t index) {
+            LineRecord segment = { start, end };
+            for (uint32_t i = 0; i < segmentIterations; ++i)
+            {
+                const float2 perpendicular = float2{ segment.start.y - segment.end.y, segment.end.x - segment.start.x } * (std::sqrt(3.f) / 6.f);
+
+                const float2 points[5] = {
+                    segment.start,
+                    lerp(segment.start, segment.end, 1.f / 3.f),
+                    lerp(segment.start, segment.end, .5f) + perpendicular,
+                    lerp(segment.start, segment.end, 2.f / 3.f),
+                    segment.end,
+                };
+
+                const uint32_t part = (index >> (2 * (segmentIterations - 1 - i))) & 3;
+                segment = { points[part], points[part + 1] };
+            }
+            return segment;
+        };
+
+        if (hasOutput) {
+            for (uint32_t child = 0; child < childCount; ++child)
+            {
+                outputs.snowflakeRecords.push_back(getSegment(iterations, child));
+            }
+
+            for (uint32_t i = 0; i < iterations; ++i)
+            {
+                for (uint32_t s = 0; s < (1u << (2 * i)); ++s)
+                {
+                    const LineRecord segment = getSegment(i, s);
+                    const float2 perpendicular = float2{ segment.start.y - segment.end.y, segment.end.x - segment.start.x } * (std::sqrt(3.f) / 6.f);
+
+                    outputs.draws.triangles.push_back({ {
+                        lerp(segment.start, segment.end, 1.f / 3.f),
+                        lerp(segment.start, segment.end, .5f) + perpendicular,
+                        lerp(segment.start, segment.end, 2.f / 3.f) }, 1 + iteration + i });
+                }
+            }
+        } else {
+            outputs.draws.lines.push_back({ start, end });
+        }
+
+        outputs.counters[SnowflakeNodeInvocations] += 1;
+        outputs.counters[SnowflakeToSnowflakeRecords] += childCount;
+        outputs.counters[SnowflakeToTriangleRecords] += triangleCount;
+        outputs.counters[SnowflakeToLineRecords] += !hasOutput;
+    }
+
+    void SnowflakeNodeStrip(const LineRecord& record, uint32_t remainingRecursionLevels, uint32_t maxRecursionDepth, NodeOutputs& outputs)
+    {
+        const float2 start = record.start;
+        const float2 end   = record.end;
+
+        const bool hasChildren = remainingRecursionLevels > 1;
+        const bool hasTriangle = remainingRecursionLevels != 0;
+
+        const float2 perpendicular = float2{ start.y - end.y, end.x - start.x } * (std::sqrt(3.f) / 6.f);
+
+        const float2 points[5] = {
+            start,
+            lerp(start, end, 1.f / 3.f),
+            lerp(start, end, .5f) + perpendicular,
+            lerp(start, end, 2.f / 3.f),
+            end,
+        };
+
+        if (hasChildren) {
+            for (uint32_t i = 0; i < 4; ++i)
+            {
+                outputs.snowflakeRecords.push_back({ points[i], points[i + 1] });
+            }
+        }
+
+        if (hasTriangle) {
+            outputs.draws.triangles.push_back({ { points[1], points[2], points[3] }, 1 + (maxRecursionDepth - remainingRecursionLevels) });
+        }
+
+        if (!hasChildren) {
+            LineStripRecord strip;
+            strip.segmentCount = hasTriangle ? 4 : 1;
+            for (uint32_t i = 0; i < 5; ++i)
+            {
+                strip.points[i] = hasTriangle ? points[i] : ((i == 0) ? start : end);
+            }
+            outputs.draws.lineStrips.push_back(strip);
+        }
+
+        outputs.counters[SnowflakeNodeInvocations] += 1;
+        outputs.counters[SnowflakeToSnowflakeRecords] += hasChildren * 4;
+        outputs.counters[SnowflakeToTriangleRecords] += hasTriangle;
+        outputs.counters[SnowflakeToLineRecords] += !hasChildren;
+    }
+
+    GraphOutput ExpandLineStrips(const GraphOutput& output)
+    {
+        GraphOutput expanded;
+        expanded.triangles = output.triangles;
+        expanded.lines     = output.lines;
+        for (const LineStripRecord& strip : output.lineStrips)
+        {
+            for (uint32_t i = 0; i < strip.segmentCount; ++i)
+            {
+                expanded.lines.push_back({ strip.points[i], strip.points[i + 1] });
+            }
+        }
+        return expanded;
+    }
+
+    void DispatchGridReport::Print() const
+    {
+        printf("%s dispatch grids: %llu records of %u bytes, %llu groups, largest grid %u, %llu invalid grids\n",
+            node, static_cast<unsigned long long>(records), recordBytes, static_cast<unsigned long long>(groups), maxGrid,
+            static_cast<unsigned long long>(invalidGrids));
+    }
+
+    DispatchGridReport CheckLineDispatchGrids(const GraphOutput& output, uint32_t maxDispatchGrid)
+    {
+        DispatchGridReport report;
+        report.node        = "LineMeshNode";
+        report.recordBytes = sizeof(LineStripRecord);
+
+        // A grid is at most the lines of a record, and must be within the D3D12 limits
+        const uint32_t gridLimit = std::min({ maxDispatchGrid, static_cast<uint32_t>(shader::LineMaxDispatchGrid), MaxDispatchGridPerDimension, MaxMeshNodeDispatchGroups });
+        for (const LineStripRecord& record : output.lineStrips)
+        {
+            report.records += 1;
+            report.groups  += record.segmentCount;
+            report.maxGrid  = std::max(report.maxGrid, record.segmentCount);
+            report.invalidGrids += (record.segmentCount == 0) || (record.segmentCount > gridLimit);
+        }
+
+        return report;
+    }
+
+    DispatchGridReport CheckTriangleDispatchGrids(const GraphOutput& output, uint32_t groupSize, uint32_t maxDispatchGrid)
+    {
+        DispatchGridReport report;
+        report.node        = "TriangleBatchMeshNode";
+        report.recordBytes = sizeof(TriangleGridRecord);
+
+        const uint32_t gatherSize = shader::TriangleGridGroupSize * shader::TriangleMaxDispatchGrid;
+        const uint32_t gridLimit  = std::min({ maxDispatchGrid, static_cast<uint32_t>(shader::TriangleMaxDispatchGrid), MaxDispatchGridPerDimension, MaxMeshNodeDispatchGroups });
+        for (size_t first = 0; first < output.triangles.size(); first += gatherSize)
+        {
+            const uint32_t count = static_cast<uint32_t>(std::min<size_t>(output.triangles.size() - first, gatherSize));
+            const uint32_t grid  = (count + groupSize - 1) / groupSize;
+
+            report.records += 1;
+            report.groups  += grid;
+            report.maxGrid  = std::max(report.maxGrid, grid);
+            report.invalidGrids += (grid == 0) || (grid > gridLimit);
+        }
+
+        return report;
+    }
+
+    namespace {
+        uint32_t PackSnorm(float value, uint32_t bits)
+        {
+            const float scale = static_cast<float>((1u << (bits - 1)) - 1);
+            return static_cast<uint32_t>(static_cast<int32_t>(std::round(std::min(std::max(value, -1.f), 1.f) * scale))) & ((1u << bits) - 1);
+        }
+
+        float UnpackSnorm(uint32_t packed, uint32_t bits)
+        {
+            const float scale = static_cast<float>((1u << (bits - 1)) - 1);
+            // Sign extend the lowest bits
+            const int32_t value = static_cast<int32_t>(packed << (32 - bits)) >> (32 - bits);
+            return std::max(value / scale, -1.f);
+        }
+
+        // Maximum rounding error of a snorm coordinate
+        double GetSnormError(uint32_t bits)
+        {
+            return .5 / ((1u << (bits - 1)) - 1);
+        }
+
+        // Records as seen by the consumers, after they have been written with the compact encoding
+        void RoundTripCompactRecords(std::vector<LineRecord>& lines)
+        {
+            for (LineRecord& line : lines)
+            {
+                line = DecodeLineRecord(EncodeLineRecord(line));
+            }
+        }
+
+        void RoundTripCompactRecords(NodeOutputs& outputs)
+        {
+            RoundTripCompactRecords(outputs.snowflakeRecords);
+            RoundTripCompactRecords(outputs.draws.lines);
+            for (TriangleDrawRecord& triangle : outputs.draws.triangles)
+            {
+                triangle = DecodeTriangleRecord(EncodeTriangleRecord(triangle));
+            }
+        }
+    }
+
+    CompactLineRecord EncodeLineRecord(const LineRecord& record)
+    {
+        return { {
+            PackSnorm(record.start.x, 16) | (PackSnorm(record.start.y, 16) << 16),
+            PackSnorm(record.end.x, 16) | (PackSnorm(record.end.y, 16) << 16),
+        } };
+    }
+
+    LineRecord DecodeLineRecord(const CompactLineRecord& record)
+    {
+        return {
+            { UnpackSnorm(record.endpoints[0], 16), UnpackSnorm(record.endpoints[0] >> 16, 16) },
+            { UnpackSnorm(record.endpoints[1], 16), UnpackSnorm(record.endpoints[1] >> 16, 16) },
+        };
+    }
+
+    CompactTriangleRecord EncodeTriangleRecord(const TriangleDrawRecord& record)
+    {
+        const float2 base = record.verts[2] - record.verts[0];
+        const float2 apex = record.verts[1] - record.verts[0];
+        const bool clockwise = (base.x * apex.y - base.y * apex.x) < 0.f;
+
+        return { {
+            PackSnorm(record.verts[0].x, 14) | (PackSnorm(record.verts[0].y, 14) << 14) | (std::min(record.depth, 15u) << 28),
+            PackSnorm(record.verts[2].x, 14) | (PackSnorm(record.verts[2].y, 14) << 14) | (static_cast<uint32_t>(clockwise) << 28),
+        } };
+    }
+
+    TriangleDrawRecord DecodeTriangleRecord(const CompactTriangleRecord& record)
+    {
+        const float2 v0 = { UnpackSnorm(record.base[0], 14), UnpackSnorm(record.base[0] >> 14, 14) };
+        const float2 v2 = { UnpackSnorm(record.base[1], 14), UnpackSnorm(record.base[1] >> 14, 14) };
+        const float side = ((record.base[1] >> 28) & 1) ? -1.f : 1.f;
+        const float2 v1 = lerp(v0, v2, .5f) + float2{ v0.y - v2.y, v2.x - v0.x } * (side * std::sqrt(3.f) / 2.f);
+
+        return { { v0, v1, v2 }, record.base[0] >> 28 };
+    }
+
+    void CompactRecordError::Print() const
+    {
+        printf("Compact records: line error %.3g (bound %.3g), triangle error %.3g (bound %.3g), %llu mismatches\n",
+            lineError, lineBound, triangleError, triangleBound, static_cast<unsigned long long>(mismatches));
+    }
+
+    CompactRecordError MeasureCompactRecordError(uint32_t maxRecursionDepth, const GraphOutput& exact, const GraphOutput& compact)
+    {
+        CompactRecordError error;
+
+        // Every SnowflakeNode level computes its lines from the rounded lines of the previous level.
+        // Lerp keeps the error of its inputs, the perpendicular offset adds 1 / sqrt(3) of it, then the result is rounded again.
+        // Triangles are rounded from their base, the apex adds sqrt(3) times the error of the base.
+        // A small absolute term accounts for float arithmetic.
+        const double floatError = 1e-6;
+        double recordError   = GetSnormError(16);
+        double triangleBound = (1.0 + std::sqrt(3.0)) * GetSnormError(14);
+        for (uint32_t level = 0; level < maxRecursionDepth; ++level)
+        {
+            triangleBound = std::max(triangleBound, (1.0 + std::sqrt(3.0)) * (recordError + GetSnormError(14)));
+            recordError   = recordError * (1.0 + 1.0 / std::sqrt(3.0)) + GetSnormError(16);
+        }
+        error.lineBound     = recordError + floatError;
+        error.triangleBound = triangleBound + floatError;
+
+        const auto updateError = [](double& maxError, float2 a, float2 b) {
+            maxError = std::max({ maxError, static_cast<double>(std::abs(a.x - b.x)), static_cast<double>(std::abs(a.y - b.y)) });
+        };
+
+        if ((exact.lines.size() != compact.lines.size()) || (exact.triangles.size() != compact.triangles.size()))
+        {
+            error.mismatches = 1;
+            return error;
+        }
+
+        for (size_t i = 0; i < exact.lines.size(); ++i)
+        {
+            updateError(error.lineError, exact.lines[i].start, compact.lines[i].start);
+            updateError(error.lineError, exact.lines[i].end, compact.lines[i].end);
+        }
+
+        for (size_t i = 0; i < exact.triangles.size(); ++i)
+        {
+            for (uint32_t v = 0; v < 3; ++v)
+            {
+                updateError(error.triangleError, exact.triangles[i].verts[v], compact.triangles[i].verts[v]);
+            }
+            error.mismatches += exact.triangles[i].depth != compact.triangles[i].depth;
+        }
+
+        return error;
+    }
+
+    bool HasIdenticalGeometry(const GraphOutput& a, const GraphOutput& b)
+    {
+        return (a.triangles.size() == b.triangles.size()) && (a.lines.size() == b.lines.size()) && (a.lineStrips.size() == b.lineStrips.size()) &&
+            std::equal(a.triangles.begin(), a.triangles.end(), b.triangles.begin(), [](const TriangleDrawRecord& x, const TriangleDrawRecord& y) {
+                return memcmp(&x, &y, sizeof(TriangleDrawRecord)) == 0;
+            }) &&
+            std::equal(a.lines.begin(), a.lines.end(), b.lines.begin(), [](const LineRecord& x, const LineRecord& y) {
+                return memcmp(&x, &y, sizeof(LineRecord)) == 0;
+            }) &&
+            std::equal(a.lineStrips.begin(), a.lineStrips.end(), b.lineStrips.begin(), [](const LineStripRecord& x, const LineStripRecord& y) {
+                return memcmp(&x, &y, sizeof(LineStripRecord)) == 0;
+            });
+    }
+
+    bool HasEquivalentGeometry(const GraphOutput& a, const GraphOutput& b)
+    {
+        const auto sortRecords = [](GraphOutput output) {
+            std::sort(output.triangles.begin(), output.triangles.end(), [](const TriangleDrawRecord& x, const TriangleDrawRecord& y) {
+                return memcmp(&x, &y, sizeof(TriangleDrawRecord)) < 0;
+            });
+            std::sort(output.lines.begin(), output.lines.end(), [](const LineRecord& x, const LineRecord& y) {
+                return memcmp(&x, &y, sizeof(LineRecord)) < 0;
+            });
+            std::sort(output.lineStrips.begin(), output.lineStrips.end(), [](const LineStripRecord& x, const LineStripRecord& y) {
+                return memcmp(&x, &y, sizeof(LineStripRecord)) < 0;
+            });
+            return output;
+        };
+        return HasIdenticalGeometry(sortRecords(a), sortRecords(b));
+    }
+
+    WorkerPool::WorkerPool(uint32_t threadCount)
+    {
+        for (uint32_t worker = 1; worker < std::max(threadCount, 1u); ++worker)
+        {
+            threads_.emplace_back(&WorkerPool::WorkerLoop, this, worker);
+        }
+    }
+
+    WorkerPool::~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            exit_ = true;
+        }
+        wake_.notify_all();
+
+        for (std::thread& thread : threads_)
+        {
+            thread.join();
+        }
+    }
+
+    void WorkerPool::ParallelFor(uint32_t count, const std::function<void(uint32_t index, uint32_t worker)>& task)
+    {
+        if (threads_.empty() || count <= 1)
+        {
+            for (uint32_t index = 0; index < count; ++index)
+            {
+                task(index, 0);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            task_          = &task;
+            taskCount_     = count;
+            nextTask_      = 0;
+            activeWorkers_ = static_cast<uint32_t>(threads_.size());
+            ++generation_;
+        }
+        wake_.notify_all();
+
+        RunTasks(0);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return activeWorkers_ == 0; });
+        task_ = nullptr;
+    }
+
+    void WorkerPool::WorkerLoop(uint32_t worker)
+    {
+        uint64_t generation = 0;
+
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&] { return exit_ || generation_ != generation; });
+                if (exit_)
+                {
+                    return;
+                }
+                generation = generation_;
+            }
+
+            RunTasks(worker);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                --activeWorkers_;
+            }
+            done_.notify_one();
+        }
+    }
+
+    void WorkerPool::RunTasks(uint32_t worker)
+    {
+        while (true)
+        {
+            uint32_t index;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (nextTask_ >= taskCount_)
+                {
+                    return;
+                }
+                index = nextTask_++;
+            }
+
+            (*task_)(index, worker);
+        }
+    }
+
+    TraceRecorder::TraceRecorder(uint32_t threadCount)
+        : origin_(Clock::now()), workerEvents_(std::max(threadCount, 1u))
+    {
+    }
+
+    void TraceRecorder::Reset()
+    {
+        origin_ = Clock::now();
+        for (std::vector<Event>& events : workerEvents_)
+        {
+            events.clear();
+        }
+    }
+
+    double TraceRecorder::ToUs(Clock::time_point time) const
+    {
+        return std::chrono::duration<double, std::micro>(time - origin_).count();
+    }
+
+    void TraceRecorder::AddSlice(uint32_t worker, const char* node, uint32_t level, uint32_t recordCount,
+        Clock::time_point begin, Clock::time_point end)
+    {
+        workerEvents_[worker].push_back({ node, 'X', level, recordCount, ToUs(begin), ToUs(end) - ToUs(begin) });
+    }
+
+    void TraceRecorder::AddCounter(uint32_t worker, const char* name, uint64_t value, Clock::time_point time)
+    {
+        workerEvents_[worker].push_back({ name, 'C', 0, value, ToUs(time), 0 });
+    }
+
+    bool TraceRecorder::WriteJson(const std::string& path) const
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            return false;
+        }
+
+        file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+
+        // One lane per worker thread
+        for (size_t worker = 0; worker < workerEvents_.size(); ++worker)
+        {
+            file << ((worker == 0) ? "" : ",\n")
+                 << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " << worker
+                 << ", \"args\": {\"name\": \"worker " << worker << "\"}}";
+        }
+
+        for (size_t worker = 0; worker < workerEvents_.size(); ++worker)
+        {
+            for (const Event& event : workerEvents_[worker])
+            {
+                file << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"" << event.phase
+                     << "\", \"pid\": 0, \"tid\": " << worker << ", \"ts\": " << event.beginUs;
+                if (event.phase == 'X')
+                {
+                    file << ", \"dur\": " << event.durationUs
+                         << ", \"args\": {\"level\": " << event.level << ", \"records\": " << event.value << "}}";
+                }
+                else
+                {
+                    file << ", \"args\": {\"value\": " << event.value << "}}";
+                }
+            }
+        }
+
+        file << "\n]}\n";
+
+        return static_cast<bool>(file);
+    }
+
+    Executor::Executor(const ExecutorDesc& desc)
+        : desc_(desc), pool_(desc.threadCount)
+    {
+        desc_.batchSize = std::max(desc_.batchSize, 1u);
+        desc_.expansionLevels = std::max(desc_.expansionLevels, 1u);
+        if (desc_.meshNodeArray)
+        {
+            desc_.compactRecords = false;
+        }
+        if (desc_.unrolledChain)
+        {
+            desc_.meshNodeArray = false;
+        }
+        if (desc_.compactRecords || desc_.meshNodeArray || desc_.unrolledChain)
+        {
+            desc_.lineStrips = false;
+        }
+        if (desc_.lineStrips || desc_.compactRecords || desc_.meshNodeArray || desc_.unrolledChain)
+        {
+            desc_.expansionLevels = 1;
+        }
+        if ((desc_.expansionLevels > 1) || desc_.lineStrips || desc_.compactRecords || desc_.meshNodeArray || desc_.unrolledChain)
+        {
+            desc_.snowflakeGroupSize = 0;
+        }
+        // Thread groups are never split across batches
+        if (desc_.snowflakeGroupSize > 0)
+        {
+            desc_.batchSize = (desc_.batchSize + desc_.snowflakeGroupSize - 1) / desc_.snowflakeGroupSize * desc_.snowflakeGroupSize;
+        }
+    }
+
+    void Executor::Run(GraphOutput& output)
+    {
+        output.Clear();
+        counters_ = {};
+        timings_  = {};
+        highWaterMarks_ = {};
+
+        // A single input record, see SetMaximumInputRecords in PrepareWorkGraph. The record does not contain any data.
+        highWaterMarks_.nodeRecords[EntryNodeId] = 1;
+
+        if (trace_)
+        {
+            trace_->Reset();
+        }
+
+        // EntryNode
+        const TraceRecorder::Clock::time_point entryBegin = TraceRecorder::Clock::now();
+        NodeOutputs entryOutputs;
+        EntryNode(entryOutputs);
+        if (desc_.compactRecords)
+        {
+            RoundTripCompactRecords(entryOutputs);
+        }
+        const TraceRecorder::Clock::time_point entryEnd = TraceRecorder::Clock::now();
+        timings_.ms[EntryNodeId] = std::chrono::duration<double, std::milli>(entryEnd - entryBegin).count();
+        if (trace_)
+        {
+            trace_->AddSlice(0, "EntryNode", 0, 1, entryBegin, entryEnd);
+        }
+
+        levelRecords_ = std::move(entryOutputs.snowflakeRecords);
+        output.triangles.insert(output.triangles.end(), entryOutputs.draws.triangles.begin(), entryOutputs.draws.triangles.end());
+        counters_ += entryOutputs.counters;
+
+        // EntryNode opens one allocation for each of its two outputs
+        highWaterMarks_.openInvocations       = 1;
+        highWaterMarks_.openOutputAllocations = 2;
+        highWaterMarks_.openOutputRecords     = 4;
+
+        // Every node invocation holds its output allocations from GetThreadNodeOutputRecords until OutputComplete.
+        // The invocations open at the same time are counted around each call of a node function.
+        std::atomic<uint32_t> openInvocations(0);
+        std::atomic<uint32_t> peakOpenInvocations(0);
+        const auto invoke = [&](const auto& node) {
+            const uint32_t open = openInvocations.fetch_add(1, std::memory_order_relaxed) + 1;
+            uint32_t peak = peakOpenInvocations.load(std::memory_order_relaxed);
+            while ((open > peak) && !peakOpenInvocations.compare_exchange_weak(peak, open, std::memory_order_relaxed))
+            {
+            }
+            node();
+            openInvocations.fetch_sub(1, std::memory_order_relaxed);
+        };
+
+        const uint64_t lineRecordBytes     = desc_.compactRecords ? sizeof(CompactLineRecord) : sizeof(LineRecord);
+        const uint64_t triangleRecordBytes = desc_.compactRecords ? sizeof(CompactTriangleRecord) : sizeof(TriangleDrawRecord);
+        // Entries of the mesh node array share the triangle record
+        const uint64_t lineDrawRecordBytes = desc_.meshNodeArray ? sizeof(TriangleDrawRecord) : lineRecordBytes;
+        // SnowflakeNode allocates its child lines, triangles and lines, or its child lines and one draw record of the mesh node array
+        const uint64_t snowflakeOutputs    = desc_.meshNodeArray ? 2 : 3;
+
+        // SnowflakeNode, one recursion level at a time
+        const TraceRecorder::Clock::time_point snowflakeBegin = TraceRecorder::Clock::now();
+        const uint32_t recursionDepth = GetSnowflakeRecursionDepth(desc_.maxRecursionDepth, desc_.expansionLevels);
+        for (uint32_t level = 0; level <= recursionDepth && !levelRecords_.empty(); ++level)
+        {
+            const uint32_t remainingRecursionLevels = recursionDepth - level;
+            const uint32_t recordCount = static_cast<uint32_t>(levelRecords_.size());
+            const uint32_t batchCount  = (recordCount + desc_.batchSize - 1) / desc_.batchSize;
+
+            highWaterMarks_.levelRecords.push_back(recordCount);
+            highWaterMarks_.levelBytes.push_back(recordCount * lineRecordBytes);
+
+            batchOutputs_.resize(std::max(static_cast<size_t>(batchCount), batchOutputs_.size()));
+
+            // Records of this level, which have not been picked up by a worker yet
+            std::atomic<uint64_t> queueDepth(recordCount);
+            if (trace_)
+            {
+                trace_->AddCounter(0, "SnowflakeNode queue depth", recordCount, TraceRecorder::Clock::now());
+            }
+
+            pool_.ParallelFor(batchCount, [&](uint32_t batch, uint32_t worker) {
+                TraceRecorder::Clock::time_point batchBegin;
+                if (trace_)
+                {
+                    batchBegin = TraceRecorder::Clock::now();
+                }
+
+                NodeOutputs& outputs = batchOutputs_[batch];
+                outputs.snowflakeRecords.clear();
+                outputs.draws.Clear();
+                outputs.counters = {};
+
+                const uint32_t first = batch * desc_.batchSize;
+                const uint32_t last  = std::min(first + desc_.batchSize, recordCount);
+                if (desc_.lineStrips)
+                {
+                    for (uint32_t i = first; i < last; ++i)
+                    {
+                        invoke([&] { SnowflakeNodeStrip(levelRecords_[i], remainingRecursionLevels, desc_.maxRecursionDepth, outputs); });
+                    }
+                }
+                else if (desc_.unrolledChain && (remainingRecursionLevels != 0))
+                {
+                    for (uint32_t i = first; i < last; ++i)
+                    {
+                        invoke([&] { SnowflakeChainNode(levelRecords_[i], 1 + level, outputs); });
+                    }
+                }
+                else if (desc_.unrolledChain)
+                {
+                    for (uint32_t i = first; i < last; ++i)
+                    {
+                        invoke([&] { SnowflakeChainLeaf(levelRecords_[i], outputs); });
+                    }
+                }
+                else if (desc_.expansionLevels > 1)
+                {
+                    for (uint32_t i = first; i < last; ++i)
+                    {
+                        invoke([&] { SnowflakeNodeExpanded(levelRecords_[i], remainingRecursionLevels, desc_.maxRecursionDepth, desc_.expansionLevels, outputs); });
+                    }
+                }
+                else if (desc_.snowflakeGroupSize > 0)
+                {
+                    for (uint32_t i = first; i < last; i += desc_.snowflakeGroupSize)
+                    {
+                        // A coalescing group is a single invocation with one allocation per output
+                        invoke([&] {
+                            SnowflakeNodeGroup(&levelRecords_[i], std::min(desc_.snowflakeGroupSize, last - i),
+                                remainingRecursionLevels, desc_.maxRecursionDepth, outputs);
+                        });
+                    }
+                }
+                else
+                {
+                    for (uint32_t i = first; i < last; ++i)
+                    {
+                        invoke([&] { SnowflakeNode(levelRecords_[i], remainingRecursionLevels, desc_.maxRecursionDepth, outputs); });
+                    }
+                }
+                if (desc_.compactRecords)
+                {
+                    RoundTripCompactRecords(outputs);
+                }
+
+                if (trace_)
+                {
+                    const TraceRecorder::Clock::time_point batchEnd = TraceRecorder::Clock::now();
+                    const uint64_t remaining = queueDepth.fetch_sub(last - first) - (last - first);
+                    trace_->AddSlice(worker, "SnowflakeNode", level, last - first, batchBegin, batchEnd);
+                    trace_->AddCounter(worker, "SnowflakeNode queue depth", remaining, batchEnd);
+                }
+            });
+
+            // Gather the batch outputs in order to keep the output deterministic
+            std::vector<LineRecord> nextLevelRecords;
+            nextLevelRecords.reserve(static_cast<size_t>(recordCount) * 4);
+            for (uint32_t batch = 0; batch < batchCount; ++batch)
+            {
+                const NodeOutputs& outputs = batchOutputs_[batch];
+                nextLevelRecords.insert(nextLevelRecords.end(), outputs.snowflakeRecords.begin(), outputs.snowflakeRecords.end());
+                output.triangles.insert(output.triangles.end(), outputs.draws.triangles.begin(), outputs.draws.triangles.end());
+                output.lines.insert(output.lines.end(), outputs.draws.lines.begin(), outputs.draws.lines.end());
+                output.lineStrips.insert(output.lineStrips.end(), outputs.draws.lineStrips.begin(), outputs.draws.lineStrips.end());
+                counters_ += outputs.counters;
+            }
+
+            // Input and output records of this level are alive at the same time, next to all pending draw records
+            const uint64_t drawBytes = output.triangles.size() * triangleRecordBytes + output.lines.size() * lineDrawRecordBytes +
+                output.lineStrips.size() * sizeof(LineStripRecord);
+            highWaterMarks_.inFlightBytes = std::max(highWaterMarks_.inFlightBytes,
+                (levelRecords_.size() + nextLevelRecords.size()) * lineRecordBytes + drawBytes);
+
+            // Each invocation calls GetThreadNodeOutputRecords (or GetGroupNodeOutputRecords for a whole group) for all
+            // three outputs (two with the mesh node array), which hold 4 + 1 records per input record above the last level and a single line record in the last level.
+            // With several iterations per invocation, an invocation holds all child lines and triangles of its iterations.
+            uint64_t recordsPerInvocation = ((remainingRecursionLevels != 0) ? 5 : 1) * std::max(desc_.snowflakeGroupSize, 1u);
+            if ((desc_.expansionLevels > 1) && (remainingRecursionLevels != 0))
+            {
+                const uint64_t children = 1ull << (2 * std::min(desc_.expansionLevels, desc_.maxRecursionDepth - level * desc_.expansionLevels));
+                recordsPerInvocation = children + (children - 1) / 3;
+            }
+            if (desc_.lineStrips && (remainingRecursionLevels == 1))
+            {
+                // A triangle and a strip
+                recordsPerInvocation = 2;
+            }
+            // Nodes of the unrolled chain only declare the outputs of their level
+            uint64_t outputsPerInvocation = snowflakeOutputs;
+            if (desc_.unrolledChain)
+            {
+                outputsPerInvocation = (remainingRecursionLevels != 0) ? 2 : 1;
+            }
+            highWaterMarks_.openInvocations       = std::max<uint64_t>(highWaterMarks_.openInvocations, peakOpenInvocations);
+            highWaterMarks_.openOutputAllocations = std::max<uint64_t>(highWaterMarks_.openOutputAllocations, peakOpenInvocations * outputsPerInvocation);
+            highWaterMarks_.openOutputRecords     = std::max<uint64_t>(highWaterMarks_.openOutputRecords, peakOpenInvocations * recordsPerInvocation);
+            peakOpenInvocations = 0;
+
+            levelRecords_ = std::move(nextLevelRecords);
+        }
+
+        highWaterMarks_.nodeRecords[SnowflakeNodeId] = *std::max_element(highWaterMarks_.levelRecords.begin(), highWaterMarks_.levelRecords.end());
+        highWaterMarks_.nodeBytes[SnowflakeNodeId]   = highWaterMarks_.nodeRecords[SnowflakeNodeId] * lineRecordBytes;
+        // Mesh nodes run after the graph on the CPU, thus all their records are pending at the end
+        highWaterMarks_.nodeRecords[TriangleMeshNodeId] = output.triangles.size();
+        highWaterMarks_.nodeBytes[TriangleMeshNodeId]   = output.triangles.size() * triangleRecordBytes;
+        highWaterMarks_.nodeRecords[LineMeshNodeId]     = output.lines.size() + output.lineStrips.size();
+        highWaterMarks_.nodeBytes[LineMeshNodeId]       = output.lines.size() * lineDrawRecordBytes + output.lineStrips.size() * sizeof(LineStripRecord);
+        timings_.ms[SnowflakeNodeId] = std::chrono::duration<double, std::milli>(TraceRecorder::Clock::now() - snowflakeBegin).count();
+
+        // Every draw record launches one mesh node dispatch grid of a single group
+        counters_[TriangleMeshNodeInvocations] = output.triangles.size();
+        counters_[LineMeshNodeInvocations]     = output.lines.size() + output.lineStrips.size();
+    }
+}
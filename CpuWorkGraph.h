@@ -0,0 +1,435 @@
+/**********************************************************************
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+#pragma once
+
+// CPU reference implementation of the Koch snowflake work graph in ShaderSource.h.
+// The nodes are implemented as plain C++ functions, which are executed level by level
+// on a pool of worker threads. This file does not depend on D3D12 or Windows headers.
+
+#include "ShaderSource.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace cpu {
+    struct float2
+    {
+        float x;
+        float y;
+    };
+
+    inline float2 operator+(float2 a, float2 b) { return { a.x + b.x, a.y + b.y }; }
+    inline float2 operator-(float2 a, float2 b) { return { a.x - b.x, a.y - b.y }; }
+    inline float2 operator*(float2 a, float s)  { return { a.x * s, a.y * s }; }
+    inline float2 lerp(float2 a, float2 b, float t) { return a + (b - a) * t; }
+
+    // Record structs with the same layout as the HLSL records
+    struct LineRecord
+    {
+        float2 start;
+        float2 end;
+    };
+
+    struct TriangleDrawRecord
+    {
+        float2   verts[3];
+        uint32_t depth;
+    };
+
+    struct LineStripRecord
+    {
+        float2   points[5];
+        uint32_t segmentCount;
+    };
+
+    static_assert(sizeof(LineRecord) == 16, "LineRecord must match HLSL layout");
+    static_assert(sizeof(TriangleDrawRecord) == 28, "TriangleDrawRecord must match HLSL layout");
+    static_assert(sizeof(LineStripRecord) == 44, "LineStripRecord must match HLSL layout");
+
+    // Compact records (COMPACT_RECORDS in ShaderSource.h).
+    // Start and end point as snorm16.
+    struct CompactLineRecord
+    {
+        uint32_t endpoints[2];
+    };
+
+    // Base verts[0] -> verts[2] of an equilateral triangle as snorm14, depth and the side of verts[1] in the top bits
+    struct CompactTriangleRecord
+    {
+        uint32_t base[2];
+    };
+
+    static_assert(sizeof(CompactLineRecord) == 8, "CompactLineRecord must match HLSL layout");
+    static_assert(sizeof(CompactTriangleRecord) == 8, "CompactTriangleRecord must match HLSL layout");
+
+    // Encoding functions, mirroring MakeLineRecord, GetLineStart, ... in ShaderSource.h
+    CompactLineRecord     EncodeLineRecord(const LineRecord& record);
+    LineRecord            DecodeLineRecord(const CompactLineRecord& record);
+    // Only valid for equilateral triangles with depth < 16
+    CompactTriangleRecord EncodeTriangleRecord(const TriangleDrawRecord& record);
+    TriangleDrawRecord    DecodeTriangleRecord(const CompactTriangleRecord& record);
+
+    // Counter slots of the instrumented work graph (NODE_COUNTERS in ShaderSource.h)
+    enum CounterSlot : uint32_t
+    {
+        EntryNodeInvocations,
+        SnowflakeNodeInvocations,
+        TriangleMeshNodeInvocations,
+        LineMeshNodeInvocations,
+        EntryToSnowflakeRecords,
+        EntryToTriangleRecords,
+        SnowflakeToSnowflakeRecords,
+        SnowflakeToTriangleRecords,
+        SnowflakeToLineRecords,
+        CounterCount
+    };
+
+    const char* GetCounterName(CounterSlot slot);
+
+    struct NodeCounters
+    {
+        uint64_t values[CounterCount] = {};
+
+        uint64_t& operator[](CounterSlot slot) { return values[slot]; }
+        uint64_t operator[](CounterSlot slot) const { return values[slot]; }
+
+        NodeCounters& operator+=(const NodeCounters& other);
+    };
+
+    // Closed-form node counters of the graph for a given recursion depth.
+    // The SnowflakeNode runs for maxRecursionDepth + 1 levels, starting with three lines.
+    // With expansionLevels > 1 (SNOWFLAKE_EXPANSION_LEVELS), every SnowflakeNode invocation expands several Koch iterations.
+    // With lineStrips (LINE_STRIP), the last Koch iteration sends one strip of four lines to LineMeshNode instead of recursing.
+    NodeCounters ExpectedNodeCounters(uint32_t maxRecursionDepth, uint32_t expansionLevels = 1, bool lineStrips = false);
+
+    // Number of expanding SnowflakeNode invocations in a recursion chain (NodeMaxRecursionDepth), ceil(maxRecursionDepth / expansionLevels)
+    uint32_t GetSnowflakeRecursionDepth(uint32_t maxRecursionDepth, uint32_t expansionLevels);
+
+    // Prints a table of both counter sets and returns true if all counters are equal
+    bool CompareNodeCounters(const char* nameA, const NodeCounters& a, const char* nameB, const NodeCounters& b);
+
+    enum NodeId : uint32_t
+    {
+        EntryNodeId,
+        SnowflakeNodeId,
+        TriangleMeshNodeId,
+        LineMeshNodeId,
+        NodeCount
+    };
+
+    const char* GetNodeName(NodeId node);
+
+    // Time spent in each node in milliseconds. Negative values mark nodes which have not been measured.
+    struct NodeTimings
+    {
+        double ms[NodeCount] = { -1.0, -1.0, -1.0, -1.0 };
+    };
+
+    // Peak memory use of the records of one graph execution
+    struct HighWaterMarks
+    {
+        // Peak number of records (and their size) waiting in the input queue of each node
+        uint64_t nodeRecords[NodeCount] = {};
+        uint64_t nodeBytes[NodeCount]   = {};
+        // SnowflakeNode input records (and their size) per recursion level
+        std::vector<uint64_t> levelRecords;
+        std::vector<uint64_t> levelBytes;
+        // Peak size of all records alive at the same time
+        uint64_t inFlightBytes = 0;
+        // Peak number of node invocations open at the same time, measured around every invocation
+        uint64_t openInvocations = 0;
+        // Peak number of concurrently open GetThreadNodeOutputRecords allocations and the records they hold,
+        // i.e. the open invocations of a level times the allocations and records of one invocation
+        uint64_t openOutputAllocations = 0;
+        uint64_t openOutputRecords     = 0;
+    };
+
+    // Prints the high-water marks and relates them to the backing memory size reported by GetWorkGraphMemoryRequirements.
+    // Pass 0 for the memory requirements if they are not known.
+    void PrintHighWaterMarks(const HighWaterMarks& marks, uint64_t minBackingMemoryBytes, uint64_t maxBackingMemoryBytes);
+
+    // Records sent to the two mesh nodes of the graph.
+    // LineMeshNode receives either lines or, with LINE_STRIP, line strips.
+    struct GraphOutput
+    {
+        std::vector<TriangleDrawRecord> triangles;
+        std::vector<LineRecord>         lines;
+        std::vector<LineStripRecord>    lineStrips;
+
+        void Clear()
+        {
+            triangles.clear();
+            lines.clear();
+            lineStrips.clear();
+        }
+    };
+
+    // Line and triangle records in memory owned elsewhere, e.g. a mapped geometry file (see GeometryFile.h)
+    struct DrawRecordView
+    {
+        const TriangleDrawRecord* triangles     = nullptr;
+        size_t                    triangleCount = 0;
+        const LineRecord*         lines         = nullptr;
+        size_t                    lineCount     = 0;
+    };
+
+    // Returns the output with every line strip replaced by its lines, in order
+    GraphOutput ExpandLineStrips(const GraphOutput& output);
+
+    // D3D12 limits of records with SV_DispatchGrid
+    constexpr uint32_t MaxNodeRecordBytes          = 32768;
+    constexpr uint32_t MaxDispatchGridPerDimension = 65535;
+    // Mesh nodes launch at most 2^22 groups per dispatch grid
+    constexpr uint32_t MaxMeshNodeDispatchGroups   = 1u << 22;
+
+    static_assert(sizeof(LineStripRecord) <= MaxNodeRecordBytes, "LineStripRecord exceeds the maximum record size");
+    static_assert(offsetof(LineStripRecord, segmentCount) % 4 == 0, "SV_DispatchGrid of LineStripRecord must be 4 byte aligned");
+    static_assert((shader::LineMaxDispatchGrid <= MaxDispatchGridPerDimension) && (shader::LineMaxDispatchGrid <= MaxMeshNodeDispatchGroups),
+        "LineMaxDispatchGrid exceeds the dispatch grid limits");
+
+    // With LINE_DISPATCH_GRID, TriangleBatchNode gathers the triangle records into this record,
+    // which launches one TriangleBatchMeshNode group per TriangleGridGroupSize triangles.
+    // Mirrors TriangleBatchRecord in the HLSL source.
+    struct TriangleGridRecord
+    {
+        uint32_t           groupCount;
+        uint32_t           count;
+        TriangleDrawRecord triangles[shader::TriangleGridGroupSize * shader::TriangleMaxDispatchGrid];
+    };
+
+    static_assert(sizeof(TriangleGridRecord) <= MaxNodeRecordBytes, "TriangleGridRecord exceeds the maximum record size");
+    static_assert(offsetof(TriangleGridRecord, groupCount) % 4 == 0, "SV_DispatchGrid of TriangleGridRecord must be 4 byte aligned");
+    static_assert((shader::TriangleMaxDispatchGrid <= MaxDispatchGridPerDimension) && (shader::TriangleMaxDispatchGrid <= MaxMeshNodeDispatchGroups),
+        "TriangleMaxDispatchGrid exceeds the dispatch grid limits");
+    // TriangleBatchNode gathers at most 256 records per coalescing group, a mesh shader group outputs at most 256 vertices
+    static_assert(shader::TriangleGridGroupSize * shader::TriangleMaxDispatchGrid <= 256, "TriangleBatchNode gathers too many triangle records");
+    static_assert(3 * shader::TriangleGridGroupSize <= 256, "TriangleGridGroupSize exceeds the mesh shader output limits");
+
+    // Dispatch grids of the line strip records with LINE_DISPATCH_GRID, where every record launches one LineMeshNode group per line,
+    // or of the gathered triangle records
+    struct DispatchGridReport
+    {
+        // Mesh node launched by the records
+        const char* node      = "";
+        uint64_t records      = 0;
+        uint64_t groups       = 0;
+        uint32_t maxGrid      = 0;
+        uint32_t recordBytes  = 0;
+        // Records with an empty grid or a grid above [NodeMaxDispatchGrid(...)]
+        uint64_t invalidGrids = 0;
+
+        bool IsValid() const { return (invalidGrids == 0) && (recordBytes <= MaxNodeRecordBytes); }
+        void Print() const;
+    };
+
+    // Checks the grid of every line strip record against [NodeMaxDispatchGrid(...)] of LineMeshNode and the D3D12 limits
+    DispatchGridReport CheckLineDispatchGrids(const GraphOutput& output, uint32_t maxDispatchGrid = shader::LineMaxDispatchGrid);
+    // Gathers the triangle records in order into TriangleGridRecords, as full coalescing groups of TriangleBatchNode would,
+    // and checks their grids against [NodeMaxDispatchGrid(...)] of TriangleBatchMeshNode and the D3D12 limits.
+    // The coalescing groups of the GPU may hold fewer records, which only reduces their grid.
+    DispatchGridReport CheckTriangleDispatchGrids(const GraphOutput& output, uint32_t groupSize = shader::TriangleGridGroupSize,
+        uint32_t maxDispatchGrid = shader::TriangleMaxDispatchGrid);
+
+    // Largest coordinate error of the draw records of a graph executed with compact records
+    // and the analytical bound of the error for the recursion depth
+    struct CompactRecordError
+    {
+        double lineError     = 0.0;
+        double triangleError = 0.0;
+        double lineBound     = 0.0;
+        double triangleBound = 0.0;
+        // Draw records which are not the same in both outputs, apart from coordinates
+        uint64_t mismatches  = 0;
+
+        bool IsWithinBounds() const { return (mismatches == 0) && (lineError <= lineBound) && (triangleError <= triangleBound); }
+        void Print() const;
+    };
+
+    // Compares the output of a graph executed with compact records against the full precision output
+    CompactRecordError MeasureCompactRecordError(uint32_t maxRecursionDepth, const GraphOutput& exact, const GraphOutput& compact);
+
+    // True if both outputs contain bitwise identical records in the same order
+    bool HasIdenticalGeometry(const GraphOutput& a, const GraphOutput& b);
+    // True if both outputs contain bitwise identical records, in any order
+    bool HasEquivalentGeometry(const GraphOutput& a, const GraphOutput& b);
+
+    // Output of the nodes for one batch of input records
+    struct NodeOutputs
+    {
+        std::vector<LineRecord> snowflakeRecords;
+        GraphOutput             draws;
+        NodeCounters            counters;
+    };
+
+    // Node functions, mirroring the HLSL nodes
+    void EntryNode(NodeOutputs& outputs);
+    void SnowflakeNode(const LineRecord& record, uint32_t remainingRecursionLevels, uint32_t maxRecursionDepth, NodeOutputs& outputs);
+    // Coalescing launch variant of SnowflakeNode (SNOWFLAKE_COALESCING in ShaderSource.h) for one thread group of records
+    void SnowflakeNodeGroup(const LineRecord* records, uint32_t recordCount, uint32_t remainingRecursionLevels, uint32_t maxRecursionDepth, NodeOutputs& outputs);
+    // Variant of SnowflakeNode expanding several Koch iterations per invocation (SNOWFLAKE_EXPANSION_LEVELS in ShaderSource.h).
+    // remainingRecursionLevels counts down from GetSnowflakeRecursionDepth.
+    void SnowflakeNodeExpanded(const LineRecord& record, uint32_t remainingRecursionLevels, uint32_t maxRecursionDepth, uint32_t expansionLevels, NodeOutputs& outputs);
+    // Variant of SnowflakeNode drawing the lines of the last Koch iteration as one strip (LINE_STRIP in ShaderSource.h)
+    void SnowflakeNodeStrip(const LineRecord& record, uint32_t remainingRecursionLevels, uint32_t maxRecursionDepth, NodeOutputs& outputs);
+    // Nodes of the unrolled chain (SNOWFLAKE_UNROLLED in ShaderSource.h). SnowflakeNode_<level> expands a Koch iteration
+    // with the triangle depth level + 1 as a constant, the last node of the chain draws its line.
+    void SnowflakeChainNode(const LineRecord& record, uint32_t depth, NodeOutputs& outputs);
+    void SnowflakeChainLeaf(const LineRecord& record, NodeOutputs& outputs);
+
+    // Persistent pool of worker threads. The calling thread participates as worker 0.
+    class WorkerPool
+    {
+    public:
+        explicit WorkerPool(uint32_t threadCount);
+        ~WorkerPool();
+
+        uint32_t GetThreadCount() const { return static_cast<uint32_t>(threads_.size()) + 1; }
+
+        // Calls task(index, worker) for every index in [0, count) and returns once all calls have finished
+        void ParallelFor(uint32_t count, const std::function<void(uint32_t index, uint32_t worker)>& task);
+
+    private:
+        void WorkerLoop(uint32_t worker);
+        void RunTasks(uint32_t worker);
+
+        std::vector<std::thread> threads_;
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::condition_variable done_;
+
+        const std::function<void(uint32_t, uint32_t)>* task_ = nullptr;
+        uint32_t taskCount_ = 0;
+        uint32_t nextTask_ = 0;
+        uint32_t activeWorkers_ = 0;
+        uint64_t generation_ = 0;
+        bool exit_ = false;
+    };
+
+    // Collects Chrome trace events (chrome://tracing or ui.perfetto.dev) of the executor.
+    // Every worker appends to its own event list, so recording does not need any synchronization.
+    class TraceRecorder
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        explicit TraceRecorder(uint32_t threadCount);
+
+        // Sets the time origin of the trace and drops all recorded events
+        void Reset();
+
+        // Complete event ("ph": "X") for one batch of node invocations on a worker lane
+        void AddSlice(uint32_t worker, const char* node, uint32_t level, uint32_t recordCount,
+            Clock::time_point begin, Clock::time_point end);
+        // Counter event ("ph": "C"), e.g. number of records waiting in a node queue
+        void AddCounter(uint32_t worker, const char* name, uint64_t value, Clock::time_point time);
+
+        bool WriteJson(const std::string& path) const;
+
+    private:
+        struct Event
+        {
+            const char* name;
+            char        phase;
+            uint32_t    level;
+            uint64_t    value;
+            double      beginUs;
+            double      durationUs;
+        };
+
+        double ToUs(Clock::time_point time) const;
+
+        Clock::time_point origin_;
+        std::vector<std::vector<Event>> workerEvents_;
+    };
+
+    struct ExecutorDesc
+    {
+        uint32_t maxRecursionDepth = shader::MaxSnowflakeRecursions;
+        uint32_t threadCount       = 1;
+        // Number of SnowflakeNode records processed by one worker task
+        uint32_t batchSize         = 256;
+        // Records per SnowflakeNode thread group with coalescing launch, 0 for thread launch.
+        // Must match SNOWFLAKE_COALESCING of the HLSL source.
+        uint32_t snowflakeGroupSize = 0;
+        // Koch iterations per SnowflakeNode invocation, must match SNOWFLAKE_EXPANSION_LEVELS of the HLSL source.
+        // Values above 1 use thread launch, snowflakeGroupSize is ignored.
+        uint32_t expansionLevels    = shader::SnowflakeExpansionLevels;
+        // Draw line strips, must match LINE_STRIP or LINE_DISPATCH_GRID of the HLSL source, which share the records.
+        // Uses thread launch with one Koch iteration per invocation, snowflakeGroupSize and expansionLevels are ignored.
+        bool     lineStrips         = shader::LineStrips;
+        // Pass all records through their compact encoding, must match COMPACT_RECORDS of the HLSL source.
+        // Uses the thread launch SnowflakeNode, the other variants are ignored.
+        bool     compactRecords     = shader::CompactRecords;
+        // Send draw records to the entries of one mesh node array, must match MESH_NODE_ARRAY of the HLSL source.
+        // Only changes the record sizes and output allocations of the high-water marks, as line records are stored in triangle records.
+        // Uses the thread launch SnowflakeNode with full precision records, the other variants are ignored.
+        bool     meshNodeArray      = shader::MeshNodeArray;
+        // Run one node per recursion level instead of the recursive SnowflakeNode, must match SNOWFLAKE_UNROLLED of the HLSL source.
+        // Uses thread launch with one Koch iteration per node and separate lines, the other variants apart from compact records are ignored.
+        bool     unrolledChain      = shader::UnrolledSnowflakeChain;
+    };
+
+    // Writes a Graphviz DOT file of the work graph variant selected by desc. Each edge is annotated with the declared [MaxRecords(...)],
+    // the measured number of records and the bytes moved along it, each node with its invocations and measured time.
+    bool WriteGraphviz(const std::string& path, const char* title, const ExecutorDesc& desc, const NodeCounters& counters, const NodeTimings& timings);
+
+    // Executes the work graph on the CPU, one SnowflakeNode recursion level at a time.
+    // Output records are gathered in the order of the input records, thus the output does not depend on the thread count.
+    class Executor
+    {
+    public:
+        explicit Executor(const ExecutorDesc& desc);
+
+        // Runs the graph with a single empty input record, like DispatchGraph in RecordCommandList
+        void Run(GraphOutput& output);
+
+        const NodeCounters& GetNodeCounters() const { return counters_; }
+        // Wall clock time of EntryNode and all SnowflakeNode levels of the last run
+        const NodeTimings& GetNodeTimings() const { return timings_; }
+        const HighWaterMarks& GetHighWaterMarks() const { return highWaterMarks_; }
+        const ExecutorDesc& GetDesc() const { return desc_; }
+
+        // Records trace events during Run. Tracing is disabled with nullptr (default),
+        // which leaves a single branch per batch in the executor.
+        void SetTraceRecorder(TraceRecorder* trace) { trace_ = trace; }
+
+    private:
+        ExecutorDesc   desc_;
+        WorkerPool     pool_;
+        NodeCounters   counters_;
+        NodeTimings    timings_;
+        HighWaterMarks highWaterMarks_;
+        TraceRecorder* trace_ = nullptr;
+
+        std::vector<LineRecord>  levelRecords_;
+        std::vector<NodeOutputs> batchOutputs_;
+    };
+}
@@ -25,7 +25,7 @@ THE SOFTWARE.
 #include <string>
 #include <algorithm>
 
-#define ERROR_QUIT(value, ...) if(!(value)) { printf("ERROR: "); printf(__VA_ARGS__); printf("\nPress any key to terminate...\n"); _getch(); throw 0; }
+#define ERROR_QUIT(value, ...) if(!(value)) { printf("ERROR: "); printf(__VA_ARGS__); printf("\n"); if (d3d12::sWaitForKeyOnError) { printf("Press any key to terminate...\n"); _getch(); } throw 0; }
 
 namespace {
     // function GetHardwareAdapter() copy-pasted from the publicly distributed sample provided at: https://learn.microsoft.com/en-us/windows/win32/api/d3d12/nf-d3d12-d3d12createdevice
@@ -67,6 +67,7 @@ void HelloMeshNodes::InitializeDirectX(HWND hwnd)
 
     device_ = nullptr;
 
+    profiling::ScopedZone deviceZone("Device creation");
     CComPtr<IDXGIFactory4> factory;
     hresult = CreateDXGIFactory2(0, IID_PPV_ARGS(&factory));
     ERROR_QUIT(hresult == S_OK, "Failed to create IDXGIFactory4.");
@@ -75,6 +76,7 @@ void HelloMeshNodes::InitializeDirectX(HWND hwnd)
     GetHardwareAdapter(factory, &hardwareAdapter);
     hresult = D3D12CreateDevice(hardwareAdapter, D3D_FEATURE_LEVEL_11_0, IID_PPV_ARGS(&device_));
     ERROR_QUIT(hresult == S_OK, "Failed to create ID3D12Device.");
+    deviceZone.End();
 
     // Create the command queue.
     D3D12_COMMAND_QUEUE_DESC queueDesc = {};
@@ -85,35 +87,45 @@ void HelloMeshNodes::InitializeDirectX(HWND hwnd)
     ERROR_QUIT(hresult == S_OK, "Failed to create ID3D12CommandQueue.");
 
     // Create the swap chain.
-    DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
-    swapChainDesc.BufferCount = FrameCount;
-    swapChainDesc.Width = WindowSize;
-    swapChainDesc.Height = WindowSize;
-    swapChainDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-    swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-    swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
-    swapChainDesc.SampleDesc.Count = 1;
-
-    CComPtr<IDXGISwapChain1> swapChain;
-    hresult = factory->CreateSwapChainForHwnd(
-        commandQueue_,
-        hwnd,
-        &swapChainDesc,
-        nullptr,
-        nullptr,
-        &swapChain
-    );
-    ERROR_QUIT(hresult == S_OK, "Failed to create IDXGISwapChain1.");
-
-    hresult = factory->MakeWindowAssociation(hwnd, DXGI_MWA_NO_ALT_ENTER);
-    ERROR_QUIT(hresult == S_OK, "Failed to make window association.");
-
-    hresult = swapChain.QueryInterface(&swapChain_);
-    ERROR_QUIT(hresult == S_OK, "Failed to query IDXGISwapChain3.");
-
-    frameIndex_ = swapChain_->GetCurrentBackBufferIndex();
+    // Without a window (headless benchmark), frames are rendered to offscreen render targets instead.
+    if (hwnd)
+    {
+        profiling::ScopedZone swapChainZone("Swap chain");
+        DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
+        swapChainDesc.BufferCount = FrameCount;
+        swapChainDesc.Width = WindowSize;
+        swapChainDesc.Height = WindowSize;
+        swapChainDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
+        swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
+        swapChainDesc.SampleDesc.Count = 1;
+
+        CComPtr<IDXGISwapChain1> swapChain;
+        hresult = factory->CreateSwapChainForHwnd(
+            commandQueue_,
+            hwnd,
+            &swapChainDesc,
+            nullptr,
+            nullptr,
+            &swapChain
+        );
+        ERROR_QUIT(hresult == S_OK, "Failed to create IDXGISwapChain1.");
+
+        hresult = factory->MakeWindowAssociation(hwnd, DXGI_MWA_NO_ALT_ENTER);
+        ERROR_QUIT(hresult == S_OK, "Failed to make window association.");
+
+        hresult = swapChain.QueryInterface(&swapChain_);
+        ERROR_QUIT(hresult == S_OK, "Failed to query IDXGISwapChain3.");
+
+        frameIndex_ = swapChain_->GetCurrentBackBufferIndex();
+    }
+    else
+    {
+        frameIndex_ = 0;
+    }
 
     // Create render target view (RTV) descriptor heaps.
+    profiling::ScopedZone descriptorHeapZone("Descriptor heaps & render target views");
     {
         D3D12_DESCRIPTOR_HEAP_DESC rtvHeapDesc = {};
         rtvHeapDesc.NumDescriptors = FrameCount;
@@ -132,15 +144,41 @@ void HelloMeshNodes::InitializeDirectX(HWND hwnd)
         // Create a RTV for each frame.
         for (UINT n = 0; n < FrameCount; n++)
         {
-            hresult = swapChain_->GetBuffer(n, IID_PPV_ARGS(&renderTargets_[n]));
-            ERROR_QUIT(hresult == S_OK, "Failed to access render target of swap chain.");
+            if (swapChain_)
+            {
+                hresult = swapChain_->GetBuffer(n, IID_PPV_ARGS(&renderTargets_[n]));
+                ERROR_QUIT(hresult == S_OK, "Failed to access render target of swap chain.");
+            }
+            else
+            {
+                // Created in the present (common) state, like the swap chain buffers
+                CD3DX12_HEAP_PROPERTIES renderTargetHeapProperties(D3D12_HEAP_TYPE_DEFAULT);
+                CD3DX12_RESOURCE_DESC renderTargetDescription = CD3DX12_RESOURCE_DESC::Tex2D(
+                    DXGI_FORMAT_R8G8B8A8_UNORM,
+                    WindowSize, WindowSize,
+                    1, 1, 1, 0,
+                    D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET);
+                hresult = device_->CreateCommittedResource(
+                    &renderTargetHeapProperties,
+                    D3D12_HEAP_FLAG_NONE,
+                    &renderTargetDescription,
+                    D3D12_RESOURCE_STATE_PRESENT,
+                    nullptr,
+                    IID_PPV_ARGS(&renderTargets_[n])
+                );
+                ERROR_QUIT(hresult == S_OK, "Failed to create offscreen render target.");
+            }
             device_->CreateRenderTargetView(renderTargets_[n].p, nullptr, rtvHandle);
             rtvHandle.Offset(1, descriptorSize_);
         }
     }
 
+    descriptorHeapZone.End();
+
     // Create a depth-stencil view (DSV) descriptor heap and depth buffer
     {
+        profiling::ScopedZone depthBufferZone("Depth buffer");
+
         D3D12_DESCRIPTOR_HEAP_DESC dsvHeapDesc = {};
         dsvHeapDesc.NumDescriptors = 1;
         dsvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
@@ -179,6 +217,7 @@ void HelloMeshNodes::InitializeDirectX(HWND hwnd)
         device_->CreateDepthStencilView(depthBuffer_, &depthStencilDesc, depthDescriptorHeap_->GetCPUDescriptorHandleForHeapStart());
     }
 
+    profiling::ScopedZone commandListZone("Command allocator, list & synchronization objects");
     hresult = device_->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&commandAllocator_));
     ERROR_QUIT(hresult == S_OK, "Failed to create ID3D12CommandAllocator.");
 
@@ -200,10 +239,33 @@ void HelloMeshNodes::InitializeDirectX(HWND hwnd)
     fenceEvent_ = CreateEvent(nullptr, FALSE, FALSE, nullptr);
     ERROR_QUIT(fenceEvent_ != nullptr, "Failed to create synchronization event.");
 
-    // Create empty root signature
+    commandListZone.End();
+
+    // Create timestamp query heap and readback buffer for frame timings
     {
+        profiling::ScopedZone queryHeapZone("Timestamp query heap");
+
+        D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+        queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+        queryHeapDesc.Count = TimestampCount;
+        hresult = device_->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&timestampQueryHeap_));
+        ERROR_QUIT(hresult == S_OK, "Failed to create timestamp query heap.");
+
+        timestampReadbackBuffer_.Attach(d3d12::AllocateBuffer(device_, TimestampCount * sizeof(UINT64), D3D12_RESOURCE_FLAG_NONE, D3D12_HEAP_TYPE_READBACK));
+
+        hresult = commandQueue_->GetTimestampFrequency(&timestampFrequency_);
+        ERROR_QUIT(hresult == S_OK, "Failed to query timestamp frequency.");
+    }
+
+    // Create root signature. It is empty, unless the instrumented work graph needs the node counter UAV at u0.
+    {
+        profiling::ScopedZone rootSignatureZone("Root signature");
+
+        CD3DX12_ROOT_PARAMETER nodeCounterParameter;
+        nodeCounterParameter.InitAsUnorderedAccessView(0);
+
         CD3DX12_ROOT_SIGNATURE_DESC rootSignatureDesc;
-        rootSignatureDesc.Init(0, nullptr, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+        rootSignatureDesc.Init(settings_.nodeCounters ? 1 : 0, &nodeCounterParameter, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
         CComPtr<ID3DBlob> signature;
         CComPtr<ID3DBlob> error;
@@ -217,6 +279,17 @@ void HelloMeshNodes::InitializeDirectX(HWND hwnd)
 void HelloMeshNodes::Render()
 {
     HRESULT hresult;
+
+    profiling::FrameTimings timings = {};
+    timings.frame = frameCount_++;
+
+    // The first frame is part of the startup, as drivers may defer work until the first use of the work graph
+    const bool firstFrame = (timings.frame == 0);
+    const size_t firstFrameZone = firstFrame ? profiling::StartupZones().Begin("First frame") : 0;
+
+    const profiling::CpuTimer frameTimer;
+    profiling::CpuTimer phaseTimer;
+
     // Reset allocator and list
     hresult = commandAllocator_->Reset();
     ERROR_QUIT(hresult == S_OK, "Failed to reset ID3D12CommandAllocator.");
@@ -228,15 +301,67 @@ void HelloMeshNodes::Render()
 
     hresult = commandList_->Close();
     ERROR_QUIT(hresult == S_OK, "Failed to close ID3D12CommandAllocator.");
+    timings.cpuRecordMs = phaseTimer.Lap();
 
     // Execute the command list.
     commandQueue_->ExecuteCommandLists(1, CommandListCast(&commandList_.p));
+    timings.cpuSubmitMs = phaseTimer.Lap();
 
-    // Present the frame.
-    hresult = swapChain_->Present(1, 0);
-    ERROR_QUIT(hresult == S_OK, "Failed to present frame.");
+    // Present the frame. Headless frames are not presented.
+    if (swapChain_)
+    {
+        hresult = swapChain_->Present(1, 0);
+        ERROR_QUIT(hresult == S_OK, "Failed to present frame.");
+    }
+    timings.cpuPresentMs = phaseTimer.Lap();
 
     WaitForPreviousFrame();
+    timings.cpuWaitMs = phaseTimer.Lap();
+
+    // Copying the frame for the PNG writer is part of the frame, encoding it is not
+    if (frameWriter_)
+    {
+        WriteFrame(timings);
+    }
+    timings.cpuTotalMs = frameTimer.ElapsedMs();
+
+    // The frame has finished on the GPU, thus its timestamps can be read back
+    ReadFrameTimestamps(timings);
+    frameTimings_.Push(timings);
+
+    if (settings_.nodeCounters)
+    {
+        CheckNodeCounters(timings);
+    }
+
+    if (firstFrame)
+    {
+        profiling::StartupZones().End(firstFrameZone);
+
+        if (settings_.startupProfile)
+        {
+            printf("Startup profile:\n");
+            profiling::StartupZones().Print();
+            profiling::StartupZones().WriteJson("startup_profile.json");
+        }
+    }
+}
+
+void HelloMeshNodes::ReadFrameTimestamps(profiling::FrameTimings& timings)
+{
+    UINT64* timestamps = nullptr;
+    const D3D12_RANGE readRange = { 0, TimestampCount * sizeof(UINT64) };
+    HRESULT hresult = timestampReadbackBuffer_->Map(0, &readRange, reinterpret_cast<void**>(&timestamps));
+    ERROR_QUIT(hresult == S_OK, "Failed to map timestamp readback buffer.");
+
+    const double ticksToMs = 1000.0 / static_cast<double>(timestampFrequency_);
+    timings.gpuClearMs         = (timestamps[TimestampClearEnd] - timestamps[TimestampFrameBegin]) * ticksToMs;
+    timings.gpuDispatchGraphMs = (timestamps[TimestampDispatchGraphEnd] - timestamps[TimestampClearEnd]) * ticksToMs;
+    timings.gpuTotalMs         = (timestamps[TimestampDispatchGraphEnd] - timestamps[TimestampFrameBegin]) * ticksToMs;
+
+    // Nothing was written by the CPU
+    const D3D12_RANGE writeRange = { 0, 0 };
+    timestampReadbackBuffer_->Unmap(0, &writeRange);
 }
 
 void HelloMeshNodes::WaitForPreviousFrame()
@@ -261,13 +386,16 @@ void HelloMeshNodes::WaitForPreviousFrame()
         WaitForSingleObject(fenceEvent_, INFINITE);
     }
 
-    frameIndex_ = swapChain_->GetCurrentBackBufferIndex();
+    frameIndex_ = swapChain_ ? swapChain_->GetCurrentBackBufferIndex() : (frameIndex_ + 1) % FrameCount;
 }
 
 namespace d3d12 {
     HMODULE sDxCompilerDLL = nullptr;
+    bool sWaitForKeyOnError = true;
     void LoadCompiler()
     {
+        profiling::ScopedZone zone("LoadCompiler");
+
         // load compiler
         sDxCompilerDLL = LoadLibrary(L"dxcompiler.dll");
 
@@ -287,9 +415,20 @@ namespace d3d12 {
     {
         ID3D12Resource* pResource;
 
+        // Upload and readback heaps require fixed initial resource states
+        D3D12_RESOURCE_STATES InitialState = D3D12_RESOURCE_STATE_COMMON;
+        if (HeapType == D3D12_HEAP_TYPE_UPLOAD)
+        {
+            InitialState = D3D12_RESOURCE_STATE_GENERIC_READ;
+        }
+        else if (HeapType == D3D12_HEAP_TYPE_READBACK)
+        {
+            InitialState = D3D12_RESOURCE_STATE_COPY_DEST;
+        }
+
         CD3DX12_HEAP_PROPERTIES HeapProperties(HeapType);
         CD3DX12_RESOURCE_DESC ResourceDesc = CD3DX12_RESOURCE_DESC::Buffer(Size, ResourceFlags);
-        HRESULT hr = pDevice->CreateCommittedResource(&HeapProperties, D3D12_HEAP_FLAG_NONE, &ResourceDesc, D3D12_RESOURCE_STATE_COMMON, NULL, IID_PPV_ARGS(&pResource));
+        HRESULT hr = pDevice->CreateCommittedResource(&HeapProperties, D3D12_HEAP_FLAG_NONE, &ResourceDesc, InitialState, NULL, IID_PPV_ARGS(&pResource));
         ERROR_QUIT(SUCCEEDED(hr), "Failed to allocate buffer.");
 
         return pResource;
@@ -0,0 +1,489 @@
+/**********************************************************************
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+
+#include "GeometryFile.h"
+
+#include <cmath>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace geometry {
+    namespace {
+        uint64_t AlignUp(uint64_t value, uint64_t alignment)
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        struct Fnv1a
+        {
+            uint64_t hash = 14695981039346656037ull;
+
+            template <typename T>
+            void Add(const T& value)
+            {
+                unsigned char bytes[sizeof(T)];
+                std::memcpy(bytes, &value, sizeof(T));
+                for (const unsigned char byte : bytes)
+                {
+                    hash = (hash ^ byte) * 1099511628211ull;
+                }
+            }
+        };
+
+        // One Koch iteration of a line, with the same math as cpu::SnowflakeNode
+        void Subdivide(const cpu::LineRecord& record, uint32_t depth, cpu::LineRecord* children, cpu::TriangleDrawRecord& triangle)
+        {
+            const cpu::float2 start = record.start;
+            const cpu::float2 end   = record.end;
+
+            const cpu::float2 perpendicular = cpu::float2{ start.y - end.y, end.x - start.x } * (std::sqrt(3.f) / 6.f);
+
+            const cpu::float2 triangleLeft  = cpu::lerp(start, end, 1.f / 3.f);
+            const cpu::float2 triangleMid   = cpu::lerp(start, end, .5f) + perpendicular;
+            const cpu::float2 triangleRight = cpu::lerp(start, end, 2.f / 3.f);
+
+            children[0] = { start, triangleLeft };
+            children[1] = { triangleLeft, triangleMid };
+            children[2] = { triangleMid, triangleRight };
+            children[3] = { triangleRight, end };
+
+            triangle = { { triangleLeft, triangleMid, triangleRight }, depth };
+        }
+
+        // Writes the Koch iterations of a line in depth-first order.
+        // Lines are written in the order of the curve, triangles before the triangles of their children.
+        void WriteSubtree(const cpu::LineRecord& record, uint32_t remainingRecursionLevels, uint32_t maxRecursionDepth,
+            cpu::LineRecord*& lines, cpu::TriangleDrawRecord*& triangles)
+        {
+            if (remainingRecursionLevels == 0)
+            {
+                *lines++ = record;
+                return;
+            }
+
+            cpu::LineRecord children[4];
+            Subdivide(record, 1 + (maxRecursionDepth - remainingRecursionLevels), children, *triangles++);
+            for (const cpu::LineRecord& child : children)
+            {
+                WriteSubtree(child, remainingRecursionLevels - 1, maxRecursionDepth, lines, triangles);
+            }
+        }
+    }
+
+    std::vector<cpu::LineRecord> GenerateTopLevels(uint32_t levels, cpu::TriangleDrawRecord* triangles)
+    {
+        cpu::NodeOutputs entry;
+        cpu::EntryNode(entry);
+        *triangles++ = entry.draws.triangles[0];
+
+        // Level by level and in the order of the curve
+        std::vector<cpu::LineRecord> lines = entry.snowflakeRecords;
+        for (uint32_t level = 0; level < levels; ++level)
+        {
+            std::vector<cpu::LineRecord> children(4 * lines.size());
+            for (size_t i = 0; i < lines.size(); ++i)
+            {
+                Subdivide(lines[i], 1 + level, &children[4 * i], *triangles++);
+            }
+            lines = std::move(children);
+        }
+        return lines;
+    }
+
+    void GenerateSubtree(const cpu::LineRecord& record, uint32_t remainingRecursionLevels, uint32_t maxRecursionDepth,
+        cpu::LineRecord* lines, cpu::TriangleDrawRecord* triangles)
+    {
+        WriteSubtree(record, remainingRecursionLevels, maxRecursionDepth, lines, triangles);
+    }
+
+    uint64_t GetParameterHash(uint32_t maxRecursionDepth)
+    {
+        cpu::NodeOutputs outputs;
+        cpu::EntryNode(outputs);
+
+        Fnv1a hash;
+        hash.Add(FileVersion);
+        hash.Add(maxRecursionDepth);
+        hash.Add(static_cast<uint32_t>(sizeof(cpu::LineRecord)));
+        hash.Add(static_cast<uint32_t>(sizeof(cpu::TriangleDrawRecord)));
+        hash.Add(outputs.draws.triangles[0]);
+        hash.Add(std::sqrt(3.f) / 6.f);
+        hash.Add(1.f / 3.f);
+        hash.Add(2.f / 3.f);
+        return hash.hash;
+    }
+
+    uint64_t GetLineCount(uint32_t maxRecursionDepth)
+    {
+        return 3ull << (2 * maxRecursionDepth);
+    }
+
+    uint64_t GetTriangleCount(uint32_t maxRecursionDepth)
+    {
+        return 1ull << (2 * maxRecursionDepth);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        Close();
+    }
+
+#ifdef _WIN32
+    bool MappedFile::Create(const std::string& path, uint64_t size)
+    {
+        Close();
+
+        file_ = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE)
+        {
+            file_ = nullptr;
+            return false;
+        }
+
+        // The mapping extends the file to its size
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), nullptr);
+        data_    = mapping_ ? static_cast<uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_WRITE, 0, 0, 0)) : nullptr;
+        size_     = size;
+        writable_ = true;
+        if (!data_)
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    bool MappedFile::OpenReadOnly(const std::string& path)
+    {
+        Close();
+
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        LARGE_INTEGER size = {};
+        if ((file_ == INVALID_HANDLE_VALUE) || !GetFileSizeEx(file_, &size) || (size.QuadPart == 0))
+        {
+            if (file_ == INVALID_HANDLE_VALUE)
+            {
+                file_ = nullptr;
+            }
+            Close();
+            return false;
+        }
+
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        data_    = mapping_ ? static_cast<uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+        size_    = static_cast<uint64_t>(size.QuadPart);
+        if (!data_)
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void MappedFile::FlushAsync(uint64_t offset, uint64_t size)
+    {
+        if (data_ && writable_)
+        {
+            FlushViewOfFile(data_ + offset, static_cast<SIZE_T>(size));
+        }
+    }
+
+    void MappedFile::Prefetch()
+    {
+        if (data_)
+        {
+            WIN32_MEMORY_RANGE_ENTRY range = { data_, static_cast<SIZE_T>(size_) };
+            PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+        }
+    }
+
+    bool MappedFile::Close()
+    {
+        bool success = true;
+        if (data_)
+        {
+            success = (!writable_ || FlushViewOfFile(data_, 0)) && UnmapViewOfFile(data_);
+        }
+        if (mapping_)
+        {
+            CloseHandle(mapping_);
+        }
+        if (file_)
+        {
+            CloseHandle(file_);
+        }
+
+        data_     = nullptr;
+        mapping_  = nullptr;
+        file_     = nullptr;
+        size_     = 0;
+        writable_ = false;
+        return success;
+    }
+#else
+    bool MappedFile::Create(const std::string& path, uint64_t size)
+    {
+        Close();
+
+        file_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if ((file_ < 0) || (ftruncate(file_, static_cast<off_t>(size)) != 0))
+        {
+            Close();
+            return false;
+        }
+
+        void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file_, 0);
+        if (data == MAP_FAILED)
+        {
+            Close();
+            return false;
+        }
+
+        data_     = static_cast<uint8_t*>(data);
+        size_     = size;
+        writable_ = true;
+        return true;
+    }
+
+    bool MappedFile::OpenReadOnly(const std::string& path)
+    {
+        Close();
+
+        file_ = open(path.c_str(), O_RDONLY);
+        struct stat status = {};
+        if ((file_ < 0) || (fstat(file_, &status) != 0) || (status.st_size == 0))
+        {
+            Close();
+            return false;
+        }
+
+        void* data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_SHARED, file_, 0);
+        if (data == MAP_FAILED)
+        {
+            Close();
+            return false;
+        }
+
+        data_ = static_cast<uint8_t*>(data);
+        size_ = static_cast<uint64_t>(status.st_size);
+        return true;
+    }
+
+    void MappedFile::FlushAsync(uint64_t offset, uint64_t size)
+    {
+        if (!data_ || !writable_)
+        {
+            return;
+        }
+
+        // msync requires a page aligned address
+        const uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        const uint64_t begin    = offset / pageSize * pageSize;
+        msync(data_ + begin, offset + size - begin, MS_ASYNC);
+    }
+
+    void MappedFile::Prefetch()
+    {
+        if (data_)
+        {
+            madvise(data_, size_, MADV_WILLNEED);
+        }
+    }
+
+    bool MappedFile::Close()
+    {
+        bool success = true;
+        if (data_)
+        {
+            success = munmap(data_, size_) == 0;
+        }
+        if (file_ >= 0)
+        {
+            success = (close(file_) == 0) && success;
+        }
+
+        data_     = nullptr;
+        file_     = -1;
+        size_     = 0;
+        writable_ = false;
+        return success;
+    }
+#endif
+
+    bool PrecomputedGeometry::Open(const std::string& path, uint32_t maxRecursionDepth, std::string* error)
+    {
+        Close();
+
+        const auto fail = [&](const std::string& reason) {
+            if (error)
+            {
+                *error = path + ": " + reason;
+            }
+            Close();
+            return false;
+        };
+
+        if (!file_.OpenReadOnly(path))
+        {
+            return fail("cannot be opened");
+        }
+        if (file_.GetSize() < sizeof(FileHeader))
+        {
+            return fail("is too small for a header");
+        }
+
+        // The data is aligned to the page size, so the header and records can be read in place
+        const FileHeader& header = *reinterpret_cast<const FileHeader*>(file_.GetData());
+        if (std::memcmp(header.magic, FileMagic, sizeof(FileMagic)) != 0)
+        {
+            return fail("is not a geometry file or its export was interrupted");
+        }
+        if ((header.version != FileVersion) || (header.headerBytes != sizeof(FileHeader)) ||
+            (header.lineRecordBytes != sizeof(cpu::LineRecord)) || (header.triangleRecordBytes != sizeof(cpu::TriangleDrawRecord)))
+        {
+            return fail("has version " + std::to_string(header.version) + " or a record layout which is not supported");
+        }
+        if (header.maxRecursionDepth != maxRecursionDepth)
+        {
+            return fail("has recursion depth " + std::to_string(header.maxRecursionDepth) + " instead of " + std::to_string(maxRecursionDepth));
+        }
+        if (header.parameterHash != GetParameterHash(maxRecursionDepth))
+        {
+            return fail("was generated with different parameters");
+        }
+
+        // Counts and offsets are checked against the file, so the views never reach past the mapping
+        if ((header.lineCount != GetLineCount(maxRecursionDepth)) || (header.triangleCount != GetTriangleCount(maxRecursionDepth)) ||
+            (header.lineOffset % SectionAlignment != 0) || (header.triangleOffset % SectionAlignment != 0) ||
+            (header.lineOffset < sizeof(FileHeader)) ||
+            (header.lineOffset + header.lineCount * sizeof(cpu::LineRecord) > header.triangleOffset) ||
+            (header.triangleOffset + header.triangleCount * sizeof(cpu::TriangleDrawRecord) > header.fileBytes) ||
+            (header.fileBytes != file_.GetSize()))
+        {
+            return fail("has an inconsistent layout or is truncated");
+        }
+
+        // The records are read front to back by the first frame
+        file_.Prefetch();
+        header_ = &header;
+        return true;
+    }
+
+    void PrecomputedGeometry::Close()
+    {
+        header_ = nullptr;
+        file_.Close();
+    }
+
+    cpu::DrawRecordView PrecomputedGeometry::GetDrawRecords() const
+    {
+        cpu::DrawRecordView view;
+        if (header_)
+        {
+            view.lines         = reinterpret_cast<const cpu::LineRecord*>(file_.GetData() + header_->lineOffset);
+            view.lineCount     = static_cast<size_t>(header_->lineCount);
+            view.triangles     = reinterpret_cast<const cpu::TriangleDrawRecord*>(file_.GetData() + header_->triangleOffset);
+            view.triangleCount = static_cast<size_t>(header_->triangleCount);
+        }
+        return view;
+    }
+
+    bool ExportGeometry(const std::string& path, uint32_t maxRecursionDepth, uint32_t threadCount, ExportReport* report)
+    {
+        if (maxRecursionDepth > MaxFileRecursionDepth)
+        {
+            return false;
+        }
+
+        FileHeader header = {};
+        header.version             = FileVersion;
+        header.headerBytes         = sizeof(FileHeader);
+        header.maxRecursionDepth   = maxRecursionDepth;
+        header.lineRecordBytes     = sizeof(cpu::LineRecord);
+        header.triangleRecordBytes = sizeof(cpu::TriangleDrawRecord);
+        header.parameterHash       = GetParameterHash(maxRecursionDepth);
+        header.lineCount           = GetLineCount(maxRecursionDepth);
+        header.lineOffset          = AlignUp(sizeof(FileHeader), SectionAlignment);
+        header.triangleCount       = GetTriangleCount(maxRecursionDepth);
+        header.triangleOffset      = AlignUp(header.lineOffset + header.lineCount * sizeof(cpu::LineRecord), SectionAlignment);
+        header.fileBytes           = header.triangleOffset + header.triangleCount * sizeof(cpu::TriangleDrawRecord);
+
+        MappedFile file;
+        if (!file.Create(path, header.fileBytes))
+        {
+            return false;
+        }
+
+        cpu::TriangleDrawRecord* triangles = reinterpret_cast<cpu::TriangleDrawRecord*>(file.GetData() + header.triangleOffset);
+
+        // The Koch subtrees below splitLevel are the chunks, enough to keep all threads busy
+        cpu::WorkerPool pool(threadCount);
+        uint32_t splitLevel = 0;
+        while ((splitLevel < maxRecursionDepth) && ((3ull << (2 * splitLevel)) < 64ull * pool.GetThreadCount()))
+        {
+            ++splitLevel;
+        }
+
+        // Iterations above the chunks
+        const std::vector<cpu::LineRecord> roots = GenerateTopLevels(splitLevel, triangles);
+
+        // Every chunk has a fixed range of lines and triangles, so all chunks are written in parallel
+        const uint32_t remainingRecursionLevels = maxRecursionDepth - splitLevel;
+        const uint64_t chunkLines         = GetTriangleCount(remainingRecursionLevels);
+        const uint64_t chunkTriangles     = (chunkLines - 1) / 3;
+        const uint64_t firstChunkTriangle = GetTriangleCount(splitLevel);
+        pool.ParallelFor(static_cast<uint32_t>(roots.size()), [&](uint32_t chunk, uint32_t) {
+            const uint64_t lineOffset     = header.lineOffset + chunk * chunkLines * sizeof(cpu::LineRecord);
+            const uint64_t triangleOffset = header.triangleOffset + (firstChunkTriangle + chunk * chunkTriangles) * sizeof(cpu::TriangleDrawRecord);
+
+            cpu::LineRecord*         chunkLineData     = reinterpret_cast<cpu::LineRecord*>(file.GetData() + lineOffset);
+            cpu::TriangleDrawRecord* chunkTriangleData = reinterpret_cast<cpu::TriangleDrawRecord*>(file.GetData() + triangleOffset);
+            GenerateSubtree(roots[chunk], remainingRecursionLevels, maxRecursionDepth, chunkLineData, chunkTriangleData);
+
+            // Written back while the other chunks are generated
+            file.FlushAsync(lineOffset, chunkLines * sizeof(cpu::LineRecord));
+            file.FlushAsync(triangleOffset, chunkTriangles * sizeof(cpu::TriangleDrawRecord));
+        });
+
+        std::memcpy(header.magic, FileMagic, sizeof(FileMagic));
+        std::memcpy(file.GetData(), &header, sizeof(FileHeader));
+
+        if (report)
+        {
+            report->lines     = header.lineCount;
+            report->triangles = header.triangleCount;
+            report->fileBytes = header.fileBytes;
+            report->chunks    = static_cast<uint32_t>(roots.size());
+        }
+
+        return file.Close();
+    }
+}
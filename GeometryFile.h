@@ -0,0 +1,153 @@
+/**********************************************************************
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+
+#pragma once
+
+// Binary file of the generated snowflake geometry, written through a memory mapping.
+// This file does not depend on D3D12 and builds on Windows and POSIX systems.
+//
+// Layout, little endian:
+//   FileHeader                                          at offset 0
+//   cpu::LineRecord[lineCount]                          at lineOffset, the outline segments in the order of the Koch curve
+//   cpu::TriangleDrawRecord[triangleCount]              at triangleOffset, the fill triangles with their depth
+// Both sections start at a multiple of SectionAlignment and have the layout of the HLSL records,
+// such that they can be drawn or uploaded directly from the mapping.
+// The triangles are ordered by Koch subtree: the base triangle, the triangles above the subtrees
+// (level by level) and then the triangles of each subtree in depth-first order.
+
+#include "CpuWorkGraph.h"
+
+#include <string>
+#include <vector>
+
+namespace geometry {
+    constexpr char     FileMagic[8]     = { 'K', 'O', 'C', 'H', 'G', 'E', 'O', 0 };
+    constexpr uint32_t FileVersion      = 1;
+    constexpr uint64_t SectionAlignment = 4096;
+    // 3 * 4^16 lines are already 192 GiB
+    constexpr uint32_t MaxFileRecursionDepth = 16;
+
+    struct FileHeader
+    {
+        char     magic[8];
+        uint32_t version;
+        uint32_t headerBytes;
+        uint32_t maxRecursionDepth;
+        uint32_t lineRecordBytes;
+        uint32_t triangleRecordBytes;
+        uint32_t reserved;
+        // Hash of all parameters which determine the geometry, see GetParameterHash
+        uint64_t parameterHash;
+        uint64_t lineCount;
+        uint64_t lineOffset;
+        uint64_t triangleCount;
+        uint64_t triangleOffset;
+        uint64_t fileBytes;
+    };
+
+    static_assert(sizeof(FileHeader) == 80, "FileHeader must not contain padding");
+
+    // FNV-1a hash of the file version, the recursion depth, the record layouts, the base triangle and the Koch constants
+    uint64_t GetParameterHash(uint32_t maxRecursionDepth);
+
+    // Line and triangle counts of a recursion depth, 3 * 4^depth and 4^depth
+    uint64_t GetLineCount(uint32_t maxRecursionDepth);
+    uint64_t GetTriangleCount(uint32_t maxRecursionDepth);
+
+    // Koch iterations in the order of the file sections, shared by the exporter and the geometry stream (GeometryStream.h).
+    // Writes the base triangle and the triangles of the first levels iterations (4^levels triangles), level by level,
+    // and returns the 3 * 4^levels lines after them in the order of the curve.
+    std::vector<cpu::LineRecord> GenerateTopLevels(uint32_t levels, cpu::TriangleDrawRecord* triangles);
+    // Writes the 4^remainingRecursionLevels lines and (4^remainingRecursionLevels - 1) / 3 triangles of the Koch subtree below a line
+    // in depth-first order, with the triangle depths of a graph with maxRecursionDepth
+    void GenerateSubtree(const cpu::LineRecord& record, uint32_t remainingRecursionLevels, uint32_t maxRecursionDepth,
+        cpu::LineRecord* lines, cpu::TriangleDrawRecord* triangles);
+
+    // File mapped into memory, either created with a fixed size for writing or opened read-only
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // Creates or truncates the file to size bytes and maps it for writing
+        bool Create(const std::string& path, uint64_t size);
+        bool OpenReadOnly(const std::string& path);
+        // Starts writing back a range of the mapping without waiting for it
+        void FlushAsync(uint64_t offset, uint64_t size);
+        // Starts reading the whole file into the page cache without waiting for it
+        void Prefetch();
+        // Unmaps and closes the file, the operating system writes back the remaining pages
+        bool Close();
+
+        uint8_t*       GetData() { return data_; }
+        const uint8_t* GetData() const { return data_; }
+        uint64_t       GetSize() const { return size_; }
+
+    private:
+        uint8_t* data_     = nullptr;
+        uint64_t size_     = 0;
+        bool     writable_ = false;
+#ifdef _WIN32
+        void*    file_     = nullptr;
+        void*    mapping_  = nullptr;
+#else
+        int      file_     = -1;
+#endif
+    };
+
+    struct ExportReport
+    {
+        uint64_t lines     = 0;
+        uint64_t triangles = 0;
+        uint64_t fileBytes = 0;
+        // Koch subtrees written in parallel, directly into the mapping
+        uint32_t chunks    = 0;
+    };
+
+    // Precomputed geometry mapped read-only, with the records used in place instead of being generated at startup
+    class PrecomputedGeometry
+    {
+    public:
+        // Maps the file and validates its header against the parameters of maxRecursionDepth.
+        // On failure, error receives the reason and nothing stays mapped.
+        bool Open(const std::string& path, uint32_t maxRecursionDepth, std::string* error = nullptr);
+        void Close();
+
+        bool IsOpen() const { return header_ != nullptr; }
+        const FileHeader& GetHeader() const { return *header_; }
+        // Points into the mapping and is valid until Close
+        cpu::DrawRecordView GetDrawRecords() const;
+
+    private:
+        MappedFile        file_;
+        const FileHeader* header_ = nullptr;
+    };
+
+    // Generates the geometry of a recursion depth straight into a mapped file, with one task per Koch subtree on threadCount threads.
+    // The header is written last, so an interrupted export leaves a file without a valid magic.
+    bool ExportGeometry(const std::string& path, uint32_t maxRecursionDepth, uint32_t threadCount, ExportReport* report = nullptr);
+}
@@ -0,0 +1,524 @@
+/**********************************************************************
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+
+#include "GeometryStream.h"
+
+#include "GeometryFile.h"
+
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace geometry {
+    namespace {
+        // Slots hold at most 4^10 lines (16 MiB)
+        constexpr uint32_t MaxChunkRecursionLevels = 10;
+
+        uint64_t AlignUp(uint64_t value, uint64_t alignment)
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        // Spins briefly and then sleeps until condition returns true. Returns false after timeoutMs.
+        template <typename Condition>
+        bool WaitFor(Condition&& condition, uint32_t timeoutMs)
+        {
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+            for (uint32_t attempt = 0; !condition(); ++attempt)
+            {
+                if (std::chrono::steady_clock::now() >= deadline)
+                {
+                    return false;
+                }
+                if (attempt < 64)
+                {
+                    std::this_thread::yield();
+                }
+                else
+                {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+            }
+            return true;
+        }
+
+        uint8_t* GetSlot(const StreamHeader& header, uint64_t sequence)
+        {
+            uint8_t* base = reinterpret_cast<uint8_t*>(const_cast<StreamHeader*>(&header));
+            return base + header.slotsOffset + (sequence % header.slotCount) * header.slotBytes;
+        }
+    }
+
+    SharedMemory::~SharedMemory()
+    {
+        Close();
+    }
+
+#ifdef _WIN32
+    bool SharedMemory::Create(const std::string& name, uint64_t size)
+    {
+        Close();
+
+        // A mapping of the same name only exists while another producer is running
+        name_    = "Local\\" + name;
+        mapping_ = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), name_.c_str());
+        if (!mapping_ || (GetLastError() == ERROR_ALREADY_EXISTS))
+        {
+            Close();
+            return false;
+        }
+
+        data_  = static_cast<uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+        size_  = size;
+        owner_ = true;
+        if (!data_)
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    bool SharedMemory::Open(const std::string& name)
+    {
+        Close();
+
+        name_    = "Local\\" + name;
+        mapping_ = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name_.c_str());
+        data_    = mapping_ ? static_cast<uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_ALL_ACCESS, 0, 0, 0)) : nullptr;
+        if (!data_)
+        {
+            Close();
+            return false;
+        }
+
+        // The view covers the whole mapping, rounded up to pages
+        MEMORY_BASIC_INFORMATION information = {};
+        VirtualQuery(data_, &information, sizeof(information));
+        size_ = information.RegionSize;
+        return true;
+    }
+
+    void SharedMemory::Close()
+    {
+        if (data_)
+        {
+            UnmapViewOfFile(data_);
+        }
+        if (mapping_)
+        {
+            // The name is removed with the last handle
+            CloseHandle(mapping_);
+        }
+
+        data_    = nullptr;
+        mapping_ = nullptr;
+        size_    = 0;
+        owner_   = false;
+    }
+#else
+    bool SharedMemory::Create(const std::string& name, uint64_t size)
+    {
+        Close();
+
+        // A left over object of a producer which did not close its stream is replaced
+        name_ = (name.empty() || (name[0] != '/')) ? "/" + name : name;
+        shm_unlink(name_.c_str());
+
+        const int file = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (file < 0)
+        {
+            return false;
+        }
+        owner_ = true;
+
+        void* data = (ftruncate(file, static_cast<off_t>(size)) == 0) ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0) : MAP_FAILED;
+        close(file);
+        if (data == MAP_FAILED)
+        {
+            Close();
+            return false;
+        }
+
+        data_ = static_cast<uint8_t*>(data);
+        size_ = size;
+        return true;
+    }
+
+    bool SharedMemory::Open(const std::string& name)
+    {
+        Close();
+
+        name_ = (name.empty() || (name[0] != '/')) ? "/" + name : name;
+        const int file = shm_open(name_.c_str(), O_RDWR, 0);
+        if (file < 0)
+        {
+            return false;
+        }
+
+        // The size is zero until the producer has resized the object
+        struct stat status = {};
+        void* data = MAP_FAILED;
+        if ((fstat(file, &status) == 0) && (status.st_size > 0))
+        {
+            data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+        }
+        close(file);
+        if (data == MAP_FAILED)
+        {
+            return false;
+        }
+
+        data_ = static_cast<uint8_t*>(data);
+        size_ = static_cast<uint64_t>(status.st_size);
+        return true;
+    }
+
+    void SharedMemory::Close()
+    {
+        if (data_)
+        {
+            munmap(data_, size_);
+        }
+        if (owner_)
+        {
+            shm_unlink(name_.c_str());
+        }
+
+        data_  = nullptr;
+        size_  = 0;
+        owner_ = false;
+    }
+#endif
+
+    StreamProducer::~StreamProducer()
+    {
+        Close();
+    }
+
+    bool StreamProducer::Create(const std::string& name, uint32_t maxRecursionDepth, const StreamDesc& desc)
+    {
+        Close();
+
+        if ((maxRecursionDepth > MaxFileRecursionDepth) || (desc.slotCount == 0) || (desc.chunkRecursionLevels > MaxChunkRecursionLevels))
+        {
+            return false;
+        }
+
+        // Slots are sized for the subtrees of this depth
+        const uint32_t chunkRecursionLevels = (desc.chunkRecursionLevels < maxRecursionDepth) ? desc.chunkRecursionLevels : maxRecursionDepth;
+        const uint64_t lineCapacity     = GetTriangleCount(chunkRecursionLevels);
+        // The top chunks need room for the base triangle
+        const uint64_t triangleCapacity = (lineCapacity > 1) ? (lineCapacity - 1) / 3 : 1;
+        const uint64_t triangleOffset   = AlignUp(sizeof(StreamSlotHeader) + lineCapacity * sizeof(cpu::LineRecord), 64);
+        const uint64_t slotBytes        = AlignUp(triangleOffset + triangleCapacity * sizeof(cpu::TriangleDrawRecord), SectionAlignment);
+        const uint64_t slotsOffset      = AlignUp(sizeof(StreamHeader), SectionAlignment);
+
+        if (!memory_.Create(name, slotsOffset + desc.slotCount * slotBytes))
+        {
+            return false;
+        }
+
+        header_ = new (memory_.GetData()) StreamHeader;
+        header_->version              = StreamVersion;
+        header_->headerBytes          = sizeof(StreamHeader);
+        header_->maxRecursionDepth    = maxRecursionDepth;
+        header_->slotCount            = desc.slotCount;
+        header_->parameterHash        = GetParameterHash(maxRecursionDepth);
+        header_->slotsOffset          = slotsOffset;
+        header_->slotBytes            = slotBytes;
+        header_->triangleOffset       = triangleOffset;
+        header_->chunkRecursionLevels = chunkRecursionLevels;
+        header_->lineCapacity         = static_cast<uint32_t>(lineCapacity);
+        header_->triangleCapacity     = static_cast<uint32_t>(triangleCapacity);
+        header_->closed.store(0);
+        header_->published.store(0);
+        for (StreamConsumerCursor& cursor : header_->consumers)
+        {
+            cursor.sequence.store(0);
+            cursor.state.store(StreamConsumerCursor::Free);
+        }
+        std::memcpy(header_->magic, StreamMagic, sizeof(StreamMagic));
+
+        // Consumers only read the header after this
+        header_->ready.store(1, std::memory_order_release);
+
+        sequence_ = 0;
+        return true;
+    }
+
+    uint32_t StreamProducer::GetAttachedConsumers() const
+    {
+        uint32_t count = 0;
+        for (const StreamConsumerCursor& cursor : header_->consumers)
+        {
+            count += (cursor.state.load() == StreamConsumerCursor::Attached) ? 1 : 0;
+        }
+        return count;
+    }
+
+    bool StreamProducer::WaitForConsumers(uint32_t count, uint32_t timeoutMs)
+    {
+        return WaitFor([&] { return GetAttachedConsumers() >= count; }, timeoutMs);
+    }
+
+    bool StreamProducer::BeginChunk(StreamSlot& slot, uint32_t timeoutMs)
+    {
+        // The slot of chunk sequence_ last held chunk sequence_ - slotCount, which every attached consumer must have released.
+        // Attaching consumers start after the chunks published before they are attached, see StreamConsumer::Open.
+        const bool released = WaitFor([&] {
+            for (const StreamConsumerCursor& cursor : header_->consumers)
+            {
+                if ((cursor.state.load() == StreamConsumerCursor::Attached) && (sequence_ - cursor.sequence.load() >= header_->slotCount))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }, timeoutMs);
+        if (!released)
+        {
+            return false;
+        }
+
+        uint8_t* data = GetSlot(*header_, sequence_);
+        slot.lines            = reinterpret_cast<cpu::LineRecord*>(data + sizeof(StreamSlotHeader));
+        slot.triangles        = reinterpret_cast<cpu::TriangleDrawRecord*>(data + header_->triangleOffset);
+        slot.lineCapacity     = header_->lineCapacity;
+        slot.triangleCapacity = header_->triangleCapacity;
+        return true;
+    }
+
+    void StreamProducer::EndChunk(uint32_t frame, uint32_t chunk, uint32_t lineCount, uint32_t triangleCount, bool lastChunkOfFrame)
+    {
+        StreamSlotHeader* slotHeader = reinterpret_cast<StreamSlotHeader*>(GetSlot(*header_, sequence_));
+        slotHeader->sequence         = sequence_;
+        slotHeader->frame            = frame;
+        slotHeader->chunk            = chunk;
+        slotHeader->lineCount        = lineCount;
+        slotHeader->triangleCount    = triangleCount;
+        slotHeader->lastChunkOfFrame = lastChunkOfFrame ? 1 : 0;
+        slotHeader->reserved         = 0;
+
+        // Sequentially consistent, such that either this producer sees a consumer attaching or the consumer sees this chunk
+        header_->published.store(++sequence_);
+    }
+
+    void StreamProducer::Close()
+    {
+        if (header_)
+        {
+            header_->closed.store(1, std::memory_order_release);
+        }
+        header_ = nullptr;
+        memory_.Close();
+    }
+
+    StreamConsumer::~StreamConsumer()
+    {
+        Close();
+    }
+
+    bool StreamConsumer::Open(const std::string& name, uint32_t maxRecursionDepth, uint32_t timeoutMs, std::string* error)
+    {
+        Close();
+
+        const auto fail = [&](const std::string& reason) {
+            if (error)
+            {
+                *error = name + ": " + reason;
+            }
+            Close();
+            return false;
+        };
+
+        // The producer may not have created or initialized the stream yet
+        const bool opened = WaitFor([&] {
+            if (memory_.Open(name) && (memory_.GetSize() >= sizeof(StreamHeader)) &&
+                reinterpret_cast<StreamHeader*>(memory_.GetData())->ready.load(std::memory_order_acquire))
+            {
+                return true;
+            }
+            memory_.Close();
+            return false;
+        }, timeoutMs);
+        if (!opened)
+        {
+            return fail("no stream was created within " + std::to_string(timeoutMs) + " ms");
+        }
+
+        header_ = reinterpret_cast<StreamHeader*>(memory_.GetData());
+        if ((std::memcmp(header_->magic, StreamMagic, sizeof(StreamMagic)) != 0) || (header_->version != StreamVersion) ||
+            (header_->headerBytes != sizeof(StreamHeader)))
+        {
+            return fail("is not a geometry stream of version " + std::to_string(StreamVersion));
+        }
+        if (header_->maxRecursionDepth != maxRecursionDepth)
+        {
+            return fail("has recursion depth " + std::to_string(header_->maxRecursionDepth) + " instead of " + std::to_string(maxRecursionDepth));
+        }
+        if (header_->parameterHash != GetParameterHash(maxRecursionDepth))
+        {
+            return fail("was generated with different parameters");
+        }
+        if ((header_->slotCount == 0) || (header_->slotsOffset + header_->slotCount * header_->slotBytes > memory_.GetSize()) ||
+            (sizeof(StreamSlotHeader) + header_->lineCapacity * sizeof(cpu::LineRecord) > header_->triangleOffset) ||
+            (header_->triangleOffset + header_->triangleCapacity * sizeof(cpu::TriangleDrawRecord) > header_->slotBytes))
+        {
+            return fail("has an inconsistent layout");
+        }
+
+        for (StreamConsumerCursor& cursor : header_->consumers)
+        {
+            uint32_t state = StreamConsumerCursor::Free;
+            if (!cursor.state.compare_exchange_strong(state, StreamConsumerCursor::Attaching))
+            {
+                continue;
+            }
+
+            // Once the producer sees the cursor as attached, it does not overwrite the chunks after the cursor.
+            // It may have published more chunks before, thus the consumer starts after all chunks published once it is attached.
+            cursor.sequence.store(header_->published.load());
+            cursor.state.store(StreamConsumerCursor::Attached);
+            sequence_ = header_->published.load();
+            cursor.sequence.store(sequence_);
+
+            cursor_ = &cursor;
+            return true;
+        }
+
+        return fail("already has " + std::to_string(MaxStreamConsumers) + " consumers");
+    }
+
+    bool StreamConsumer::Acquire(StreamChunk& chunk, uint32_t timeoutMs)
+    {
+        const bool available = WaitFor([&] {
+            return (header_->published.load(std::memory_order_acquire) > sequence_) || header_->closed.load(std::memory_order_acquire);
+        }, timeoutMs);
+        // Chunks published before the stream was closed are still read
+        if (!available || (header_->published.load(std::memory_order_acquire) <= sequence_))
+        {
+            return false;
+        }
+
+        const uint8_t* data = GetSlot(*header_, sequence_);
+        const StreamSlotHeader& slotHeader = *reinterpret_cast<const StreamSlotHeader*>(data);
+        if ((slotHeader.sequence != sequence_) || (slotHeader.lineCount > header_->lineCapacity) || (slotHeader.triangleCount > header_->triangleCapacity))
+        {
+            return false;
+        }
+
+        chunk.sequence                = sequence_;
+        chunk.frame                   = slotHeader.frame;
+        chunk.chunk                   = slotHeader.chunk;
+        chunk.lastChunkOfFrame        = slotHeader.lastChunkOfFrame != 0;
+        chunk.records.lines           = reinterpret_cast<const cpu::LineRecord*>(data + sizeof(StreamSlotHeader));
+        chunk.records.lineCount       = slotHeader.lineCount;
+        chunk.records.triangles       = reinterpret_cast<const cpu::TriangleDrawRecord*>(data + header_->triangleOffset);
+        chunk.records.triangleCount   = slotHeader.triangleCount;
+        return true;
+    }
+
+    void StreamConsumer::Release()
+    {
+        cursor_->sequence.store(++sequence_, std::memory_order_release);
+    }
+
+    bool StreamConsumer::IsEndOfStream() const
+    {
+        return header_ && header_->closed.load(std::memory_order_acquire) && (header_->published.load(std::memory_order_acquire) <= sequence_);
+    }
+
+    void StreamConsumer::Close()
+    {
+        if (cursor_)
+        {
+            cursor_->state.store(StreamConsumerCursor::Free);
+        }
+        cursor_ = nullptr;
+        header_ = nullptr;
+        memory_.Close();
+    }
+
+    bool StreamGeometry(StreamProducer& producer, uint32_t frame, uint32_t timeoutMs, StreamReport* report)
+    {
+        const StreamHeader& header = producer.GetHeader();
+        const uint32_t maxRecursionDepth    = header.maxRecursionDepth;
+        const uint32_t chunkRecursionLevels = header.chunkRecursionLevels;
+        const uint32_t splitLevel           = maxRecursionDepth - chunkRecursionLevels;
+
+        StreamReport counts;
+        StreamSlot slot;
+        uint32_t chunk = 0;
+
+        // Triangles above the subtrees, these are few compared to the subtrees and copied into the slots
+        std::vector<cpu::TriangleDrawRecord> topTriangles(GetTriangleCount(splitLevel));
+        const std::vector<cpu::LineRecord> roots = GenerateTopLevels(splitLevel, topTriangles.data());
+        for (size_t first = 0; first < topTriangles.size(); first += header.triangleCapacity)
+        {
+            const size_t   remaining = topTriangles.size() - first;
+            const uint32_t count     = (remaining < header.triangleCapacity) ? static_cast<uint32_t>(remaining) : header.triangleCapacity;
+            if (!producer.BeginChunk(slot, timeoutMs))
+            {
+                return false;
+            }
+            std::memcpy(slot.triangles, &topTriangles[first], count * sizeof(cpu::TriangleDrawRecord));
+            producer.EndChunk(frame, chunk++, 0, count, false);
+            counts.triangles += count;
+        }
+
+        // Subtrees are generated straight into the slots
+        const uint32_t subtreeLines     = static_cast<uint32_t>(GetTriangleCount(chunkRecursionLevels));
+        const uint32_t subtreeTriangles = (subtreeLines - 1) / 3;
+        for (size_t i = 0; i < roots.size(); ++i)
+        {
+            if (!producer.BeginChunk(slot, timeoutMs))
+            {
+                return false;
+            }
+            GenerateSubtree(roots[i], chunkRecursionLevels, maxRecursionDepth, slot.lines, slot.triangles);
+            producer.EndChunk(frame, chunk++, subtreeLines, subtreeTriangles, i + 1 == roots.size());
+            counts.lines     += subtreeLines;
+            counts.triangles += subtreeTriangles;
+        }
+
+        counts.chunks = chunk;
+        counts.bytes  = counts.lines * sizeof(cpu::LineRecord) + counts.triangles * sizeof(cpu::TriangleDrawRecord);
+        if (report)
+        {
+            *report = counts;
+        }
+        return true;
+    }
+}
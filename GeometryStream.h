@@ -0,0 +1,225 @@
+/**********************************************************************
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+
+#pragma once
+
+// Ring buffer in shared memory, which streams the generated geometry to consumers in other processes.
+// This file does not depend on D3D12 and builds on Windows (named file mappings) and POSIX systems (shm_open).
+//
+// Layout:
+//   StreamHeader                                        at offset 0
+//   slotCount slots of slotBytes each                   at slotsOffset, page aligned
+// A slot holds one chunk: a StreamSlotHeader, its cpu::LineRecords and at triangleOffset its cpu::TriangleDrawRecords,
+// with the layout of the HLSL records like the geometry file (GeometryFile.h).
+//
+// There is one producer and up to MaxStreamConsumers consumers, which all receive every chunk.
+// Chunk n goes to slot n % slotCount. The producer publishes a chunk by incrementing StreamHeader::published,
+// every consumer releases a chunk by incrementing its cursor. The producer only reuses a slot once all attached
+// consumers have released it, so consumers read the records in place without copying and without locks.
+// A consumer which exits without detaching stalls the producer until its timeout.
+
+#include "CpuWorkGraph.h"
+
+#include <atomic>
+#include <string>
+
+namespace geometry {
+    constexpr char     StreamMagic[8]      = { 'K', 'O', 'C', 'H', 'R', 'N', 'G', 0 };
+    constexpr uint32_t StreamVersion       = 1;
+    constexpr uint32_t MaxStreamConsumers  = 8;
+
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "Atomics in shared memory must be lock-free");
+
+    struct StreamDesc
+    {
+        uint32_t slotCount = 32;
+        // Chunks are Koch subtrees with this many iterations, 7 iterations are 16384 lines and 5461 triangles (406 KiB)
+        uint32_t chunkRecursionLevels = 7;
+    };
+
+    struct alignas(64) StreamConsumerCursor
+    {
+        enum State : uint32_t
+        {
+            Free,
+            Attaching,
+            Attached
+        };
+
+        // Sequence number of the next chunk the consumer reads, all chunks before are released
+        std::atomic<uint64_t> sequence;
+        std::atomic<uint32_t> state;
+    };
+
+    struct StreamHeader
+    {
+        char     magic[8];
+        uint32_t version;
+        uint32_t headerBytes;
+        uint32_t maxRecursionDepth;
+        uint32_t slotCount;
+        // Hash of the generating parameters, see GetParameterHash
+        uint64_t parameterHash;
+        uint64_t slotsOffset;
+        uint64_t slotBytes;
+        // Offset of the triangles within a slot
+        uint64_t triangleOffset;
+        // Koch iterations per subtree chunk, the slots hold 4^chunkRecursionLevels lines
+        uint32_t chunkRecursionLevels;
+        uint32_t lineCapacity;
+        uint32_t triangleCapacity;
+
+        // Set once the header is initialized
+        std::atomic<uint32_t> ready;
+        // Set when the producer has published its last chunk
+        std::atomic<uint32_t> closed;
+        // Number of published chunks
+        alignas(64) std::atomic<uint64_t> published;
+
+        StreamConsumerCursor consumers[MaxStreamConsumers];
+    };
+
+    struct StreamSlotHeader
+    {
+        // Sequence number of the chunk in the slot
+        uint64_t sequence;
+        // Pass over the whole geometry and chunk within it, chunk 0 starts a frame
+        uint32_t frame;
+        uint32_t chunk;
+        uint32_t lineCount;
+        uint32_t triangleCount;
+        uint32_t lastChunkOfFrame;
+        uint32_t reserved;
+    };
+
+    // Named shared memory, created by the producer and opened by the consumers
+    class SharedMemory
+    {
+    public:
+        SharedMemory() = default;
+        ~SharedMemory();
+
+        SharedMemory(const SharedMemory&) = delete;
+        SharedMemory& operator=(const SharedMemory&) = delete;
+
+        // Creates the shared memory with size bytes, replacing a left over object of the same name
+        bool Create(const std::string& name, uint64_t size);
+        bool Open(const std::string& name);
+        // Unmaps the memory, the creator also removes the name such that no other process can open it anymore
+        void Close();
+
+        uint8_t* GetData() const { return data_; }
+        uint64_t GetSize() const { return size_; }
+
+    private:
+        uint8_t*    data_  = nullptr;
+        uint64_t    size_  = 0;
+        std::string name_;
+        bool        owner_ = false;
+#ifdef _WIN32
+        void*       mapping_ = nullptr;
+#endif
+    };
+
+    // Chunk slot reserved for writing by the producer
+    struct StreamSlot
+    {
+        cpu::LineRecord*         lines            = nullptr;
+        cpu::TriangleDrawRecord* triangles        = nullptr;
+        uint32_t                 lineCapacity     = 0;
+        uint32_t                 triangleCapacity = 0;
+    };
+
+    // Chunk acquired by a consumer, the records point into the shared memory and are valid until Release
+    struct StreamChunk
+    {
+        uint64_t            sequence         = 0;
+        uint32_t            frame            = 0;
+        uint32_t            chunk            = 0;
+        bool                lastChunkOfFrame = false;
+        cpu::DrawRecordView records;
+    };
+
+    class StreamProducer
+    {
+    public:
+        ~StreamProducer();
+
+        bool Create(const std::string& name, uint32_t maxRecursionDepth, const StreamDesc& desc = {});
+        // Waits until count consumers are attached, such that they receive the stream from its first chunk
+        bool WaitForConsumers(uint32_t count, uint32_t timeoutMs);
+
+        // Waits until all consumers have released the next slot and returns it for writing. Fails after timeoutMs.
+        bool BeginChunk(StreamSlot& slot, uint32_t timeoutMs);
+        // Publishes the slot of BeginChunk
+        void EndChunk(uint32_t frame, uint32_t chunk, uint32_t lineCount, uint32_t triangleCount, bool lastChunkOfFrame);
+
+        // Publishes the end of the stream and removes its name, attached consumers read the remaining chunks
+        void Close();
+
+        const StreamHeader& GetHeader() const { return *header_; }
+        uint32_t GetAttachedConsumers() const;
+
+    private:
+        SharedMemory  memory_;
+        StreamHeader* header_   = nullptr;
+        uint64_t      sequence_ = 0;
+    };
+
+    class StreamConsumer
+    {
+    public:
+        ~StreamConsumer();
+
+        // Attaches to the stream of a producer, waiting up to timeoutMs for it to be created.
+        // The header is validated against maxRecursionDepth like a geometry file. The first chunk is the next one to be published.
+        bool Open(const std::string& name, uint32_t maxRecursionDepth, uint32_t timeoutMs, std::string* error = nullptr);
+
+        // Waits for the next chunk. Fails after timeoutMs or at the end of the stream, see IsEndOfStream.
+        bool Acquire(StreamChunk& chunk, uint32_t timeoutMs);
+        // Hands the slot of the acquired chunk back to the producer
+        void Release();
+
+        bool IsEndOfStream() const;
+        // Detaches from the stream
+        void Close();
+
+    private:
+        SharedMemory          memory_;
+        StreamHeader*         header_ = nullptr;
+        StreamConsumerCursor* cursor_ = nullptr;
+        uint64_t              sequence_ = 0;
+    };
+
+    struct StreamReport
+    {
+        uint64_t chunks    = 0;
+        uint64_t lines     = 0;
+        uint64_t triangles = 0;
+        uint64_t bytes     = 0;
+    };
+
+    // Publishes one frame of the geometry in the order of the geometry file: the triangles above the Koch subtrees
+    // (split over several chunks if needed) and then one chunk per subtree, generated straight into the slots.
+    bool StreamGeometry(StreamProducer& producer, uint32_t frame, uint32_t timeoutMs, StreamReport* report = nullptr);
+}
@@ -0,0 +1,304 @@
+/**********************************************************************
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+#include "GpuPerfModel.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace perf {
+    namespace {
+        uint64_t DivideRoundUp(uint64_t value, uint64_t divisor)
+        {
+            return (value + divisor - 1) / divisor;
+        }
+    }
+
+    const char* GetLaunchModeName(LaunchMode mode)
+    {
+        switch (mode) {
+            case LaunchMode::Thread:       return "thread";
+            case LaunchMode::Broadcasting: return "broadcasting";
+            case LaunchMode::Coalescing:   return "coalescing";
+            case LaunchMode::Mesh:         return "mesh";
+            default:                       return "unknown";
+        }
+    }
+
+    double Estimate::GetLaneUtilization() const
+    {
+        uint64_t lanes       = 0;
+        uint64_t activeLanes = 0;
+        for (const NodeEstimate& node : nodes)
+        {
+            lanes       += node.lanes;
+            activeLanes += node.activeLanes;
+        }
+        return lanes ? static_cast<double>(activeLanes) / lanes : 0.0;
+    }
+
+    void Estimate::Print() const
+    {
+        printf("%s: %.0f cycles, %.1f%% lane utilization, %llu bytes peak record queue\n", name.c_str(), totalCycles,
+            GetLaneUtilization() * 100.0, static_cast<unsigned long long>(peakQueuedBytes));
+
+        printf("  %-20s %10s %10s %10s %8s %12s\n", "node", "records", "groups", "waves", "lanes", "wave cycles");
+        for (const NodeEstimate& node : nodes)
+        {
+            printf("  %-20s %10llu %10llu %10llu %7.1f%% %12.0f\n", node.name.c_str(),
+                static_cast<unsigned long long>(node.records), static_cast<unsigned long long>(node.groups),
+                static_cast<unsigned long long>(node.waves), node.GetLaneUtilization() * 100.0, node.waveCycles);
+        }
+
+        printf("  %-20s %10s %10s %12s %10s %10s  %s\n", "level", "waves", "occupancy", "queued bytes", "primitives", "cycles", "limiter");
+        for (size_t level = 0; level < levels.size(); ++level)
+        {
+            const LevelEstimate& l = levels[level];
+            printf("  %-20zu %10llu %9.1f%% %12llu %10llu %10.0f  %s\n", level,
+                static_cast<unsigned long long>(l.waves), l.occupancy * 100.0, static_cast<unsigned long long>(l.queuedBytes),
+                static_cast<unsigned long long>(l.primitives), l.cycles, l.limiter);
+        }
+    }
+
+    Estimate Model::Evaluate(const std::string& name, const std::vector<NodeWorkload>& workload) const
+    {
+        Estimate estimate;
+        estimate.name = name;
+
+        size_t levelCount = 0;
+        for (const NodeWorkload& node : workload)
+        {
+            levelCount = std::max(levelCount, node.recordsPerLevel.size());
+        }
+
+        estimate.levels.resize(levelCount);
+        std::vector<double> maxWaveCycles(levelCount, 0.0);
+        std::vector<double> levelWaveCycles(levelCount, 0.0);
+
+        for (const NodeWorkload& node : workload)
+        {
+            NodeEstimate nodeEstimate;
+            nodeEstimate.name = node.name;
+
+            const uint64_t wavesPerGroup = DivideRoundUp(node.threadsPerGroup, desc_.waveSize);
+            // Mesh output is exported by all waves of a group together
+            const double exportCyclesPerWave = desc_.exportCycles * (node.verticesPerGroup + node.primitivesPerGroup) / wavesPerGroup;
+            const double baseCyclesPerWave   = desc_.waveLaunchCycles + node.cyclesPerThread + exportCyclesPerWave;
+
+            for (size_t level = 0; level < node.recordsPerLevel.size(); ++level)
+            {
+                const uint64_t records = node.recordsPerLevel[level];
+                if (records == 0)
+                {
+                    continue;
+                }
+
+                uint64_t groups      = 0;
+                uint64_t waves       = 0;
+                uint64_t activeLanes = 0;
+                // With thread launch, every thread of a wave allocates its own outputs
+                double   allocationsPerWave = static_cast<double>(node.allocationsPerGroup) / wavesPerGroup;
+                switch (node.launch) {
+                    case LaunchMode::Thread:
+                        // Threads of independent records are packed into full waves
+                        groups      = records;
+                        waves       = DivideRoundUp(records, desc_.waveSize);
+                        activeLanes = records * node.activeThreadsPerGroup;
+                        allocationsPerWave = static_cast<double>(node.allocationsPerGroup) * std::min<uint64_t>(records, desc_.waveSize);
+                        break;
+                    case LaunchMode::Coalescing:
+                        groups      = DivideRoundUp(records, node.recordsPerGroup);
+                        waves       = groups * wavesPerGroup;
+                        // The last group may not receive all of its records
+                        activeLanes = DivideRoundUp(records * node.activeThreadsPerGroup, node.recordsPerGroup);
+                        break;
+                    case LaunchMode::Broadcasting:
+                    case LaunchMode::Mesh:
+                        groups      = records * node.groupsPerRecord;
+                        waves       = groups * wavesPerGroup;
+                        activeLanes = groups * node.activeThreadsPerGroup;
+                        break;
+                }
+
+                const uint64_t primitives    = groups * node.primitivesPerGroup;
+                const double   cyclesPerWave = baseCyclesPerWave + allocationsPerWave * desc_.allocationCycles;
+
+                nodeEstimate.records     += records;
+                nodeEstimate.groups      += groups;
+                nodeEstimate.waves       += waves;
+                nodeEstimate.lanes       += waves * desc_.waveSize;
+                nodeEstimate.activeLanes += activeLanes;
+                nodeEstimate.primitives  += primitives;
+                nodeEstimate.waveCycles  += waves * cyclesPerWave;
+
+                LevelEstimate& levelEstimate = estimate.levels[level];
+                levelEstimate.waves       += waves;
+                levelEstimate.queuedBytes += records * node.inputRecordBytes;
+                levelEstimate.primitives  += primitives;
+                levelWaveCycles[level]    += waves * cyclesPerWave;
+                maxWaveCycles[level]       = std::max(maxWaveCycles[level], cyclesPerWave);
+            }
+
+            estimate.nodes.push_back(nodeEstimate);
+        }
+
+        const double waveSlots = static_cast<double>(desc_.computeUnits) * desc_.wavesPerUnit;
+        for (size_t level = 0; level < levelCount; ++level)
+        {
+            LevelEstimate& l = estimate.levels[level];
+            l.occupancy = std::min(l.waves / waveSlots, 1.0);
+
+            // The level takes as long as its most limiting resource, after the records of the previous level are available
+            const struct { const char* name; double cycles; } limits[] = {
+                { "latency", maxWaveCycles[level] },
+                { "waves",   levelWaveCycles[level] / waveSlots },
+                // Records are written by the previous level and read by this level
+                { "records", 2.0 * l.queuedBytes / desc_.recordBytesPerCycle },
+                { "raster",  l.primitives / desc_.primitivesPerCycle },
+            };
+
+            double limit = 0.0;
+            for (const auto& candidate : limits)
+            {
+                if (candidate.cycles > limit)
+                {
+                    limit     = candidate.cycles;
+                    l.limiter = candidate.name;
+                }
+            }
+
+            l.cycles = desc_.levelLatencyCycles + limit;
+            estimate.totalCycles    += l.cycles;
+            estimate.peakQueuedBytes = std::max(estimate.peakQueuedBytes, l.queuedBytes);
+        }
+
+        return estimate;
+    }
+
+    std::vector<NodeWorkload> GetSampleWorkload(uint32_t depth, uint32_t expansionLevels)
+    {
+        // Entry node at level 0, expanding SnowflakeNode invocations of recursion r at level r + 1,
+        // followed by the leaf invocations drawing the lines.
+        // Draw records are consumed one level after they are emitted.
+        expansionLevels = std::max(expansionLevels, 1u);
+        const uint32_t recursionDepth = (depth + expansionLevels - 1) / expansionLevels;
+        const size_t   levelCount     = recursionDepth + 3;
+
+        NodeWorkload entry;
+        entry.name                = "EntryNode";
+        entry.launch              = LaunchMode::Thread;
+        entry.cyclesPerThread     = 30.0;
+        entry.allocationsPerGroup = 2;
+        entry.recordsPerLevel.assign(levelCount, 0);
+        entry.recordsPerLevel[0] = 1;
+
+        // The cost of an expanding invocation grows with the number of records it writes
+        const uint64_t maxChildren  = uint64_t(1) << (2 * std::min(expansionLevels, std::max(depth, 1u)));
+        const uint64_t maxTriangles = (maxChildren - 1) / 3;
+
+        NodeWorkload snowflake;
+        snowflake.name                = "SnowflakeNode";
+        snowflake.launch              = LaunchMode::Thread;
+        snowflake.cyclesPerThread     = 16.0 * (maxChildren + maxTriangles);
+        snowflake.allocationsPerGroup = 3;
+        snowflake.inputRecordBytes    = 16;
+        snowflake.recordsPerLevel.assign(levelCount, 0);
+
+        // Same node, but the invocations at the end of each recursion chain only forward their record to LineMeshNode
+        NodeWorkload leaf = snowflake;
+        leaf.name            = "SnowflakeNode leaf";
+        leaf.cyclesPerThread = 16.0;
+
+        NodeWorkload triangle;
+        triangle.name                  = "TriangleMeshNode";
+        triangle.launch                = LaunchMode::Mesh;
+        triangle.threadsPerGroup       = 3;
+        triangle.activeThreadsPerGroup = 3;
+        triangle.cyclesPerThread       = 20.0;
+        triangle.inputRecordBytes      = 28;
+        triangle.verticesPerGroup      = 3;
+        triangle.primitivesPerGroup    = 1;
+        triangle.recordsPerLevel.assign(levelCount, 0);
+        triangle.recordsPerLevel[1] = 1;
+
+        NodeWorkload line;
+        line.name                  = "LineMeshNode";
+        line.launch                = LaunchMode::Mesh;
+        line.threadsPerGroup       = 32;
+        // 6 threads write a vertex, the first 4 of them also a primitive
+        line.activeThreadsPerGroup = 6;
+        line.cyclesPerThread       = 60.0;
+        line.inputRecordBytes      = 16;
+        line.verticesPerGroup      = 6;
+        line.primitivesPerGroup    = 4;
+        line.recordsPerLevel.assign(levelCount, 0);
+
+        uint64_t records = 3;
+        for (uint32_t recursion = 0; recursion < recursionDepth; ++recursion)
+        {
+            const uint32_t iterations = std::min(expansionLevels, depth - recursion * expansionLevels);
+            const uint64_t children   = uint64_t(1) << (2 * iterations);
+
+            snowflake.recordsPerLevel[recursion + 1] = records;
+            triangle.recordsPerLevel[recursion + 2]  = records * ((children - 1) / 3);
+            records *= children;
+        }
+        leaf.recordsPerLevel[recursionDepth + 1] = records;
+        line.recordsPerLevel[recursionDepth + 2] = records;
+
+        return { entry, snowflake, leaf, triangle, line };
+    }
+
+    NodeWorkload* FindNode(std::vector<NodeWorkload>& workload, const std::string& name)
+    {
+        for (NodeWorkload& node : workload)
+        {
+            if (node.name == name)
+            {
+                return &node;
+            }
+        }
+        return nullptr;
+    }
+
+    void PrintComparison(const std::vector<Estimate>& estimates)
+    {
+        if (estimates.empty())
+        {
+            return;
+        }
+
+        printf("%-32s %14s %10s %10s %10s %14s\n", "variant", "cycles", "relative", "waves", "lanes", "peak queue");
+        for (const Estimate& estimate : estimates)
+        {
+            uint64_t waves = 0;
+            for (const NodeEstimate& node : estimate.nodes)
+            {
+                waves += node.waves;
+            }
+
+            printf("%-32s %14.0f %9.2fx %10llu %9.1f%% %14llu\n", estimate.name.c_str(), estimate.totalCycles,
+                estimate.totalCycles / estimates.front().totalCycles, static_cast<unsigned long long>(waves),
+                estimate.GetLaneUtilization() * 100.0, static_cast<unsigned long long>(estimate.peakQueuedBytes));
+        }
+    }
+}
@@ -0,0 +1,167 @@
+/**********************************************************************
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+#pragma once
+
+// Analytical model of the cost of a work graph on a GPU.
+// Nodes are described by their declared launch mode, group size and per-thread work, together with the
+// number of records they receive at each dependency level of the graph. The model estimates wave
+// occupancy, lane utilization and record queue pressure per level and a total cost in GPU cycles.
+// The absolute numbers are only rough estimates, the model is meant to rank topology changes
+// (e.g. batching or fusing nodes) by their relative cost before measuring them on a GPU.
+// This file does not depend on D3D12 or Windows headers.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace perf {
+    // Parameters of the modeled GPU. The defaults roughly correspond to a mid-range desktop GPU.
+    struct GpuDesc
+    {
+        uint32_t waveSize          = 32;
+        uint32_t computeUnits      = 40;
+        // Waves resident per compute unit at the same time
+        uint32_t wavesPerUnit      = 16;
+
+        // Fixed cost of launching a wave, including fetching its input records
+        double waveLaunchCycles    = 150.0;
+        // Cost of exporting a vertex or primitive from a mesh shader wave
+        double exportCycles        = 4.0;
+        // Cost of an output record allocation (Get*NodeOutputRecords), which are serialized within a wave
+        double allocationCycles    = 8.0;
+        // Bytes of records written or read per cycle across the whole GPU
+        double recordBytesPerCycle = 256.0;
+        // Primitives set up by the rasterizer per cycle across the whole GPU
+        double primitivesPerCycle  = 4.0;
+        // Latency until records of one level can be consumed by the next level
+        double levelLatencyCycles  = 1000.0;
+    };
+
+    enum class LaunchMode
+    {
+        // One thread per record, threads of different records are packed into waves
+        Thread,
+        // One thread group per record (or dispatch grid entry)
+        Broadcasting,
+        // One thread group for up to recordsPerGroup records
+        Coalescing,
+        // One mesh shader group per record
+        Mesh
+    };
+
+    const char* GetLaunchModeName(LaunchMode mode);
+
+    // Workload of a single node as declared in the shader
+    struct NodeWorkload
+    {
+        std::string name;
+        LaunchMode  launch = LaunchMode::Thread;
+
+        // [NumThreads(...)], 1 for thread launch
+        uint32_t threadsPerGroup       = 1;
+        // Threads of a group doing useful work, e.g. writing a vertex
+        uint32_t activeThreadsPerGroup = 1;
+        // Input records per group, only used for coalescing launch
+        uint32_t recordsPerGroup       = 1;
+        // Estimated ALU cost of a thread
+        double   cyclesPerThread       = 0.0;
+        // Output record allocations per group, or per thread with thread launch
+        uint32_t allocationsPerGroup   = 0;
+
+        uint32_t inputRecordBytes      = 0;
+        // Mesh shader output per group
+        uint32_t verticesPerGroup      = 0;
+        uint32_t primitivesPerGroup    = 0;
+        // Groups launched by a record of a broadcasting or mesh node, the SV_DispatchGrid of the record
+        uint32_t groupsPerRecord       = 1;
+
+        // Input records of the node at each dependency level of the graph
+        std::vector<uint64_t> recordsPerLevel;
+    };
+
+    struct NodeEstimate
+    {
+        std::string name;
+        uint64_t records     = 0;
+        uint64_t groups      = 0;
+        uint64_t waves       = 0;
+        // Lanes of all launched waves and lanes doing useful work
+        uint64_t lanes       = 0;
+        uint64_t activeLanes = 0;
+        uint64_t primitives  = 0;
+        double   waveCycles  = 0.0;
+
+        double GetLaneUtilization() const { return lanes ? static_cast<double>(activeLanes) / lanes : 0.0; }
+    };
+
+    struct LevelEstimate
+    {
+        uint64_t waves       = 0;
+        // Fraction of the wave slots of the GPU filled by the level
+        double   occupancy   = 0.0;
+        // Bytes of input records queued for the level
+        uint64_t queuedBytes = 0;
+        uint64_t primitives  = 0;
+        double   cycles      = 0.0;
+        // Resource limiting the level: "latency", "waves", "records" or "raster"
+        const char* limiter  = "";
+    };
+
+    struct Estimate
+    {
+        std::string name;
+        std::vector<NodeEstimate>  nodes;
+        std::vector<LevelEstimate> levels;
+        double   totalCycles     = 0.0;
+        uint64_t peakQueuedBytes = 0;
+
+        double GetLaneUtilization() const;
+
+        // Prints a table per node and per level
+        void Print() const;
+    };
+
+    class Model
+    {
+    public:
+        explicit Model(const GpuDesc& desc = GpuDesc()) : desc_(desc) {}
+
+        // Levels run one after another, the nodes within a level run concurrently
+        Estimate Evaluate(const std::string& name, const std::vector<NodeWorkload>& workload) const;
+
+        const GpuDesc& GetDesc() const { return desc_; }
+
+    private:
+        GpuDesc desc_;
+    };
+
+    // Workload of the graph in ShaderSource.h with the given number of Koch iterations,
+    // expanding expansionLevels iterations per SnowflakeNode invocation (SNOWFLAKE_EXPANSION_LEVELS)
+    std::vector<NodeWorkload> GetSampleWorkload(uint32_t depth, uint32_t expansionLevels = 1);
+
+    // Returns the node with the given name, or nullptr
+    NodeWorkload* FindNode(std::vector<NodeWorkload>& workload, const std::string& name);
+
+    // Prints the estimates next to each other, with the cost relative to the first estimate
+    void PrintComparison(const std::vector<Estimate>& estimates);
+}
@@ -25,23 +25,171 @@ THE SOFTWARE.
 
 #include <algorithm>
 
-#define ERROR_QUIT(value, ...) if(!(value)) { printf("ERROR: "); printf(__VA_ARGS__); printf("\nPress any key to terminate...\n"); _getch(); throw 0; }
+#define ERROR_QUIT(value, ...) if(!(value)) { printf("ERROR: "); printf(__VA_ARGS__); printf("\n"); if (d3d12::sWaitForKeyOnError) { printf("Press any key to terminate...\n"); _getch(); } throw 0; }
+
+const char* GetUnsupportedVariantReason(const Settings& settings)
+{
+    // Variants which replace the SnowflakeNode with thread launch and one Koch iteration per invocation
+    const bool threadLaunchSnowflakeNode = (settings.snowflakeGroupSize == 0) && (settings.expansionLevels == 1);
+
+    if (settings.snowflakeGroupSize > shader::MaxSnowflakeGroupSize)
+    {
+        return "The coalescing SnowflakeNode supports at most shader::MaxSnowflakeGroupSize records per group, as a thread group outputs at most 256 records.";
+    }
+    if ((settings.expansionLevels < 1) || (settings.expansionLevels > shader::MaxSnowflakeExpansionLevels))
+    {
+        return "Multi-level expansion supports 1 to shader::MaxSnowflakeExpansionLevels Koch iterations per invocation, as a thread outputs at most 256 records.";
+    }
+    if ((settings.snowflakeGroupSize > 0) && (settings.expansionLevels > 1))
+    {
+        return "The coalescing SnowflakeNode cannot be combined with multi-level expansion.";
+    }
+    if (settings.triangleBatchSize > shader::MaxTriangleBatchSize)
+    {
+        return "Triangle batches are limited to shader::MaxTriangleBatchSize triangles, as mesh shaders output at most 256 vertices.";
+    }
+    if (settings.lineStrips && !threadLaunchSnowflakeNode)
+    {
+        return "Line strips are only supported with the thread launch SnowflakeNode.";
+    }
+    if (settings.lineDispatchGrid && (!threadLaunchSnowflakeNode || settings.lineStrips || settings.compactRecords || settings.meshNodeArray || (settings.triangleBatchSize > 0)))
+    {
+        return "Line dispatch grids are only supported with the thread launch SnowflakeNode, and replace triangle batches.";
+    }
+    if (settings.compactRecords && (!threadLaunchSnowflakeNode || settings.lineStrips || (settings.triangleBatchSize > 0)))
+    {
+        return "Compact records are only supported with the thread launch SnowflakeNode.";
+    }
+    if (settings.meshNodeArray && (!threadLaunchSnowflakeNode || settings.lineStrips || (settings.triangleBatchSize > 0) || settings.compactRecords))
+    {
+        return "The mesh node array is only supported with the thread launch SnowflakeNode.";
+    }
+    if (settings.unrolledChain && (!threadLaunchSnowflakeNode || settings.lineStrips || settings.lineDispatchGrid || settings.meshNodeArray))
+    {
+        return "The unrolled SnowflakeNode chain is only supported with the thread launch SnowflakeNode.";
+    }
+    return nullptr;
+}
+
+std::vector<DxcDefine> ShaderVariant::GetDxcDefines() const
+{
+    std::vector<DxcDefine> dxcDefines;
+    for (const auto& define : defines)
+    {
+        dxcDefines.push_back({ define.first.c_str(), define.second.c_str() });
+    }
+    return dxcDefines;
+}
+
+ShaderVariant GetShaderVariant(const Settings& settings)
+{
+    ShaderVariant variant;
+    variant.source = shader::workGraphSource;
+
+    // Recursion depth is shared with the CPU executor
+    variant.defines.push_back({ L"MAX_SNOWFLAKE_RECURSIONS", std::to_wstring(shader::MaxSnowflakeRecursions) });
+    if (settings.snowflakeGroupSize > 0)
+    {
+        variant.defines.push_back({ L"SNOWFLAKE_COALESCING", std::to_wstring(settings.snowflakeGroupSize) });
+    }
+    variant.defines.push_back({ L"SNOWFLAKE_EXPANSION_LEVELS", std::to_wstring(settings.expansionLevels) });
+    if (settings.triangleBatchSize > 0)
+    {
+        variant.defines.push_back({ L"TRIANGLE_BATCH_SIZE", std::to_wstring(settings.triangleBatchSize) });
+    }
+    if (settings.lineStrips)
+    {
+        variant.defines.push_back({ L"LINE_STRIP", L"1" });
+    }
+    if (settings.lineDispatchGrid)
+    {
+        variant.defines.push_back({ L"LINE_DISPATCH_GRID", L"1" });
+    }
+    if (settings.compactRecords)
+    {
+        variant.defines.push_back({ L"COMPACT_RECORDS", L"1" });
+    }
+    if (settings.meshNodeArray)
+    {
+        variant.defines.push_back({ L"MESH_NODE_ARRAY", L"1" });
+    }
+    if (settings.meshNodeCulling)
+    {
+        // The viewport always covers the whole window
+        variant.defines.push_back({ L"MESH_NODE_CULLING", std::to_wstring(WindowSize) });
+        variant.defines.push_back({ L"CULL_MIN_PIXEL_AREA", std::to_wstring(settings.cullMinPixelArea) });
+    }
+    if (settings.unrolledChain)
+    {
+        variant.defines.push_back({ L"SNOWFLAKE_UNROLLED", L"1" });
+        variant.source += shader::GenerateUnrolledSnowflakeChain(shader::MaxSnowflakeRecursions);
+    }
+    if (settings.nodeCounters)
+    {
+        variant.defines.push_back({ L"NODE_COUNTERS", L"1" });
+    }
+    return variant;
+}
+
+cpu::ExecutorDesc GetExecutorDesc(const Settings& settings)
+{
+    cpu::ExecutorDesc desc = {};
+    desc.snowflakeGroupSize = settings.snowflakeGroupSize;
+    desc.expansionLevels    = settings.expansionLevels;
+    // Line dispatch grids use the records of line strips
+    desc.lineStrips         = settings.lineStrips || settings.lineDispatchGrid;
+    desc.compactRecords     = settings.compactRecords;
+    desc.meshNodeArray      = settings.meshNodeArray;
+    desc.unrolledChain      = settings.unrolledChain;
+    return desc;
+}
 
 void HelloMeshNodes::Initialize(HWND hwnd)
 {
-    EnableExperimentalFeatures();
+    profiling::ScopedZone zone("HelloMeshNodes::Initialize");
+
+    {
+        profiling::ScopedZone experimentalFeaturesZone("EnableExperimentalFeatures");
+        EnableExperimentalFeatures();
+    }
 
-    InitializeDirectX(hwnd);
+    {
+        profiling::ScopedZone directXZone("InitializeDirectX");
+        InitializeDirectX(hwnd);
+    }
 
     CheckWorkGraphMeshNodeSupport();
 
+    const char* unsupportedVariant = GetUnsupportedVariantReason(settings_);
+    ERROR_QUIT(!unsupportedVariant, "%s", unsupportedVariant);
+
+    const ShaderVariant shaderVariant = GetShaderVariant(settings_);
+    const std::vector<DxcDefine> defines = shaderVariant.GetDxcDefines();
+    const std::string& workGraphSource = shaderVariant.source;
+
+    if (settings_.nodeCounters)
+    {
+        InitializeNodeCounters();
+    }
+    if (!settings_.framePathPrefix.empty())
+    {
+        InitializeFrameReadback();
+    }
+
     // Compile shader libraries with meta data
-    workGraphLibrary_ = d3d12::CompileShader(shader::workGraphSource, nullptr, L"lib_6_9");
+    workGraphLibrary_ = d3d12::CompileShader(workGraphSource, nullptr, L"lib_6_9", defines);
     // Compile pixel shader separately
-    pixelShaderLibrary_ = d3d12::CompileShader(shader::workGraphSource, L"MeshNodePixelShader", L"ps_6_9");
+    pixelShaderLibrary_ = d3d12::CompileShader(workGraphSource, L"MeshNodePixelShader", L"ps_6_9", defines);
+
+    {
+        profiling::ScopedZone stateObjectZone("CreateGWGStateObject");
+        stateObject_ = CreateGWGStateObject();
+    }
 
-    stateObject_ = CreateGWGStateObject();
-    setProgramDesc_ = PrepareWorkGraph(stateObject_);
+    {
+        profiling::ScopedZone prepareZone("PrepareWorkGraph");
+        setProgramDesc_ = PrepareWorkGraph(stateObject_);
+    }
 }
 
 void HelloMeshNodes::EnableExperimentalFeatures()
@@ -121,60 +269,78 @@ ID3D12StateObject* HelloMeshNodes::CreateGWGStateObject()
     renderTargetFormatSubobject->SetNumRenderTargets(1);
     renderTargetFormatSubobject->SetRenderTargetFormat(0, renderTargets_[0]->GetDesc().Format);
 
-    // Next we'll create two generic program subobject for our two mesh nodes.
-
-    // LineMeshNode
+    // Next we'll create a generic program subobject for each of our mesh nodes.
+    struct MeshNodeProgram
+    {
+        // Name of the mesh shader in the shader library
+        const wchar_t* meshShader;
+        // Unique name of the generic program, which is required to rename the mesh node created with it
+        const wchar_t* programName;
+        // Name and array index of the mesh node, or no name to keep the [NodeId(...)] attribute of the mesh shader
+        D3D12_NODE_ID  nodeId;
+    };
+
+    const wchar_t* lineMeshShader = settings_.lineStrips ? L"LineStripMeshShader" : L"LineMeshShader";
+    std::vector<MeshNodeProgram> meshNodePrograms;
+    if (settings_.meshNodeArray)
+    {
+        // With MESH_NODE_ARRAY, both mesh nodes are entries of the "MeshNodes" node array.
+        // The rest of the work graph addresses them by their array index.
+        meshNodePrograms.push_back({ L"TriangleMeshShader", L"TriangleMeshNodeGenericProgram", { L"MeshNodes", shader::TriangleMeshNodeIndex } });
+        meshNodePrograms.push_back({ lineMeshShader, L"LineMeshNodeGenericProgram", { L"MeshNodes", shader::LineMeshNodeIndex } });
+    }
+    else
     {
         // The line mesh shader defines the [NodeId(...)] attribute, and thus a generic program that references it
         // will be automatically turned into a work graph mesh node.
+        meshNodePrograms.push_back({ lineMeshShader, L"LineMeshNodeGenericProgram", { nullptr, 0 } });
+
+        if ((settings_.triangleBatchSize > 0) || settings_.lineDispatchGrid)
+        {
+            // With TRIANGLE_BATCH_SIZE or LINE_DISPATCH_GRID, "TriangleMeshNode" is the coalescing TriangleBatchNode of the library
+            // and the batched mesh shader defines its [NodeId(...)], like the line mesh shader.
+            meshNodePrograms.push_back({ L"TriangleBatchMeshShader", L"TriangleBatchMeshNodeGenericProgram", { nullptr, 0 } });
+        }
+        else
+        {
+            // The triangle mesh shader does not define a [NodeId(...)] attribute,
+            // thus the generic program that we create with it would take the name "TriangleMeshShader".
+            // Here we'll rename it to "TriangleMeshNode", which is how other nodes in the graph reference it.
+            meshNodePrograms.push_back({ L"TriangleMeshShader", L"TriangleMeshNodeGenericProgram", { L"TriangleMeshNode", 0 } });
+        }
+    }
 
-        auto lineProgramSubobject = stateObjectDesc.CreateSubobject<CD3DX12_GENERIC_PROGRAM_SUBOBJECT>();
+    for (const MeshNodeProgram& meshNodeProgram : meshNodePrograms)
+    {
+        auto programSubobject = stateObjectDesc.CreateSubobject<CD3DX12_GENERIC_PROGRAM_SUBOBJECT>();
+
+        // To later rename the mesh node created with this generic program, we first need to give it a unique name.
+        programSubobject->SetProgramName(meshNodeProgram.programName);
 
         // Add mesh shader to the generic program.
         // The exportName is the name of our mesh shader function in the shader library.
-        lineProgramSubobject->AddExport(L"LineMeshShader");
+        programSubobject->AddExport(meshNodeProgram.meshShader);
         // Add the pixel shader to the generic program.
         // The exportName is the entry point name of our pixel shader.
-        lineProgramSubobject->AddExport(L"MeshNodePixelShader");
+        programSubobject->AddExport(L"MeshNodePixelShader");
 
         // Add "building blocks" to define the graphics PSO state for our mesh node
-        lineProgramSubobject->AddSubobject(*rasterizerSubobject);
-        lineProgramSubobject->AddSubobject(*depthStencilSubobject);
-        lineProgramSubobject->AddSubobject(*depthStencilFormatSubobject);
-        lineProgramSubobject->AddSubobject(*renderTargetFormatSubobject);
-    }
-
-    // TriangleMeshNode
-    {
-        // The triangle mesh shader does not define a [NodeId(...)] attribute,
-        // thus the generic program that we create with it would take the name "TriangleMeshShader".
-        // Here we'll rename it to "TriangleMeshNode", which is how other nodes in the graph reference it.
+        programSubobject->AddSubobject(*rasterizerSubobject);
+        programSubobject->AddSubobject(*depthStencilSubobject);
+        programSubobject->AddSubobject(*depthStencilFormatSubobject);
+        programSubobject->AddSubobject(*renderTargetFormatSubobject);
 
-        auto triangleProgramSubobject = stateObjectDesc.CreateSubobject<CD3DX12_GENERIC_PROGRAM_SUBOBJECT>();
-
-        // To later rename the mesh node created with this generic program, we first need to give it a unique name.
-        const auto genericProgramName = L"TriangleMeshNodeGenericProgram";
-        triangleProgramSubobject->SetProgramName(genericProgramName);
-
-        // Mesh and pixel shader are added in the same way as with the line mesh shader above
-        triangleProgramSubobject->AddExport(L"TriangleMeshShader");
-        triangleProgramSubobject->AddExport(L"MeshNodePixelShader");
-
-        // Same with the "building blocks" for the graphics PSO state
-        triangleProgramSubobject->AddSubobject(*rasterizerSubobject);
-        triangleProgramSubobject->AddSubobject(*depthStencilSubobject);
-        triangleProgramSubobject->AddSubobject(*depthStencilFormatSubobject);
-        triangleProgramSubobject->AddSubobject(*renderTargetFormatSubobject);
-
-        // Next, we need to rename the created mesh node to "TriangleMeshNode".
-        // To do this, we need to create a mesh launch override with the same name as our generic program.
-        auto triangleNodeOverride = workGraphDesc->CreateMeshLaunchNodeOverrides(genericProgramName);
-        // Here we set the name and array index of our mesh node.
-        // This name will be used by the rest of the work graph to send records to our mesh node.
-        // This override will also remove the implicitly created "TriangleMeshShader" mesh node.
-        triangleNodeOverride->NewName({ L"TriangleMeshNode", 0 });
-        // Here we could also override other attributes, such as the node dispatch grid,
-        // but in our case, those attributes are already set in the HLSL source code.
+        if (meshNodeProgram.nodeId.Name)
+        {
+            // To rename the created mesh node, we need to create a mesh launch override with the same name as our generic program.
+            auto nodeOverride = workGraphDesc->CreateMeshLaunchNodeOverrides(meshNodeProgram.programName);
+            // Here we set the name and array index of our mesh node.
+            // This name will be used by the rest of the work graph to send records to our mesh node.
+            // This override will also remove the implicitly created mesh node named after the mesh shader or its [NodeId(...)].
+            nodeOverride->NewName(meshNodeProgram.nodeId);
+            // Here we could also override other attributes, such as the node dispatch grid,
+            // but in our case, those attributes are already set in the HLSL source code.
+        }
     }
 
     HRESULT hr = device_->CreateStateObject(stateObjectDesc, IID_PPV_ARGS(&stateObject));
@@ -204,6 +370,18 @@ D3D12_SET_PROGRAM_DESC HelloMeshNodes::PrepareWorkGraph(CComPtr<ID3D12StateObjec
 
     D3D12_WORK_GRAPH_MEMORY_REQUIREMENTS memoryRequirements = {};
     workGraphProperties->GetWorkGraphMemoryRequirements(workGraphIndex, &memoryRequirements);
+
+    if (settings_.memoryReport)
+    {
+        // Compare the backing memory requirements for a single input record against the records the graph actually has in flight.
+        // The executor runs the variant of the compiled graph, as the record sizes and output allocations depend on it.
+        cpu::Executor executor(GetExecutorDesc(settings_));
+        cpu::GraphOutput output;
+        executor.Run(output);
+
+        printf("Record high-water marks of the CPU executor with a single input record:\n");
+        cpu::PrintHighWaterMarks(executor.GetHighWaterMarks(), memoryRequirements.MinSizeInBytes, memoryRequirements.MaxSizeInBytes);
+    }
     if (memoryRequirements.MaxSizeInBytes > 0)
     {
         backingMemoryResource = d3d12::AllocateBuffer(device_, memoryRequirements.MaxSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_HEAP_TYPE_DEFAULT);
@@ -221,17 +399,166 @@ D3D12_SET_PROGRAM_DESC HelloMeshNodes::PrepareWorkGraph(CComPtr<ID3D12StateObjec
     return setProgramDesc;
 }
 
+void HelloMeshNodes::InitializeNodeCounters()
+{
+    constexpr UINT64 counterBufferSize = cpu::CounterCount * sizeof(UINT);
+
+    nodeCounterBuffer_.Attach(d3d12::AllocateBuffer(device_, counterBufferSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_HEAP_TYPE_DEFAULT));
+    nodeCounterResetBuffer_.Attach(d3d12::AllocateBuffer(device_, counterBufferSize, D3D12_RESOURCE_FLAG_NONE, D3D12_HEAP_TYPE_UPLOAD));
+    nodeCounterReadbackBuffer_.Attach(d3d12::AllocateBuffer(device_, counterBufferSize, D3D12_RESOURCE_FLAG_NONE, D3D12_HEAP_TYPE_READBACK));
+
+    // Counters are reset every frame by copying from this zero-filled buffer
+    void* resetData = nullptr;
+    HRESULT hr = nodeCounterResetBuffer_->Map(0, nullptr, &resetData);
+    ERROR_QUIT(SUCCEEDED(hr), "Failed to map node counter reset buffer.");
+    memset(resetData, 0, counterBufferSize);
+    nodeCounterResetBuffer_->Unmap(0, nullptr);
+
+    // The CPU executor has to match the closed-form expectation before we compare it against the GPU
+    // Line dispatch grids use the records of line strips
+    const bool lineStripRecords = settings_.lineStrips || settings_.lineDispatchGrid;
+    const cpu::NodeCounters closedFormCounters = cpu::ExpectedNodeCounters(shader::MaxSnowflakeRecursions, settings_.expansionLevels, lineStripRecords);
+
+    cpu::Executor executor(GetExecutorDesc(settings_));
+    cpu::GraphOutput output;
+    executor.Run(output);
+
+    printf("Node counters for %u Koch iterations:\n", shader::MaxSnowflakeRecursions);
+    const bool match = cpu::CompareNodeCounters("CPU", executor.GetNodeCounters(), "Closed form", closedFormCounters);
+    ERROR_QUIT(match, "CPU executor node counters do not match the closed-form expectation.");
+
+    // Variants of the graph have to produce the same geometry as the thread launch reference.
+    // Line strips are compared by their lines.
+    if ((settings_.snowflakeGroupSize > 0) || (settings_.expansionLevels > 1) || lineStripRecords || settings_.unrolledChain)
+    {
+        if (settings_.lineDispatchGrid)
+        {
+            const cpu::DispatchGridReport dispatchGrids = cpu::CheckLineDispatchGrids(output);
+            dispatchGrids.Print();
+            ERROR_QUIT(dispatchGrids.IsValid(), "Line records exceed the dispatch grid limits of LineMeshNode.");
+
+            const cpu::DispatchGridReport triangleGrids = cpu::CheckTriangleDispatchGrids(output);
+            triangleGrids.Print();
+            ERROR_QUIT(triangleGrids.IsValid(), "Gathered triangle records exceed the dispatch grid limits of TriangleBatchMeshNode.");
+        }
+
+        output = cpu::ExpandLineStrips(output);
+
+        // With compact records, the variant is compared against compact records of the thread launch node,
+        // the error of the rounding is checked against the full precision records below
+        cpu::ExecutorDesc referenceDesc = {};
+        referenceDesc.expansionLevels = 1;
+        referenceDesc.compactRecords  = settings_.compactRecords;
+        cpu::Executor referenceExecutor(referenceDesc);
+        cpu::GraphOutput referenceOutput;
+        referenceExecutor.Run(referenceOutput);
+        ERROR_QUIT(cpu::HasIdenticalGeometry(output, referenceOutput) || ((settings_.expansionLevels > 1) && cpu::HasEquivalentGeometry(output, referenceOutput)),
+            "SnowflakeNode variant does not produce the geometry of the thread launch node.");
+    }
+
+    // Compact records round the coordinates, thus the geometry can only match the full precision reference within a bound
+    if (settings_.compactRecords)
+    {
+        cpu::ExecutorDesc referenceDesc = {};
+        referenceDesc.compactRecords = false;
+        cpu::Executor referenceExecutor(referenceDesc);
+        cpu::GraphOutput referenceOutput;
+        referenceExecutor.Run(referenceOutput);
+
+        const cpu::CompactRecordError error = cpu::MeasureCompactRecordError(shader::MaxSnowflakeRecursions, referenceOutput, output);
+        error.Print();
+        ERROR_QUIT(error.IsWithinBounds(), "Compact records exceed the error bound of the full precision records.");
+    }
+
+    expectedNodeCounters_ = closedFormCounters;
+}
+
+void HelloMeshNodes::CheckNodeCounters(const profiling::FrameTimings& timings)
+{
+    UINT* gpuCounters = nullptr;
+    const D3D12_RANGE readRange = { 0, cpu::CounterCount * sizeof(UINT) };
+    HRESULT hr = nodeCounterReadbackBuffer_->Map(0, &readRange, reinterpret_cast<void**>(&gpuCounters));
+    ERROR_QUIT(SUCCEEDED(hr), "Failed to map node counter readback buffer.");
+
+    cpu::NodeCounters counters;
+    for (UINT i = 0; i < cpu::CounterCount; ++i)
+    {
+        counters.values[i] = gpuCounters[i];
+    }
+
+    const D3D12_RANGE writeRange = { 0, 0 };
+    nodeCounterReadbackBuffer_->Unmap(0, &writeRange);
+
+    const bool match = std::equal(std::begin(counters.values), std::end(counters.values), std::begin(expectedNodeCounters_.values));
+
+    // Print the full table for the first frame and for every frame with a mismatch
+    if ((timings.frame == 0) || !match)
+    {
+        printf("Node counters of frame %llu:\n", timings.frame);
+        cpu::CompareNodeCounters("GPU", counters, "Expected", expectedNodeCounters_);
+    }
+    // Like the CPU executor check in InitializeNodeCounters, a mismatch is fatal
+    ERROR_QUIT(match, "GPU node counters of frame %llu do not match the CPU executor.", timings.frame);
+
+    // Individual node times are not available on the GPU, thus only the DispatchGraph time is part of the title
+    if ((timings.frame == 0) && !settings_.graphvizPath.empty())
+    {
+        const std::string title = "D3D12 DispatchGraph: " + std::to_string(timings.gpuDispatchGraphMs) + " ms";
+        if (!cpu::WriteGraphviz(settings_.graphvizPath, title.c_str(), GetExecutorDesc(settings_), counters, cpu::NodeTimings{}))
+        {
+            printf("ERROR: Failed to write Graphviz file to %s\n", settings_.graphvizPath.c_str());
+        }
+    }
+}
+
+void HelloMeshNodes::InitializeFrameReadback()
+{
+    // Rows of the readback buffer are aligned to D3D12_TEXTURE_DATA_PITCH_ALIGNMENT
+    const D3D12_RESOURCE_DESC renderTargetDesc = renderTargets_[0]->GetDesc();
+    UINT64 readbackSize = 0;
+    device_->GetCopyableFootprints(&renderTargetDesc, 0, 1, 0, &frameReadbackFootprint_, nullptr, nullptr, &readbackSize);
+    frameReadbackBuffer_.Attach(d3d12::AllocateBuffer(device_, readbackSize, D3D12_RESOURCE_FLAG_NONE, D3D12_HEAP_TYPE_READBACK));
+
+    frameWriter_.reset(new png::FrameWriter(std::thread::hardware_concurrency()));
+}
+
+void HelloMeshNodes::WriteFrame(const profiling::FrameTimings& timings)
+{
+    const D3D12_RANGE readRange = { 0, static_cast<SIZE_T>(frameReadbackFootprint_.Footprint.RowPitch) * WindowSize };
+    uint8_t* pixels = nullptr;
+    HRESULT hr = frameReadbackBuffer_->Map(0, &readRange, reinterpret_cast<void**>(&pixels));
+    ERROR_QUIT(SUCCEEDED(hr), "Failed to map frame readback buffer.");
+
+    // Only copies the frame, it is encoded and written on the writer thread
+    char index[16];
+    snprintf(index, sizeof(index), "%04llu", timings.frame);
+    frameWriter_->Submit(settings_.framePathPrefix + index + ".png", pixels + frameReadbackFootprint_.Offset,
+        WindowSize, WindowSize, frameReadbackFootprint_.Footprint.RowPitch);
+
+    const D3D12_RANGE writeRange = { 0, 0 };
+    frameReadbackBuffer_->Unmap(0, &writeRange);
+}
+
 void HelloMeshNodes::RecordCommandList()
 {
     ID3D12Resource* backbuffer = renderTargets_[frameIndex_].p;
     d3d12::TransitionBarrier(commandList_, backbuffer, D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET);
 
+    if (settings_.nodeCounters)
+    {
+        // Counter buffer is implicitly promoted from common to copy destination
+        commandList_->CopyBufferRegion(nodeCounterBuffer_, 0, nodeCounterResetBuffer_, 0, cpu::CounterCount * sizeof(UINT));
+        d3d12::TransitionBarrier(commandList_, nodeCounterBuffer_, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+    }
+
     // Setup viewport & scissor
     CD3DX12_VIEWPORT viewport(0.f, 0.f, WindowSize, WindowSize);
     CD3DX12_RECT scissorRect(0, 0, WindowSize, WindowSize);
     commandList_->RSSetViewports(1, &viewport);
     commandList_->RSSetScissorRects(1, &scissorRect);
 
+    commandList_->EndQuery(timestampQueryHeap_, D3D12_QUERY_TYPE_TIMESTAMP, TimestampFrameBegin);
+
     // Render view and depth handle
     CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(renderViewDescriptorHeap_->GetCPUDescriptorHandleForHeapStart(), frameIndex_, descriptorSize_);
     CD3DX12_CPU_DESCRIPTOR_HANDLE dsvHandle(depthDescriptorHeap_->GetCPUDescriptorHandleForHeapStart());
@@ -243,6 +570,8 @@ void HelloMeshNodes::RecordCommandList()
     // Clear depth buffer
     commandList_->ClearDepthStencilView(dsvHandle, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
 
+    commandList_->EndQuery(timestampQueryHeap_, D3D12_QUERY_TYPE_TIMESTAMP, TimestampClearEnd);
+
     // Set depth & color render targets
     commandList_->OMSetRenderTargets(1, &rtvHandle, false, &dsvHandle);
 
@@ -258,18 +587,72 @@ void HelloMeshNodes::RecordCommandList()
     dispatchGraphDesc.NodeCPUInput.pRecords = nullptr;
 
     commandList_->SetGraphicsRootSignature(globalRootSignature_);
+    if (settings_.nodeCounters)
+    {
+        commandList_->SetGraphicsRootUnorderedAccessView(0, nodeCounterBuffer_->GetGPUVirtualAddress());
+    }
     commandList_->SetProgram(&setProgramDesc_);
     commandList_->DispatchGraph(&dispatchGraphDesc);
 
-    d3d12::TransitionBarrier(commandList_, backbuffer, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
+    // Timestamps are resolved to the readback buffer and read after the frame has finished (see ReadFrameTimestamps)
+    commandList_->EndQuery(timestampQueryHeap_, D3D12_QUERY_TYPE_TIMESTAMP, TimestampDispatchGraphEnd);
+    commandList_->ResolveQueryData(timestampQueryHeap_, D3D12_QUERY_TYPE_TIMESTAMP, 0, TimestampCount, timestampReadbackBuffer_, 0);
+
+    if (settings_.nodeCounters)
+    {
+        // Node counters are read after the frame has finished (see CheckNodeCounters)
+        d3d12::TransitionBarrier(commandList_, nodeCounterBuffer_, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+        commandList_->CopyBufferRegion(nodeCounterReadbackBuffer_, 0, nodeCounterBuffer_, 0, cpu::CounterCount * sizeof(UINT));
+        d3d12::TransitionBarrier(commandList_, nodeCounterBuffer_, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_COMMON);
+    }
+
+    if (frameReadbackBuffer_)
+    {
+        // Read back after the frame has finished (see WriteFrame)
+        d3d12::TransitionBarrier(commandList_, backbuffer, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_COPY_SOURCE);
+        const CD3DX12_TEXTURE_COPY_LOCATION destination(frameReadbackBuffer_, frameReadbackFootprint_);
+        const CD3DX12_TEXTURE_COPY_LOCATION source(backbuffer, 0);
+        commandList_->CopyTextureRegion(&destination, 0, 0, 0, &source, nullptr);
+        d3d12::TransitionBarrier(commandList_, backbuffer, D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_PRESENT);
+    }
+    else
+    {
+        d3d12::TransitionBarrier(commandList_, backbuffer, D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
+    }
 
     // Only initialize in the first frame. Set flag from Init to None for all other frames.
     setProgramDesc_.WorkGraph.Flags = D3D12_SET_WORK_GRAPH_FLAG_NONE;
 }
 
 namespace d3d12 {
-    ID3DBlob* CompileShader(const std::string& shaderCode, const wchar_t* entryPoint, const wchar_t* targetProfile)
+    ID3DBlob* CompileShader(const std::string& shaderCode, const wchar_t* entryPoint, const wchar_t* targetProfile,
+        const std::vector<DxcDefine>& defines)
+    {
+        std::string errors;
+        ID3DBlob* resultBlob = TryCompileShader(shaderCode, entryPoint, targetProfile, defines, errors);
+
+        ERROR_QUIT(resultBlob, "Failed to compile GWG Library.\n%s", errors.c_str());
+        return resultBlob;
+    }
+
+    ID3DBlob* TryCompileShader(const std::string& shaderCode, const wchar_t* entryPoint, const wchar_t* targetProfile,
+        const std::vector<DxcDefine>& defines, std::string& errors)
     {
+        // Zone name contains the entry point (if any) and the target profile, e.g. "CompileShader MeshNodePixelShader ps_6_9"
+        std::string zoneName = "CompileShader";
+        for (const wchar_t* name : { entryPoint, targetProfile })
+        {
+            if (name)
+            {
+                zoneName += ' ';
+                for (const wchar_t* c = name; *c; ++c)
+                {
+                    zoneName += static_cast<char>(*c);
+                }
+            }
+        }
+        profiling::ScopedZone zone(zoneName);
+
         ID3DBlob* resultBlob = nullptr;
         if (d3d12::sDxCompilerDLL)
         {
@@ -287,7 +670,7 @@ namespace d3d12 {
                 {
                     if (SUCCEEDED(pUtils->CreateBlob(shaderCode.c_str(), static_cast<uint32_t>(shaderCode.length()), 0, &pSource)))
                     {
-                        if (SUCCEEDED(pCompiler->Compile(pSource, nullptr, entryPoint, targetProfile, nullptr, 0, nullptr, 0, nullptr, &pOperationResult)))
+                        if (SUCCEEDED(pCompiler->Compile(pSource, nullptr, entryPoint, targetProfile, nullptr, 0, defines.data(), static_cast<UINT32>(defines.size()), nullptr, &pOperationResult)))
                         {
                             HRESULT hr;
                             pOperationResult->GetStatus(&hr);
@@ -295,13 +678,24 @@ namespace d3d12 {
                             {
                                 pOperationResult->GetResult((IDxcBlob**)&resultBlob);
                             }
+                            else
+                            {
+                                CComPtr<IDxcBlobEncoding> pErrors;
+                                if (SUCCEEDED(pOperationResult->GetErrorBuffer(&pErrors)) && pErrors)
+                                {
+                                    errors.assign(static_cast<const char*>(pErrors->GetBufferPointer()), pErrors->GetBufferSize());
+                                }
+                            }
                         }
                     }
                 }
             }
         }
 
-        ERROR_QUIT(resultBlob, "Failed to compile GWG Library.");
+        if (!resultBlob && errors.empty())
+        {
+            errors = "The DXC compiler is not available.";
+        }
         return resultBlob;
     }
 }
\ No newline at end of file
@@ -31,23 +31,105 @@ THE SOFTWARE.
 #include <dxcapi.h>
 #include <dxgi1_6.h>
 
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CpuWorkGraph.h"
+#include "PngWriter.h"
+#include "Profiling.h"
+
 constexpr UINT WindowSize = 720;
 
 static const wchar_t* kProgramName = L"Hello Mesh Nodes";
 
+// Options of the sample, set from the command line (see main.cpp)
+struct Settings
+{
+    // Use the instrumented work graph, which counts node invocations and emitted records per node
+    // and checks them against the CPU executor and the closed-form expectation.
+    bool nodeCounters = false;
+    // If set, the CPU executor runs the graph once on all hardware threads and writes a Chrome trace of it to this file
+    std::string cpuTracePath;
+    // If set, a Graphviz DOT file of the graph annotated with measured record counts is written to this file.
+    // Counts are measured on the GPU with nodeCounters, otherwise they are taken from the CPU executor.
+    std::string graphvizPath;
+    // Print the record high-water marks of the CPU executor next to the work graph backing memory requirements
+    bool memoryReport = false;
+    // Print a breakdown of the startup phases after the first frame and write it to startup_profile.json
+    bool startupProfile = false;
+    // If set, every frame is read back and written to <prefix>0000.png, ... by a background PNG writer (see PngWriter.h)
+    std::string framePathPrefix;
+    // Records per SnowflakeNode thread group with the coalescing launch variant, 0 for the thread launch node.
+    // Passed to the HLSL source as SNOWFLAKE_COALESCING.
+    uint32_t snowflakeGroupSize = 0;
+    // Koch iterations expanded per SnowflakeNode invocation, passed to the HLSL source as SNOWFLAKE_EXPANSION_LEVELS
+    uint32_t expansionLevels = shader::SnowflakeExpansionLevels;
+    // Triangles per batched triangle mesh node group, 0 to draw one triangle per group.
+    // Passed to the HLSL source as TRIANGLE_BATCH_SIZE.
+    uint32_t triangleBatchSize = shader::TriangleBatchSize;
+    // Draw the lines of the last Koch iteration as strips with shared joint vertices, passed to the HLSL source as LINE_STRIP
+    bool lineStrips = shader::LineStrips;
+    // Send the lines of the last Koch iteration as one record, which launches a LineMeshNode group per line with SV_DispatchGrid,
+    // and gather the triangles into records which launch a group per shader::TriangleGridGroupSize triangles.
+    // Passed to the HLSL source as LINE_DISPATCH_GRID.
+    bool lineDispatchGrid = shader::LineDispatchGrid;
+    // Encode line and triangle records as snorm integers with 8 bytes each, passed to the HLSL source as COMPACT_RECORDS.
+    // Only supported with the thread launch SnowflakeNode, one Koch iteration per invocation and separate lines.
+    bool compactRecords = shader::CompactRecords;
+    // Draw triangles and lines with the entries of one mesh node array, passed to the HLSL source as MESH_NODE_ARRAY.
+    // Only supported with the thread launch SnowflakeNode, one Koch iteration per invocation and full precision records.
+    bool meshNodeArray = shader::MeshNodeArray;
+    // Replace the recursive SnowflakeNode with a generated chain of one node per recursion level, passed to the HLSL source as SNOWFLAKE_UNROLLED.
+    // Only supported with the thread launch SnowflakeNode, one Koch iteration per invocation and separate lines.
+    bool unrolledChain = shader::UnrolledSnowflakeChain;
+    // Cull off-screen primitives and primitives which cover no pixel center in the mesh nodes, passed to the HLSL source as MESH_NODE_CULLING.
+    // Line strips are culled as a whole.
+    bool meshNodeCulling = shader::MeshNodeCulling;
+    // Triangles smaller than this many pixels are culled as well with meshNodeCulling, which can change the image if non-zero.
+    // Passed to the HLSL source as CULL_MIN_PIXEL_AREA.
+    float cullMinPixelArea = shader::CullMinPixelArea;
+};
+
+// Returns why the settings select a combination of work graph variants which is not supported, or nullptr if it is supported.
+// The HLSL source rejects the same combinations with #error.
+const char* GetUnsupportedVariantReason(const Settings& settings);
+
+// Work graph source and preprocessor defines of the variant selected by the settings
+struct ShaderVariant
+{
+    std::string source;
+    // Names and values of the preprocessor defines
+    std::vector<std::pair<std::wstring, std::wstring>> defines;
+
+    // The returned defines point into this variant and must not outlive it
+    std::vector<DxcDefine> GetDxcDefines() const;
+};
+
+ShaderVariant GetShaderVariant(const Settings& settings);
+
+// CPU executor of the variant selected by the settings, on a single thread
+cpu::ExecutorDesc GetExecutorDesc(const Settings& settings);
+
 class HelloMeshNodes
 {
 public:
-    HelloMeshNodes() = default;
+    explicit HelloMeshNodes(const Settings& settings = {}) : settings_(settings) {}
     ~HelloMeshNodes();
-    // Initialize D3D12 and Work graphs objects
+    // Initialize D3D12 and Work graphs objects.
+    // Without a window (hwnd is null), frames are rendered offscreen and not presented.
     void Initialize(HWND hwnd);
     // Record command list, execute the list and present the finished frame
     void Render();
 
+    // CPU and GPU timings of the most recently rendered frames
+    const profiling::FrameTimingRing& GetFrameTimings() const { return frameTimings_; }
+
 private:
     static constexpr UINT FrameCount = 2;
 
+    Settings settings_;
+
     // Pipeline objects
     CComPtr<IDXGISwapChain3> swapChain_;
     CComPtr<ID3D12Device9> device_;
@@ -79,6 +161,31 @@ private:
     CComPtr<ID3D12Fence> fence_;
     UINT64 fenceValue_;
 
+    // Frame timing objects
+    enum TimestampQuery : UINT
+    {
+        TimestampFrameBegin,
+        TimestampClearEnd,
+        TimestampDispatchGraphEnd,
+        TimestampCount
+    };
+    CComPtr<ID3D12QueryHeap> timestampQueryHeap_;
+    CComPtr<ID3D12Resource> timestampReadbackBuffer_;
+    UINT64 timestampFrequency_;
+    UINT64 frameCount_ = 0;
+    profiling::FrameTimingRing frameTimings_{ "d3d12" };
+
+    // Node counter objects, only created with Settings::nodeCounters
+    CComPtr<ID3D12Resource> nodeCounterBuffer_;
+    CComPtr<ID3D12Resource> nodeCounterResetBuffer_;
+    CComPtr<ID3D12Resource> nodeCounterReadbackBuffer_;
+    cpu::NodeCounters expectedNodeCounters_;
+
+    // Frame readback objects, only created with Settings::framePathPrefix
+    CComPtr<ID3D12Resource> frameReadbackBuffer_;
+    D3D12_PLACED_SUBRESOURCE_FOOTPRINT frameReadbackFootprint_;
+    std::unique_ptr<png::FrameWriter> frameWriter_;
+
     // Initializes common DirectX objects
     // - D3D12Device
     // - D3D12CommandQueue
@@ -89,6 +196,7 @@ private:
     // - Depth Buffer
     // - D3D12CommandAllocator
     // - D3D12GraphicsCommandList
+    // - D3D12QueryHeap & readback buffer for frame timestamps
     // - D3D12RootSignature
     void InitializeDirectX(HWND hwnd);
 
@@ -107,17 +215,38 @@ private:
     // - clear render target
     // - clear depth buffer
     // - dispatch work graph
+    // - resolve frame timestamps
+    // - copy the render target to the frame readback buffer
     void RecordCommandList();
 
+    // Reads back the timestamps of the last finished frame and converts them to GPU phase timings
+    void ReadFrameTimestamps(profiling::FrameTimings& timings);
+
+    // Creates the node counter buffers and runs the CPU executor to get the expected counters
+    void InitializeNodeCounters();
+    // Reads back the node counters of the last finished frame and compares them to the expected counters
+    void CheckNodeCounters(const profiling::FrameTimings& timings);
+
+    // Creates the frame readback buffer and the background PNG writer
+    void InitializeFrameReadback();
+    // Queues the last finished frame for the PNG writer, which encodes it while the next frames are rendered
+    void WriteFrame(const profiling::FrameTimings& timings);
+
     // wait for previous frame to finish
     void WaitForPreviousFrame();
 };
 
 namespace d3d12 {
     extern HMODULE sDxCompilerDLL;
+    // ERROR_QUIT waits for a key press before terminating, unless the sample runs without a window
+    extern bool sWaitForKeyOnError;
     void LoadCompiler();	
     // Compiles work graphs library with required meta data
-    ID3DBlob* CompileShader(const std::string& shaderCode, const wchar_t* entryPoint, const wchar_t* targetProfil);
+    ID3DBlob* CompileShader(const std::string& shaderCode, const wchar_t* entryPoint, const wchar_t* targetProfil,
+        const std::vector<DxcDefine>& defines = {});
+    // Same as CompileShader, but returns nullptr and the compiler errors instead of terminating if compilation fails
+    ID3DBlob* TryCompileShader(const std::string& shaderCode, const wchar_t* entryPoint, const wchar_t* targetProfile,
+        const std::vector<DxcDefine>& defines, std::string& errors);
     void ReleaseCompiler();
     
     ID3D12Resource* AllocateBuffer(CComPtr<ID3D12Device9> pDevice, UINT64 Size, D3D12_RESOURCE_FLAGS ResourceFlags, D3D12_HEAP_TYPE HeapType);
@@ -0,0 +1,620 @@
+/**********************************************************************
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+
+#include "PngWriter.h"
+
+#include "Profiling.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace png {
+    namespace {
+        constexpr uint32_t BytesPerPixel = 3;
+
+        // Deflate window and match limits
+        constexpr uint32_t WindowSize     = 32768;
+        constexpr uint32_t MinMatchLength = 3;
+        constexpr uint32_t MaxMatchLength = 258;
+        constexpr uint32_t HashBits       = 15;
+        // Candidates compared per position, rendered frames have long matches which are found quickly
+        constexpr uint32_t MaxChainLength = 32;
+        // Positions inserted into the hash chains at the start and the end of a match
+        constexpr uint32_t MaxInsertLength = 16;
+
+        constexpr uint32_t LengthBase[29]  = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        constexpr uint32_t LengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        constexpr uint32_t DistanceBase[30]  = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537,
+                                                 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+        constexpr uint32_t DistanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+        constexpr uint32_t AdlerModulus = 65521;
+
+        uint32_t ReverseBits(uint32_t code, uint32_t bitCount)
+        {
+            uint32_t reversed = 0;
+            for (uint32_t bit = 0; bit < bitCount; ++bit)
+            {
+                reversed = (reversed << 1) | ((code >> bit) & 1);
+            }
+            return reversed;
+        }
+
+        // Fixed Huffman codes of deflate (RFC 1951, 3.2.6), bit reversed as they are written LSB first,
+        // and the length and distance codes of every length and distance
+        struct FixedCodes
+        {
+            uint16_t literalCode[288];
+            uint8_t  literalBits[288];
+            uint8_t  lengthCode[MaxMatchLength + 1];
+            uint8_t  distanceCode[WindowSize + 1];
+
+            FixedCodes()
+            {
+                for (uint32_t value = 0; value < 288; ++value)
+                {
+                    uint32_t code = 0;
+                    uint32_t bits = 0;
+                    if (value < 144)      { code = 0x30 + value;          bits = 8; }
+                    else if (value < 256) { code = 0x190 + value - 144;   bits = 9; }
+                    else if (value < 280) { code = value - 256;           bits = 7; }
+                    else                  { code = 0xc0 + value - 280;    bits = 8; }
+                    literalCode[value] = static_cast<uint16_t>(ReverseBits(code, bits));
+                    literalBits[value] = static_cast<uint8_t>(bits);
+                }
+
+                for (uint32_t code = 0; code < 29; ++code)
+                {
+                    const uint32_t last = (code == 28) ? MaxMatchLength : LengthBase[code] + (1u << LengthExtra[code]) - 1;
+                    for (uint32_t length = LengthBase[code]; length <= last; ++length)
+                    {
+                        lengthCode[length] = static_cast<uint8_t>(code);
+                    }
+                }
+                // 284 with all extra bits set would be 258, which has its own code
+                lengthCode[MaxMatchLength] = 28;
+
+                for (uint32_t code = 0; code < 30; ++code)
+                {
+                    const uint32_t last = DistanceBase[code] + (1u << DistanceExtra[code]) - 1;
+                    for (uint32_t distance = DistanceBase[code]; distance <= last; ++distance)
+                    {
+                        distanceCode[distance] = static_cast<uint8_t>(code);
+                    }
+                }
+            }
+        };
+
+        const FixedCodes& GetFixedCodes()
+        {
+            static const FixedCodes codes;
+            return codes;
+        }
+
+        struct CrcTable
+        {
+            uint32_t entries[256];
+
+            CrcTable()
+            {
+                for (uint32_t i = 0; i < 256; ++i)
+                {
+                    uint32_t crc = i;
+                    for (uint32_t bit = 0; bit < 8; ++bit)
+                    {
+                        crc = (crc & 1) ? 0xedb88320u ^ (crc >> 1) : crc >> 1;
+                    }
+                    entries[i] = crc;
+                }
+            }
+        };
+
+        uint32_t UpdateCrc(uint32_t crc, const uint8_t* data, size_t size)
+        {
+            static const CrcTable table;
+            for (size_t i = 0; i < size; ++i)
+            {
+                crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+            }
+            return crc;
+        }
+
+        uint32_t ComputeAdler(const uint8_t* data, size_t size)
+        {
+            uint32_t a = 1;
+            uint32_t b = 0;
+            while (size > 0)
+            {
+                // 5552 bytes are the most which cannot overflow b before the modulo
+                const size_t block = std::min<size_t>(size, 5552);
+                for (size_t i = 0; i < block; ++i)
+                {
+                    a += data[i];
+                    b += a;
+                }
+                a %= AdlerModulus;
+                b %= AdlerModulus;
+                data += block;
+                size -= block;
+            }
+            return (b << 16) | a;
+        }
+
+        // Adler-32 of the concatenation of two buffers, from their checksums and the size of the second one
+        uint32_t CombineAdler(uint32_t first, uint32_t second, size_t secondSize)
+        {
+            const uint32_t remainder = static_cast<uint32_t>(secondSize % AdlerModulus);
+            uint32_t a = first & 0xffff;
+            uint32_t b = static_cast<uint32_t>((static_cast<uint64_t>(remainder) * a) % AdlerModulus);
+            a += (second & 0xffff) + AdlerModulus - 1;
+            b += (first >> 16) + (second >> 16) + AdlerModulus - remainder;
+            a %= AdlerModulus;
+            b %= AdlerModulus;
+            return (b << 16) | a;
+        }
+
+        void AppendBigEndian(std::vector<uint8_t>& bytes, uint32_t value)
+        {
+            const uint8_t data[4] = { static_cast<uint8_t>(value >> 24), static_cast<uint8_t>(value >> 16), static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value) };
+            bytes.insert(bytes.end(), data, data + 4);
+        }
+
+        void AppendChunk(std::vector<uint8_t>& png, const char* type, const uint8_t* data, size_t size, uint32_t crc)
+        {
+            AppendBigEndian(png, static_cast<uint32_t>(size));
+            png.insert(png.end(), type, type + 4);
+            png.insert(png.end(), data, data + size);
+            AppendBigEndian(png, crc);
+        }
+
+        uint32_t GetChunkCrc(const char* type, const uint8_t* data, size_t size)
+        {
+            uint32_t crc = UpdateCrc(0xffffffffu, reinterpret_cast<const uint8_t*>(type), 4);
+            return UpdateCrc(crc, data, size) ^ 0xffffffffu;
+        }
+
+        class BitWriter
+        {
+        public:
+            explicit BitWriter(std::vector<uint8_t>& bytes) : bytes_(bytes) {}
+
+            void Write(uint32_t value, uint32_t bitCount)
+            {
+                bits_ |= static_cast<uint64_t>(value) << count_;
+                count_ += bitCount;
+                while (count_ >= 8)
+                {
+                    bytes_.push_back(static_cast<uint8_t>(bits_));
+                    bits_ >>= 8;
+                    count_ -= 8;
+                }
+            }
+
+            void AlignToByte()
+            {
+                if (count_ > 0)
+                {
+                    Write(0, 8 - count_);
+                }
+            }
+
+        private:
+            std::vector<uint8_t>& bytes_;
+            uint64_t bits_  = 0;
+            uint32_t count_ = 0;
+        };
+
+        uint8_t Paeth(uint8_t left, uint8_t up, uint8_t upLeft)
+        {
+            const int estimate = left + up - upLeft;
+            const int distanceLeft   = std::abs(estimate - left);
+            const int distanceUp     = std::abs(estimate - up);
+            const int distanceUpLeft = std::abs(estimate - upLeft);
+            if ((distanceLeft <= distanceUp) && (distanceLeft <= distanceUpLeft))
+            {
+                return left;
+            }
+            return (distanceUp <= distanceUpLeft) ? up : upLeft;
+        }
+
+        void ToRgb(const uint8_t* pixels, uint32_t width, uint8_t* rgb)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                // RGBA8 in memory order, see cpu::PackColor
+                rgb[3 * x + 0] = pixels[4 * x + 0];
+                rgb[3 * x + 1] = pixels[4 * x + 1];
+                rgb[3 * x + 2] = pixels[4 * x + 2];
+            }
+        }
+
+        // Writes the filter type and the filtered row to output, with the filter which minimizes the sum of absolute differences.
+        // previous is all zero for the first row.
+        void FilterRow(const uint8_t* row, const uint8_t* previous, uint32_t rowBytes, std::vector<uint8_t> (&candidates)[5], uint8_t* output)
+        {
+            // Pointers in locals, as stores through uint8_t pointers could otherwise modify the vectors
+            uint8_t* none    = candidates[0].data();
+            uint8_t* sub     = candidates[1].data();
+            uint8_t* up      = candidates[2].data();
+            uint8_t* average = candidates[3].data();
+            uint8_t* paeth   = candidates[4].data();
+
+            // The first pixel has no left neighbors, they are zero
+            for (uint32_t i = 0; i < BytesPerPixel; ++i)
+            {
+                none[i]    = row[i];
+                sub[i]     = row[i];
+                up[i]      = static_cast<uint8_t>(row[i] - previous[i]);
+                average[i] = static_cast<uint8_t>(row[i] - previous[i] / 2);
+                paeth[i]   = static_cast<uint8_t>(row[i] - previous[i]);
+            }
+            for (uint32_t i = BytesPerPixel; i < rowBytes; ++i)
+            {
+                const uint8_t left     = row[i - BytesPerPixel];
+                const uint8_t above    = previous[i];
+                const uint8_t diagonal = previous[i - BytesPerPixel];
+                none[i]    = row[i];
+                sub[i]     = static_cast<uint8_t>(row[i] - left);
+                up[i]      = static_cast<uint8_t>(row[i] - above);
+                average[i] = static_cast<uint8_t>(row[i] - (left + above) / 2);
+                paeth[i]   = static_cast<uint8_t>(row[i] - Paeth(left, above, diagonal));
+            }
+
+            uint32_t bestFilter = 0;
+            uint64_t bestCost   = ~0ull;
+            for (uint32_t filter = 0; filter < 5; ++filter)
+            {
+                const uint8_t* filtered = candidates[filter].data();
+                uint64_t cost = 0;
+                for (uint32_t i = 0; i < rowBytes; ++i)
+                {
+                    cost += std::abs(static_cast<int8_t>(filtered[i]));
+                }
+                if (cost < bestCost)
+                {
+                    bestCost   = cost;
+                    bestFilter = filter;
+                }
+            }
+
+            output[0] = static_cast<uint8_t>(bestFilter);
+            std::memcpy(output + 1, candidates[bestFilter].data(), rowBytes);
+        }
+
+        // Compresses data[begin, end) as one fixed Huffman block. Matches may start before begin, as these bytes precede the strip in the stream.
+        // Unless the strip is the last one, the block is followed by a sync flush, so the next strip starts at a byte boundary.
+        void DeflateStrip(const uint8_t* data, size_t begin, size_t end, bool last, std::vector<uint8_t>& output)
+        {
+            const FixedCodes& codes = GetFixedCodes();
+
+            const size_t dictionaryBegin = (begin > WindowSize) ? begin - WindowSize : 0;
+            // Positions relative to dictionaryBegin, -1 terminates a chain
+            std::vector<int32_t> head(1u << HashBits, -1);
+            std::vector<int32_t> previous(end - dictionaryBegin);
+
+            const auto hash = [&](size_t position) {
+                return ((data[position] << 10) ^ (data[position + 1] << 5) ^ data[position + 2]) & ((1u << HashBits) - 1);
+            };
+            const auto insert = [&](size_t position) {
+                if (position + MinMatchLength <= end)
+                {
+                    const uint32_t key = hash(position);
+                    previous[position - dictionaryBegin] = head[key];
+                    head[key] = static_cast<int32_t>(position - dictionaryBegin);
+                }
+            };
+
+            for (size_t position = dictionaryBegin; position < begin; ++position)
+            {
+                insert(position);
+            }
+
+            BitWriter writer(output);
+            writer.Write(last ? 1 : 0, 1);
+            writer.Write(1, 2);
+
+            size_t position = begin;
+            while (position < end)
+            {
+                const uint32_t maxLength = static_cast<uint32_t>(std::min<size_t>(MaxMatchLength, end - position));
+
+                uint32_t bestLength   = 0;
+                uint32_t bestDistance = 0;
+                if (maxLength >= MinMatchLength)
+                {
+                    int32_t candidate = head[hash(position)];
+                    for (uint32_t chain = 0; (chain < MaxChainLength) && (candidate >= 0); ++chain)
+                    {
+                        const size_t candidatePosition = dictionaryBegin + candidate;
+                        const size_t distance = position - candidatePosition;
+                        if (distance > WindowSize)
+                        {
+                            break;
+                        }
+
+                        uint32_t length = 0;
+                        while ((length < maxLength) && (data[candidatePosition + length] == data[position + length]))
+                        {
+                            ++length;
+                        }
+                        if (length > bestLength)
+                        {
+                            bestLength   = length;
+                            bestDistance = static_cast<uint32_t>(distance);
+                            if (length == maxLength)
+                            {
+                                break;
+                            }
+                        }
+                        candidate = previous[candidate];
+                    }
+                }
+
+                if (bestLength >= MinMatchLength)
+                {
+                    const uint32_t lengthCode = codes.lengthCode[bestLength];
+                    writer.Write(codes.literalCode[257 + lengthCode], codes.literalBits[257 + lengthCode]);
+                    writer.Write(bestLength - LengthBase[lengthCode], LengthExtra[lengthCode]);
+
+                    const uint32_t distanceCode = codes.distanceCode[bestDistance];
+                    writer.Write(ReverseBits(distanceCode, 5), 5);
+                    writer.Write(bestDistance - DistanceBase[distanceCode], DistanceExtra[distanceCode]);
+
+                    // Positions in the middle of long matches are skipped, the ends are enough to continue runs of the same color
+                    for (uint32_t i = 0; i < bestLength; ++i)
+                    {
+                        if ((i < MaxInsertLength) || (i + MaxInsertLength >= bestLength))
+                        {
+                            insert(position + i);
+                        }
+                    }
+                    position += bestLength;
+                }
+                else
+                {
+                    writer.Write(codes.literalCode[data[position]], codes.literalBits[data[position]]);
+                    insert(position);
+                    ++position;
+                }
+            }
+
+            // End of block
+            writer.Write(codes.literalCode[256], codes.literalBits[256]);
+            if (!last)
+            {
+                // Empty stored block
+                writer.Write(0, 3);
+                writer.AlignToByte();
+                const uint8_t storedLength[4] = { 0x00, 0x00, 0xff, 0xff };
+                output.insert(output.end(), storedLength, storedLength + 4);
+            }
+            writer.AlignToByte();
+        }
+    }
+
+    void Encode(const void* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, cpu::WorkerPool& pool,
+        std::vector<uint8_t>& png, uint32_t rowsPerStrip)
+    {
+        const uint8_t* pixelBytes = static_cast<const uint8_t*>(pixels);
+        const uint32_t rowBytes   = width * BytesPerPixel;
+        const size_t   filteredRowBytes = rowBytes + 1;
+        rowsPerStrip = std::max(rowsPerStrip, 1u);
+        const uint32_t stripCount = (height + rowsPerStrip - 1) / rowsPerStrip;
+
+        // Filtering only reads the unfiltered previous row, so all strips are filtered in parallel
+        std::vector<uint8_t> filtered(filteredRowBytes * height);
+        pool.ParallelFor(stripCount, [&](uint32_t strip, uint32_t) {
+            std::vector<uint8_t> candidates[5];
+            for (std::vector<uint8_t>& candidate : candidates)
+            {
+                candidate.resize(rowBytes);
+            }
+            std::vector<uint8_t> row(rowBytes);
+            std::vector<uint8_t> previous(rowBytes, 0);
+
+            const uint32_t firstRow = strip * rowsPerStrip;
+            const uint32_t lastRow  = std::min(firstRow + rowsPerStrip, height);
+            if (firstRow > 0)
+            {
+                ToRgb(pixelBytes + static_cast<size_t>(firstRow - 1) * rowPitch, width, previous.data());
+            }
+            for (uint32_t y = firstRow; y < lastRow; ++y)
+            {
+                ToRgb(pixelBytes + static_cast<size_t>(y) * rowPitch, width, row.data());
+                FilterRow(row.data(), previous.data(), rowBytes, candidates, &filtered[y * filteredRowBytes]);
+                std::swap(row, previous);
+            }
+        });
+
+        // Each strip becomes one IDAT chunk, the first one starts with the zlib header
+        std::vector<std::vector<uint8_t>> chunks(stripCount);
+        std::vector<uint32_t> chunkCrcs(stripCount);
+        std::vector<uint32_t> stripAdlers(stripCount);
+        pool.ParallelFor(stripCount, [&](uint32_t strip, uint32_t) {
+            const size_t begin = strip * rowsPerStrip * filteredRowBytes;
+            const size_t end   = std::min<size_t>((strip + 1) * rowsPerStrip, height) * filteredRowBytes;
+
+            std::vector<uint8_t>& chunk = chunks[strip];
+            chunk.reserve((end - begin) / 4 + 64);
+            if (strip == 0)
+            {
+                // Deflate with a 32 KiB window, no preset dictionary, (0x78 << 8 | 0x01) % 31 == 0
+                chunk.push_back(0x78);
+                chunk.push_back(0x01);
+            }
+            DeflateStrip(filtered.data(), begin, end, strip + 1 == stripCount, chunk);
+
+            chunkCrcs[strip]   = GetChunkCrc("IDAT", chunk.data(), chunk.size());
+            stripAdlers[strip] = ComputeAdler(filtered.data() + begin, end - begin);
+        });
+
+        uint32_t adler = stripAdlers[0];
+        for (uint32_t strip = 1; strip < stripCount; ++strip)
+        {
+            const size_t stripBytes = (std::min((strip + 1) * rowsPerStrip, height) - strip * rowsPerStrip) * filteredRowBytes;
+            adler = CombineAdler(adler, stripAdlers[strip], stripBytes);
+        }
+
+        png.clear();
+        const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        png.insert(png.end(), signature, signature + 8);
+
+        std::vector<uint8_t> header;
+        AppendBigEndian(header, width);
+        AppendBigEndian(header, height);
+        // 8 bit depth, RGB, deflate, adaptive filtering, no interlacing
+        const uint8_t format[5] = { 8, 2, 0, 0, 0 };
+        header.insert(header.end(), format, format + 5);
+        AppendChunk(png, "IHDR", header.data(), header.size(), GetChunkCrc("IHDR", header.data(), header.size()));
+
+        for (uint32_t strip = 0; strip < stripCount; ++strip)
+        {
+            AppendChunk(png, "IDAT", chunks[strip].data(), chunks[strip].size(), chunkCrcs[strip]);
+        }
+
+        // The zlib stream ends with the Adler-32 of the filtered data in its own chunk, as it is only known after all strips
+        std::vector<uint8_t> trailer;
+        AppendBigEndian(trailer, adler);
+        AppendChunk(png, "IDAT", trailer.data(), trailer.size(), GetChunkCrc("IDAT", trailer.data(), trailer.size()));
+        AppendChunk(png, "IEND", nullptr, 0, GetChunkCrc("IEND", nullptr, 0));
+    }
+
+    bool WriteFile(const std::string& path, const std::vector<uint8_t>& data)
+    {
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file)
+        {
+            return false;
+        }
+        const bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+        return (fclose(file) == 0) && written;
+    }
+
+    FrameWriter::FrameWriter(uint32_t threadCount, uint32_t maxQueuedFrames)
+        : pool_(threadCount), maxQueuedFrames_(std::max(maxQueuedFrames, 1u))
+    {
+        thread_ = std::thread(&FrameWriter::WriterLoop, this);
+    }
+
+    FrameWriter::~FrameWriter()
+    {
+        Flush();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            exit_ = true;
+        }
+        queued_.notify_all();
+        thread_.join();
+    }
+
+    void FrameWriter::Submit(const std::string& path, const void* pixels, uint32_t width, uint32_t height, uint32_t rowPitch)
+    {
+        Frame frame;
+        frame.path   = path;
+        frame.width  = width;
+        frame.height = height;
+        {
+            const profiling::CpuTimer stallTimer;
+            std::unique_lock<std::mutex> lock(mutex_);
+            written_.wait(lock, [&] { return queue_.size() < maxQueuedFrames_; });
+            statistics_.submitStallMs += stallTimer.ElapsedMs();
+
+            if (!freeBuffers_.empty())
+            {
+                frame.pixels = std::move(freeBuffers_.back());
+                freeBuffers_.pop_back();
+            }
+        }
+
+        // Rows are copied without the lock, the writer thread does not wait for them
+        frame.pixels.resize(static_cast<size_t>(width) * height);
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            std::memcpy(&frame.pixels[static_cast<size_t>(y) * width], static_cast<const uint8_t*>(pixels) + static_cast<size_t>(y) * rowPitch, width * sizeof(uint32_t));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(std::move(frame));
+        }
+        queued_.notify_one();
+    }
+
+    void FrameWriter::Submit(const std::string& path, const cpu::Image& image)
+    {
+        Submit(path, image.color.data(), image.width, image.height, image.width * sizeof(uint32_t));
+    }
+
+    bool FrameWriter::Flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        written_.wait(lock, [&] { return queue_.empty() && (writing_ == 0); });
+        const bool success = !failed_;
+        failed_ = false;
+        return success;
+    }
+
+    void FrameWriter::WriterLoop()
+    {
+        std::vector<uint8_t> png;
+        for (;;)
+        {
+            Frame frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                queued_.wait(lock, [&] { return exit_ || !queue_.empty(); });
+                if (queue_.empty())
+                {
+                    return;
+                }
+                frame = std::move(queue_.front());
+                queue_.pop_front();
+                ++writing_;
+            }
+            // A queue slot is free
+            written_.notify_all();
+
+            const profiling::CpuTimer encodeTimer;
+            Encode(frame.pixels.data(), frame.width, frame.height, frame.width * sizeof(uint32_t), pool_, png);
+            const bool written = WriteFile(frame.path, png);
+            if (!written)
+            {
+                printf("ERROR: Failed to write %s\n", frame.path.c_str());
+            }
+            const double encodeMs = encodeTimer.ElapsedMs();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                --writing_;
+                failed_ = failed_ || !written;
+                statistics_.frames   += 1;
+                statistics_.bytes    += png.size();
+                statistics_.encodeMs += encodeMs;
+                freeBuffers_.push_back(std::move(frame.pixels));
+            }
+            written_.notify_all();
+        }
+    }
+}
@@ -0,0 +1,114 @@
+/**********************************************************************
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+
+#pragma once
+
+// PNG encoder for rendered frames, which compresses horizontal strips of rows in parallel.
+// This file does not depend on D3D12 and builds on Windows and POSIX systems.
+//
+// Every strip is filtered and deflated on its own and ends with a sync flush (an empty stored block),
+// so the compressed strips are byte aligned and simply follow each other in the zlib stream.
+// Matches may reach back into the previous strips, which are known up front, thus the strips do not
+// lose the 32 KiB window at their start. Each strip is written as its own IDAT chunk, such that its
+// CRC is computed in parallel as well, and the Adler-32 checksums of the strips are combined at the end.
+
+#include "CpuRasterizer.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace png {
+    // Rows per strip, 32 rows of a 720 pixel wide frame are 68 KiB of filtered data
+    constexpr uint32_t DefaultRowsPerStrip = 32;
+
+    // Encodes RGBA8 pixels (see cpu::PackColor) as an 8 bit RGB PNG, the render targets are opaque.
+    // rowPitch is the distance between rows in bytes. The strips are encoded on pool.
+    void Encode(const void* pixels, uint32_t width, uint32_t height, uint32_t rowPitch, cpu::WorkerPool& pool,
+        std::vector<uint8_t>& png, uint32_t rowsPerStrip = DefaultRowsPerStrip);
+
+    bool WriteFile(const std::string& path, const std::vector<uint8_t>& data);
+
+    // Encodes and writes frames on a background thread, such that writing a frame does not stall rendering.
+    // Submit copies the frame into a recycled buffer and returns, the writer thread encodes it with a pool of threadCount threads.
+    class FrameWriter
+    {
+    public:
+        struct Statistics
+        {
+            uint64_t frames        = 0;
+            uint64_t bytes         = 0;
+            // Time spent encoding and writing on the writer thread
+            double   encodeMs      = 0.0;
+            // Time the render thread waited in Submit because maxQueuedFrames frames were queued
+            double   submitStallMs = 0.0;
+        };
+
+        FrameWriter(uint32_t threadCount, uint32_t maxQueuedFrames = 2);
+        // Writes all queued frames
+        ~FrameWriter();
+
+        FrameWriter(const FrameWriter&) = delete;
+        FrameWriter& operator=(const FrameWriter&) = delete;
+
+        void Submit(const std::string& path, const void* pixels, uint32_t width, uint32_t height, uint32_t rowPitch);
+        void Submit(const std::string& path, const cpu::Image& image);
+
+        // Waits until all submitted frames are written and returns false if writing any of them failed
+        bool Flush();
+
+        // Only consistent after Flush
+        const Statistics& GetStatistics() const { return statistics_; }
+
+    private:
+        struct Frame
+        {
+            std::string           path;
+            uint32_t              width  = 0;
+            uint32_t              height = 0;
+            std::vector<uint32_t> pixels;
+        };
+
+        void WriterLoop();
+
+        cpu::WorkerPool pool_;
+        const uint32_t  maxQueuedFrames_;
+
+        std::mutex              mutex_;
+        std::condition_variable queued_;
+        std::condition_variable written_;
+        std::deque<Frame>       queue_;
+        // Pixel buffers of written frames, reused by Submit
+        std::vector<std::vector<uint32_t>> freeBuffers_;
+        // Frames taken from the queue, but not written yet
+        uint32_t   writing_ = 0;
+        bool       failed_  = false;
+        bool       exit_    = false;
+        Statistics statistics_;
+
+        std::thread thread_;
+    };
+}
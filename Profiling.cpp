@@ -0,0 +1,290 @@
+/**********************************************************************
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+#include "Profiling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+namespace profiling {
+    FrameTimingRing::FrameTimingRing(const char* backend)
+        : backend_(backend), frames_(Capacity)
+    {
+    }
+
+    void FrameTimingRing::Push(const FrameTimings& timings)
+    {
+        frames_[next_] = timings;
+        next_ = (next_ + 1) % Capacity;
+        size_ = (size_ < Capacity) ? size_ + 1 : Capacity;
+    }
+
+    const FrameTimings& FrameTimingRing::operator[](size_t index) const
+    {
+        // next_ points to the oldest frame once the ring has wrapped around
+        const size_t oldest = (size_ < Capacity) ? 0 : next_;
+        return frames_[(oldest + index) % Capacity];
+    }
+
+    bool FrameTimingRing::WriteCsv(const std::string& path) const
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            return false;
+        }
+
+        file << "backend,frame,cpu_record_ms,cpu_submit_ms,cpu_present_ms,cpu_wait_ms,cpu_total_ms,"
+                "gpu_clear_ms,gpu_dispatch_graph_ms,gpu_total_ms\n";
+
+        for (size_t i = 0; i < size_; ++i)
+        {
+            const FrameTimings& t = (*this)[i];
+            file << backend_ << ',' << t.frame << ','
+                 << t.cpuRecordMs << ',' << t.cpuSubmitMs << ',' << t.cpuPresentMs << ','
+                 << t.cpuWaitMs << ',' << t.cpuTotalMs << ','
+                 << t.gpuClearMs << ',' << t.gpuDispatchGraphMs << ',' << t.gpuTotalMs << '\n';
+        }
+
+        return static_cast<bool>(file);
+    }
+
+    bool FrameTimingRing::WriteJson(const std::string& path) const
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            return false;
+        }
+
+        file << "{\n  \"backend\": \"" << backend_ << "\",\n  \"frames\": [";
+
+        for (size_t i = 0; i < size_; ++i)
+        {
+            const FrameTimings& t = (*this)[i];
+            file << ((i == 0) ? "\n" : ",\n")
+                 << "    {\"frame\": " << t.frame
+                 << ", \"cpu_record_ms\": " << t.cpuRecordMs
+                 << ", \"cpu_submit_ms\": " << t.cpuSubmitMs
+                 << ", \"cpu_present_ms\": " << t.cpuPresentMs
+                 << ", \"cpu_wait_ms\": " << t.cpuWaitMs
+                 << ", \"cpu_total_ms\": " << t.cpuTotalMs
+                 << ", \"gpu_clear_ms\": " << t.gpuClearMs
+                 << ", \"gpu_dispatch_graph_ms\": " << t.gpuDispatchGraphMs
+                 << ", \"gpu_total_ms\": " << t.gpuTotalMs << "}";
+        }
+
+        file << "\n  ]\n}\n";
+
+        return static_cast<bool>(file);
+    }
+
+    LatencyStatistics ComputeLatencyStatistics(std::vector<double> samples)
+    {
+        LatencyStatistics statistics;
+        if (samples.empty())
+        {
+            return statistics;
+        }
+
+        std::sort(samples.begin(), samples.end());
+
+        const auto percentile = [&](double p) {
+            const size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * samples.size()));
+            return samples[std::min(std::max(rank, size_t(1)), samples.size()) - 1];
+        };
+
+        statistics.count = samples.size();
+        for (const double sample : samples)
+        {
+            statistics.mean += sample;
+        }
+        statistics.mean /= samples.size();
+        statistics.min = samples.front();
+        statistics.p50 = percentile(50.0);
+        statistics.p95 = percentile(95.0);
+        statistics.p99 = percentile(99.0);
+        statistics.max = samples.back();
+
+        return statistics;
+    }
+
+    namespace {
+        double PerSecond(uint64_t items, double ms)
+        {
+            return (ms > 0.0) ? items / (ms / 1000.0) : 0.0;
+        }
+
+        void WriteLatencyJson(std::ostream& stream, const char* name, const LatencyStatistics& statistics)
+        {
+            stream << "\"" << name << "\": {\"mean\": " << statistics.mean << ", \"min\": " << statistics.min
+                   << ", \"p50\": " << statistics.p50 << ", \"p95\": " << statistics.p95
+                   << ", \"p99\": " << statistics.p99 << ", \"max\": " << statistics.max << "}";
+        }
+    }
+
+    double FrameBenchmarkReport::GetFramesPerSecond() const
+    {
+        return PerSecond(1, frameMs.mean);
+    }
+
+    double FrameBenchmarkReport::GetDrawRecordsPerSecond() const
+    {
+        return PerSecond(drawRecords, generationMs.mean);
+    }
+
+    double FrameBenchmarkReport::GetPrimitivesPerSecond() const
+    {
+        return PerSecond(primitives, rasterMs.mean);
+    }
+
+    bool FrameBenchmarkReport::IsGenerationInRaster() const
+    {
+        return (generationMs.count > 0) && (generationMs.count == rasterMs.count) && (generationMs.mean == rasterMs.mean) && (generationMs.max == rasterMs.max);
+    }
+
+    void FrameBenchmarkReport::Print() const
+    {
+        printf("%s %s, depth %u, %u threads, %zu frames\n", backend.c_str(), variant.c_str(), depth, threads, frameMs.count);
+        printf("  %-12s %10s %10s %10s %10s %10s\n", "", "mean", "p50", "p95", "p99", "max");
+
+        const auto printRow = [](const char* name, const LatencyStatistics& statistics) {
+            printf("  %-12s %10.3f %10.3f %10.3f %10.3f %10.3f ms\n", name,
+                statistics.mean, statistics.p50, statistics.p95, statistics.p99, statistics.max);
+        };
+        printRow("frame", frameMs);
+        // Runs without graph execution, e.g. of precomputed records, have no generation time and no draw record rate
+        const bool hasGeneration = generationMs.count > 0;
+        if (IsGenerationInRaster())
+        {
+            printRow("graph", generationMs);
+        }
+        else
+        {
+            if (hasGeneration)
+            {
+                printRow("generation", generationMs);
+            }
+            printRow("raster", rasterMs);
+        }
+
+        printf("  %.1f frames/s, ", GetFramesPerSecond());
+        if (hasGeneration)
+        {
+            printf("%.3g draw records/s, ", GetDrawRecordsPerSecond());
+        }
+        printf("%.3g primitives/s, %.3f ms until the first frame\n", GetPrimitivesPerSecond(), startupMs);
+    }
+
+    void FrameBenchmarkReport::WriteJson(std::ostream& stream) const
+    {
+        stream << "{\"backend\": \"" << backend << "\", \"variant\": \"" << variant << "\", \"depth\": " << depth << ", \"threads\": " << threads
+               << ", \"frames\": " << frameMs.count << ", ";
+        WriteLatencyJson(stream, "frame_ms", frameMs);
+        if (generationMs.count > 0)
+        {
+            stream << ", ";
+            WriteLatencyJson(stream, "generation_ms", generationMs);
+        }
+        stream << ", ";
+        WriteLatencyJson(stream, "raster_ms", rasterMs);
+        stream << ", \"draw_records\": " << drawRecords << ", \"primitives\": " << primitives
+               << ", \"frames_per_second\": " << GetFramesPerSecond();
+        if (generationMs.count > 0)
+        {
+            stream << ", \"draw_records_per_second\": " << GetDrawRecordsPerSecond();
+        }
+        stream << ", \"primitives_per_second\": " << GetPrimitivesPerSecond()
+               << ", \"startup_ms\": " << startupMs << "}";
+    }
+
+    bool WriteFrameBenchmarks(const std::string& path, const std::vector<FrameBenchmarkReport>& reports)
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            return false;
+        }
+
+        file << "{\n  \"frame_benchmarks\": [";
+        for (size_t i = 0; i < reports.size(); ++i)
+        {
+            file << ((i == 0) ? "\n    " : ",\n    ");
+            reports[i].WriteJson(file);
+        }
+        file << "\n  ]\n}\n";
+
+        return static_cast<bool>(file);
+    }
+
+    size_t ZoneProfiler::Begin(const std::string& name)
+    {
+        const double beginMs = std::chrono::duration<double, std::milli>(Clock::now() - origin_).count();
+        zones_.push_back({ name, depth_++, beginMs, 0.0 });
+        return zones_.size() - 1;
+    }
+
+    void ZoneProfiler::End(size_t zone)
+    {
+        const double endMs = std::chrono::duration<double, std::milli>(Clock::now() - origin_).count();
+        zones_[zone].durationMs = endMs - zones_[zone].beginMs;
+        --depth_;
+    }
+
+    void ZoneProfiler::Print() const
+    {
+        for (const Zone& zone : zones_)
+        {
+            const int indent = static_cast<int>(zone.depth) * 2;
+            printf("%*s%-*s %10.3f ms\n", indent, "", 48 - indent, zone.name.c_str(), zone.durationMs);
+        }
+    }
+
+    bool ZoneProfiler::WriteJson(const std::string& path) const
+    {
+        std::ofstream file(path);
+        if (!file)
+        {
+            return false;
+        }
+
+        file << "{\n  \"zones\": [";
+        for (size_t i = 0; i < zones_.size(); ++i)
+        {
+            const Zone& zone = zones_[i];
+            file << ((i == 0) ? "\n" : ",\n")
+                 << "    {\"name\": \"" << zone.name << "\", \"depth\": " << zone.depth
+                 << ", \"begin_ms\": " << zone.beginMs << ", \"duration_ms\": " << zone.durationMs << "}";
+        }
+        file << "\n  ]\n}\n";
+
+        return static_cast<bool>(file);
+    }
+
+    ZoneProfiler& StartupZones()
+    {
+        static ZoneProfiler profiler;
+        return profiler;
+    }
+}
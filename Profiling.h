@@ -0,0 +1,220 @@
+/**********************************************************************
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+#pragma once
+
+// This file does not depend on D3D12 or Windows headers, such that the timing reports
+// can be produced and consumed by any backend.
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace profiling {
+    using Clock = std::chrono::steady_clock;
+
+    // Measures elapsed CPU time in milliseconds
+    class CpuTimer
+    {
+    public:
+        CpuTimer() : start_(Clock::now()) {}
+
+        double ElapsedMs() const
+        {
+            return std::chrono::duration<double, std::milli>(Clock::now() - start_).count();
+        }
+
+        // Returns the elapsed time and restarts the timer.
+        // Used to time consecutive phases with a single timer.
+        double Lap()
+        {
+            const Clock::time_point now = Clock::now();
+            const double elapsed = std::chrono::duration<double, std::milli>(now - start_).count();
+            start_ = now;
+            return elapsed;
+        }
+
+    private:
+        Clock::time_point start_;
+    };
+
+    // Timings of a single frame in milliseconds.
+    // CPU phases are measured around the steps in Render,
+    // GPU phases are resolved from timestamp queries written in RecordCommandList.
+    struct FrameTimings
+    {
+        uint64_t frame = 0;
+
+        double cpuRecordMs  = 0;
+        double cpuSubmitMs  = 0;
+        double cpuPresentMs = 0;
+        double cpuWaitMs    = 0;
+        double cpuTotalMs   = 0;
+
+        double gpuClearMs         = 0;
+        double gpuDispatchGraphMs = 0;
+        double gpuTotalMs         = 0;
+    };
+
+    // Ring buffer of the most recent frame timings.
+    // Oldest frames are overwritten once the ring is full.
+    class FrameTimingRing
+    {
+    public:
+        static constexpr size_t Capacity = 1024;
+
+        // The backend name is written to the reports to tell apart results from different backends
+        explicit FrameTimingRing(const char* backend);
+
+        void Push(const FrameTimings& timings);
+
+        size_t Size() const { return size_; }
+        // Index 0 is the oldest frame in the ring
+        const FrameTimings& operator[](size_t index) const;
+
+        // Writes one line per frame with a header row
+        bool WriteCsv(const std::string& path) const;
+        // Writes {"backend": ..., "frames": [...]} with one object per frame
+        bool WriteJson(const std::string& path) const;
+
+    private:
+        std::string backend_;
+        std::vector<FrameTimings> frames_;
+        size_t next_ = 0;
+        size_t size_ = 0;
+    };
+
+    // Summary of a series of samples, e.g. frame times in milliseconds
+    struct LatencyStatistics
+    {
+        size_t count = 0;
+        double mean  = 0;
+        double min   = 0;
+        double p50   = 0;
+        double p95   = 0;
+        double p99   = 0;
+        double max   = 0;
+    };
+
+    // Percentiles use the nearest-rank method
+    LatencyStatistics ComputeLatencyStatistics(std::vector<double> samples);
+
+    // Result of rendering a fixed number of frames without a window, see --benchmark in main.cpp
+    // and --frames in Benchmark.cpp. Both backends write the same format, such that results can be
+    // compared across backends and machines.
+    struct FrameBenchmarkReport
+    {
+        std::string backend;
+        // Variant of the graph, e.g. the SnowflakeNode launch mode
+        std::string variant;
+        uint32_t    depth   = 0;
+        // Number of CPU worker threads, 0 for GPU backends
+        uint32_t    threads = 0;
+
+        LatencyStatistics frameMs;
+        // Time of the graph execution and of the mesh nodes & rasterization per frame.
+        // On the GPU, both run within DispatchGraph and are reported with the same time.
+        // generationMs has no samples if the records are not generated, e.g. precomputed records.
+        LatencyStatistics generationMs;
+        LatencyStatistics rasterMs;
+
+        // Triangle and line draw records emitted by the graph per frame
+        uint64_t drawRecords = 0;
+        // Primitives output by the mesh nodes per frame
+        uint64_t primitives  = 0;
+        // Time from the start of the setup until the first frame is finished
+        double   startupMs   = 0.0;
+
+        double GetFramesPerSecond() const;
+        double GetDrawRecordsPerSecond() const;
+        double GetPrimitivesPerSecond() const;
+        // True if generationMs and rasterMs are the same measurement, which is printed once
+        bool IsGenerationInRaster() const;
+
+        void Print() const;
+        // Writes a single JSON object, without trailing newline
+        void WriteJson(std::ostream& stream) const;
+    };
+
+    // Writes {"frame_benchmarks": [...]} with one object per report
+    bool WriteFrameBenchmarks(const std::string& path, const std::vector<FrameBenchmarkReport>& reports);
+
+    // Named CPU timing zones, e.g. of the application startup.
+    // Zones can be nested, the nesting depth is used to indent the printed breakdown.
+    class ZoneProfiler
+    {
+    public:
+        struct Zone
+        {
+            std::string name;
+            uint32_t    depth;
+            double      beginMs;
+            double      durationMs;
+        };
+
+        ZoneProfiler() : origin_(Clock::now()) {}
+
+        // Returns the index of the new zone
+        size_t Begin(const std::string& name);
+        void   End(size_t zone);
+
+        const std::vector<Zone>& GetZones() const { return zones_; }
+
+        // Prints one line per zone in the order the zones were opened
+        void Print() const;
+        bool WriteJson(const std::string& path) const;
+
+    private:
+        Clock::time_point origin_;
+        std::vector<Zone> zones_;
+        uint32_t depth_ = 0;
+    };
+
+    // Zones of the application startup, from main until the first frame
+    ZoneProfiler& StartupZones();
+
+    // Times the enclosing scope, or until End is called, as a zone of StartupZones
+    class ScopedZone
+    {
+    public:
+        explicit ScopedZone(const std::string& name) : zone_(StartupZones().Begin(name)) {}
+        ~ScopedZone() { End(); }
+
+        ScopedZone(const ScopedZone&) = delete;
+        ScopedZone& operator=(const ScopedZone&) = delete;
+
+        void End()
+        {
+            if (open_)
+            {
+                StartupZones().End(zone_);
+                open_ = false;
+            }
+        }
+
+    private:
+        size_t zone_;
+        bool   open_ = true;
+    };
+}
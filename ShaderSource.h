@@ -27,11 +27,65 @@ THE SOFTWARE.
 //  - with target lib_6_9 for all work graph nodes, including the two mesh nodes for drawing
 //  - with target ps_6_9 for the pixel shader. Pixel shader cannot be included in the library object and need to be compiled separately.
 
+#include <string>
+
 namespace shader {
-    static const char* workGraphSource = R"(
+    // Number of Koch iterations.
+    // Passed to the HLSL source as MAX_SNOWFLAKE_RECURSIONS and shared with the CPU executor (see CpuWorkGraph.h)
+    constexpr unsigned int MaxSnowflakeRecursions = 3;
+    // Number of Koch iterations expanded by a single SnowflakeNode invocation, emitting 4^k child lines.
+    // Passed to the HLSL source as SNOWFLAKE_EXPANSION_LEVELS and shared with the CPU executor.
+    constexpr unsigned int SnowflakeExpansionLevels = 1;
+    // Largest SNOWFLAKE_EXPANSION_LEVELS. An invocation declares 4^k child lines, (4^k - 1) / 3 triangles and a line,
+    // which exceeds the 256 output records of a thread (MaxNodeOutputRecords below) for k = 4.
+    constexpr unsigned int MaxSnowflakeExpansionLevels = 3;
+    // D3D12 node output limit: a thread group (a single thread with thread launch) can declare at most 256 output records across all outputs
+    constexpr unsigned int MaxNodeOutputRecords = 256;
+    // Largest SNOWFLAKE_COALESCING group size. A group declares 4 child lines, a triangle and a line per record.
+    constexpr unsigned int MaxSnowflakeGroupSize = MaxNodeOutputRecords / 6;
+    // Triangles drawn by one batched triangle mesh node group, 0 to draw one triangle per group.
+    // Passed to the HLSL source as TRIANGLE_BATCH_SIZE and shared with the CPU mesh nodes (see CpuRasterizer.h).
+    constexpr unsigned int TriangleBatchSize = 0;
+    // Mesh shaders output at most 256 vertices, i.e. 85 triangles
+    constexpr unsigned int MaxTriangleBatchSize = 85;
+    // Draw the lines of the last Koch iteration as one strip per subdivided line with shared joint vertices.
+    // Passed to the HLSL source as LINE_STRIP and shared with the CPU executor.
+    constexpr bool LineStrips = false;
+    // Send the lines of the last Koch iteration as one record, which launches a LineMeshNode group per line with SV_DispatchGrid,
+    // and gather the triangles into records which launch a group per TriangleGridGroupSize triangles.
+    // Passed to the HLSL source as LINE_DISPATCH_GRID and shared with the CPU executor.
+    constexpr bool LineDispatchGrid = false;
+    // [NodeMaxDispatchGrid(...)] of LineMeshNode with LINE_DISPATCH_GRID, the lines of a Koch iteration
+    constexpr unsigned int LineMaxDispatchGrid = 4;
+    // With LINE_DISPATCH_GRID, triangle records are gathered into records of up to TriangleGridGroupSize * TriangleMaxDispatchGrid triangles,
+    // which launch a TriangleBatchMeshNode group per TriangleGridGroupSize triangles. Must match the HLSL source.
+    constexpr unsigned int TriangleGridGroupSize   = 32;
+    constexpr unsigned int TriangleMaxDispatchGrid = 8;
+    // Encode line and triangle records with 8 instead of 16 and 28 bytes.
+    // Passed to the HLSL source as COMPACT_RECORDS and shared with the CPU executor.
+    constexpr bool CompactRecords = false;
+    // Address both mesh nodes as entries of the "MeshNodes" node array, through a single NodeOutputArray.
+    // Passed to the HLSL source as MESH_NODE_ARRAY and shared with the CPU executor.
+    constexpr bool MeshNodeArray = false;
+    // Replace the recursive SnowflakeNode with a chain of nodes SnowflakeNode_0 ... SnowflakeNode_<MaxSnowflakeRecursions>,
+    // one for each recursion level. Passed to the HLSL source as SNOWFLAKE_UNROLLED and shared with the CPU executor.
+    constexpr bool UnrolledSnowflakeChain = false;
+    // Cull mesh node primitives which are off-screen, cover no pixel center or are smaller than CullMinPixelArea.
+    // Passed to the HLSL source as MESH_NODE_CULLING=<viewport size> and shared with the CPU mesh nodes (see CpuRasterizer.h).
+    constexpr bool MeshNodeCulling = false;
+    // Minimum area of a triangle in pixels with MESH_NODE_CULLING, passed to the HLSL source as CULL_MIN_PIXEL_AREA.
+    // 0 only culls triangles which do not cover any pixel center and thus keeps the image unchanged.
+    constexpr float CullMinPixelArea = 0.f;
+    // Entries of the mesh node array, must match the HLSL source
+    constexpr unsigned int TriangleMeshNodeIndex = 0;
+    constexpr unsigned int LineMeshNodeIndex     = 1;
+    constexpr unsigned int MeshNodeCount         = 2;
+
+    static const char* const workGraphSource = R"(
 // =========================
 // Work graph record structs
 
+#ifndef COMPACT_RECORDS
 // Record used for recursively generating & drawing lines
 struct LineRecord
 {
@@ -45,9 +99,201 @@ struct TriangleDrawRecord
     float2 verts[3];
     uint   depth;
 };
+#else
+// Compact records, see cpu::EncodeLineRecord and cpu::EncodeTriangleRecord in CpuWorkGraph.h.
+// All coordinates of the graph are within [-1, 1] and stored as signed normalized integers.
+
+// Start and end point as snorm16
+struct LineRecord
+{
+    uint2 endpoints;
+};
+
+// All triangles of the graph are equilateral and are stored by one edge, the base verts[0] -> verts[2], as snorm14.
+// verts[1] is reconstructed from the base and the side of the base it is on.
+//  - base.x: verts[0].x | verts[0].y << 14 | depth << 28 (depth < 16)
+//  - base.y: verts[2].x | verts[2].y << 14 | clockwise << 28
+struct TriangleDrawRecord
+{
+    uint2 base;
+};
+#endif
+
+uint PackSnorm(float value, uint bits)
+{
+    const float scale = (1u << (bits - 1)) - 1;
+    return uint(int(round(clamp(value, -1.0, 1.0) * scale))) & ((1u << bits) - 1);
+}
+
+float UnpackSnorm(uint packed, uint bits)
+{
+    const float scale = (1u << (bits - 1)) - 1;
+    // Sign extend the lowest bits
+    return max(float(int(packed << (32 - bits)) >> (32 - bits)) / scale, -1.0);
+}
+
+// Record accessors, which hide the encoding of the records from the nodes
+LineRecord MakeLineRecord(float2 start, float2 end)
+{
+    LineRecord record;
+#ifdef COMPACT_RECORDS
+    record.endpoints.x = PackSnorm(start.x, 16) | (PackSnorm(start.y, 16) << 16);
+    record.endpoints.y = PackSnorm(end.x, 16) | (PackSnorm(end.y, 16) << 16);
+#else
+    record.start = start;
+    record.end   = end;
+#endif
+    return record;
+}
+
+float2 GetLineStart(LineRecord record)
+{
+#ifdef COMPACT_RECORDS
+    return float2(UnpackSnorm(record.endpoints.x, 16), UnpackSnorm(record.endpoints.x >> 16, 16));
+#else
+    return record.start;
+#endif
+}
+
+float2 GetLineEnd(LineRecord record)
+{
+#ifdef COMPACT_RECORDS
+    return float2(UnpackSnorm(record.endpoints.y, 16), UnpackSnorm(record.endpoints.y >> 16, 16));
+#else
+    return record.end;
+#endif
+}
+
+TriangleDrawRecord MakeTriangleRecord(float2 v0, float2 v1, float2 v2, uint depth)
+{
+    TriangleDrawRecord record;
+#ifdef COMPACT_RECORDS
+    const float2 base = v2 - v0;
+    const float2 apex = v1 - v0;
+    const bool   clockwise = (base.x * apex.y - base.y * apex.x) < 0;
+    record.base.x = PackSnorm(v0.x, 14) | (PackSnorm(v0.y, 14) << 14) | (min(depth, 15u) << 28);
+    record.base.y = PackSnorm(v2.x, 14) | (PackSnorm(v2.y, 14) << 14) | (uint(clockwise) << 28);
+#else
+    record.verts[0] = v0;
+    record.verts[1] = v1;
+    record.verts[2] = v2;
+    record.depth    = depth;
+#endif
+    return record;
+}
+
+float2 GetTriangleVertex(TriangleDrawRecord record, uint index)
+{
+#ifdef COMPACT_RECORDS
+    const float2 v0 = float2(UnpackSnorm(record.base.x, 14), UnpackSnorm(record.base.x >> 14, 14));
+    const float2 v2 = float2(UnpackSnorm(record.base.y, 14), UnpackSnorm(record.base.y >> 14, 14));
+    if (index == 1) {
+        // Apex of the equilateral triangle, on the left (counterclockwise) side of the base unless the bit is set
+        const float side = ((record.base.y >> 28) & 1)? -1.0 : 1.0;
+        return lerp(v0, v2, .5) + float2(v0.y - v2.y, v2.x - v0.x) * side * sqrt(3) / 2;
+    }
+    return (index == 0)? v0 : v2;
+#else
+    return record.verts[index];
+#endif
+}
+
+uint GetTriangleDepth(TriangleDrawRecord record)
+{
+#ifdef COMPACT_RECORDS
+    return record.base.x >> 28;
+#else
+    return record.depth;
+#endif
+}
+
+// Record used to draw consecutive lines of the outline as a single strip (LINE_STRIP)
+// or, with LINE_DISPATCH_GRID, to launch one LineMeshNode group per line.
+struct LineStripRecord
+{
+    float2 points[5];
+    // 4 for the lines of a Koch iteration, 1 for a line without any Koch iteration
+#ifdef LINE_DISPATCH_GRID
+    uint   segmentCount : SV_DispatchGrid;
+#else
+    uint   segmentCount;
+#endif
+};
+
+// Maximum number of lines of a LineStripRecord
+static const uint lineMaxDispatchGrid = 4;
+
+#ifdef MESH_NODE_ARRAY
+// Entries of the "MeshNodes" mesh node array, see CreateGWGStateObject in HelloMeshNodes.cpp
+static const uint TriangleMeshNodeIndex = 0;
+static const uint LineMeshNodeIndex     = 1;
+static const uint meshNodeCount         = 2;
+
+// All entries of a node array share one record type.
+// Lines are stored in the first two vertices of a triangle record.
+typedef TriangleDrawRecord MeshNodeRecord;
+typedef MeshNodeRecord     LineDrawRecord;
+
+MeshNodeRecord MakeLineDrawRecord(float2 start, float2 end)
+{
+    return MakeTriangleRecord(start, end, end, 0);
+}
+
+float2 GetLineStart(MeshNodeRecord record)
+{
+    return record.verts[0];
+}
+
+float2 GetLineEnd(MeshNodeRecord record)
+{
+    return record.verts[1];
+}
+#else
+// Record of LineMeshNode
+typedef LineRecord LineDrawRecord;
+#endif
 
 // Number of Koch iterations
-static const uint maxSnowflakeRecursions = 3;
+#ifndef MAX_SNOWFLAKE_RECURSIONS
+#define MAX_SNOWFLAKE_RECURSIONS 3
+#endif
+static const uint maxSnowflakeRecursions = MAX_SNOWFLAKE_RECURSIONS;
+
+// Number of Koch iterations per SnowflakeNode invocation
+#ifndef SNOWFLAKE_EXPANSION_LEVELS
+#define SNOWFLAKE_EXPANSION_LEVELS 1
+#endif
+// An invocation declares 4^k child lines, (4^k - 1) / 3 triangles and a line, which must be within the limit of 256 output records:
+// 86 records for k = 3, but 342 for k = 4
+#if (SNOWFLAKE_EXPANSION_LEVELS < 1) || (SNOWFLAKE_EXPANSION_LEVELS > 3)
+#error SNOWFLAKE_EXPANSION_LEVELS must be within [1, 3], as a thread outputs at most 256 records
+#endif
+static const uint snowflakeExpansionLevels = SNOWFLAKE_EXPANSION_LEVELS;
+
+// =====================================
+// Optional instrumentation of the graph
+// When compiled with NODE_COUNTERS, each node counts its invocations and emitted records in a UAV.
+// Counter slots must match cpu::CounterSlot in CpuWorkGraph.h.
+#ifdef NODE_COUNTERS
+RWByteAddressBuffer nodeCounters : register(u0);
+#endif
+
+static const uint EntryNodeInvocations          = 0;
+static const uint SnowflakeNodeInvocations      = 1;
+static const uint TriangleMeshNodeInvocations   = 2;
+static const uint LineMeshNodeInvocations       = 3;
+static const uint EntryToSnowflakeRecords       = 4;
+static const uint EntryToTriangleRecords        = 5;
+static const uint SnowflakeToSnowflakeRecords   = 6;
+static const uint SnowflakeToTriangleRecords    = 7;
+static const uint SnowflakeToLineRecords        = 8;
+
+void CountNode(uint slot, uint value)
+{
+#ifdef NODE_COUNTERS
+    nodeCounters.InterlockedAdd(slot * 4, value);
+#endif
+}
 
 // This node creates the triangle base for the Koch snowflake.
 [Shader("node")]
@@ -55,39 +301,185 @@ static const uint maxSnowflakeRecursions = 3;
 [NodeLaunch("thread")]
 void EntryNode(
     // Start recursive Koch fractal on each of the three sides of the triangle
+#ifdef SNOWFLAKE_UNROLLED
+    [MaxRecords(3)][NodeId("SnowflakeNode_0")]NodeOutput<LineRecord> SnowflakeNode,
+#else
     [MaxRecords(3)]NodeOutput<LineRecord> SnowflakeNode,
+#endif
+#ifdef MESH_NODE_ARRAY
+    // Fill triangle, drawn by the TriangleMeshNodeIndex entry of the mesh node array
+    [MaxRecords(1)][NodeArraySize(meshNodeCount)]NodeOutputArray<MeshNodeRecord> MeshNodes)
+#else
     // Fill triangle
     [MaxRecords(1)]NodeOutput<TriangleDrawRecord> TriangleMeshNode)
+#endif
 {
     ThreadNodeOutputRecords<LineRecord> snowflakeRecords    = SnowflakeNode.GetThreadNodeOutputRecords(3);
+#ifdef MESH_NODE_ARRAY
+    ThreadNodeOutputRecords<TriangleDrawRecord> drawRecords = MeshNodes[TriangleMeshNodeIndex].GetThreadNodeOutputRecords(1);
+#else
     ThreadNodeOutputRecords<TriangleDrawRecord> drawRecords = TriangleMeshNode.GetThreadNodeOutputRecords(1);
+#endif
 
     const float2 v0 = float2(0., .9);
     const float2 v1 = float2(+sqrt(3) * .45, -.45);
     const float2 v2 = float2(-sqrt(3) * .45, -.45);
 
     // Line v0 -> v1
-    snowflakeRecords.Get(0).start = v0;
-    snowflakeRecords.Get(0).end   = v1;
+    snowflakeRecords.Get(0) = MakeLineRecord(v0, v1);
 
     // Line v1 -> v2
-    snowflakeRecords.Get(1).start = v1;
-    snowflakeRecords.Get(1).end   = v2;
+    snowflakeRecords.Get(1) = MakeLineRecord(v1, v2);
 
     // Line v2 -> v0
-    snowflakeRecords.Get(2).start = v2;
-    snowflakeRecords.Get(2).end   = v0;
+    snowflakeRecords.Get(2) = MakeLineRecord(v2, v0);
 
     // Triangle record
-    drawRecords.Get(0).depth    = 0;
-    drawRecords.Get(0).verts[0] = v0;
-    drawRecords.Get(0).verts[1] = v1;
-    drawRecords.Get(0).verts[2] = v2;
+    drawRecords.Get(0) = MakeTriangleRecord(v0, v1, v2, 0);
 
     snowflakeRecords.OutputComplete();
     drawRecords.OutputComplete();
+
+    CountNode(EntryNodeInvocations, 1);
+    CountNode(EntryToSnowflakeRecords, 3);
+    CountNode(EntryToTriangleRecords, 1);
 };
 
+// SnowflakeNode uses thread launch by default.
+// When compiled with SNOWFLAKE_COALESCING=<group size> (e.g. 16 or 32), the coalescing launch variant below is used instead,
+// which processes up to <group size> records per thread group and allocates the outputs once per group.
+// When compiled with SNOWFLAKE_EXPANSION_LEVELS=k > 1, each invocation expands k Koch iterations at once.
+// When compiled with LINE_STRIP, the last Koch iteration sends its four lines as one strip to LineMeshNode instead of recursing.
+// When compiled with LINE_DISPATCH_GRID, the same record launches one LineMeshNode group per line.
+// When compiled with MESH_NODE_ARRAY, triangles and lines are sent through a single output to the mesh node array.
+// When compiled with SNOWFLAKE_UNROLLED, a chain of nodes with one node per recursion level is appended to the source instead.
+// A coalescing group declares 4 * group size child lines, group size triangles and group size lines,
+// which must be within the limit of 256 output records per thread group
+#if defined(SNOWFLAKE_COALESCING) && ((SNOWFLAKE_COALESCING < 1) || (6 * SNOWFLAKE_COALESCING > 256))
+#error SNOWFLAKE_COALESCING must be within [1, 42], as a thread group outputs at most 256 records
+#endif
+#if defined(SNOWFLAKE_COALESCING) && (SNOWFLAKE_EXPANSION_LEVELS > 1)
+#error SNOWFLAKE_COALESCING and SNOWFLAKE_EXPANSION_LEVELS cannot be combined
+#endif
+#if defined(LINE_STRIP) && (defined(SNOWFLAKE_COALESCING) || (SNOWFLAKE_EXPANSION_LEVELS > 1))
+#error LINE_STRIP requires the thread launch SnowflakeNode
+#endif
+// LINE_DISPATCH_GRID uses the records of LINE_STRIP, but draws the lines separately
+// and gathers the triangles into records for TriangleBatchMeshShader, which replaces TRIANGLE_BATCH_SIZE
+#if defined(LINE_DISPATCH_GRID) && (defined(LINE_STRIP) || defined(SNOWFLAKE_COALESCING) || (SNOWFLAKE_EXPANSION_LEVELS > 1) || defined(COMPACT_RECORDS) || defined(MESH_NODE_ARRAY) || defined(TRIANGLE_BATCH_SIZE))
+#error LINE_DISPATCH_GRID requires the thread launch SnowflakeNode and cannot be combined with LINE_STRIP, COMPACT_RECORDS, MESH_NODE_ARRAY or TRIANGLE_BATCH_SIZE
+#endif
+// COMPACT_RECORDS is supported by the thread launch SnowflakeNode and the unbatched mesh nodes
+#if defined(COMPACT_RECORDS) && (defined(SNOWFLAKE_COALESCING) || (SNOWFLAKE_EXPANSION_LEVELS > 1) || defined(LINE_STRIP) || defined(TRIANGLE_BATCH_SIZE))
+#error COMPACT_RECORDS requires the thread launch SnowflakeNode and cannot be combined with LINE_STRIP or TRIANGLE_BATCH_SIZE
+#endif
+// Lines are stored in triangle records, which requires the full precision records
+#if defined(MESH_NODE_ARRAY) && (defined(SNOWFLAKE_COALESCING) || (SNOWFLAKE_EXPANSION_LEVELS > 1) || defined(LINE_STRIP) || defined(TRIANGLE_BATCH_SIZE) || defined(COMPACT_RECORDS))
+#error MESH_NODE_ARRAY requires the thread launch SnowflakeNode and cannot be combined with LINE_STRIP, TRIANGLE_BATCH_SIZE or COMPACT_RECORDS
+#endif
+
+// The unrolled chain uses thread launch with one Koch iteration per node and separate line records
+#if defined(SNOWFLAKE_UNROLLED) && (defined(SNOWFLAKE_COALESCING) || (SNOWFLAKE_EXPANSION_LEVELS > 1) || defined(LINE_STRIP) || defined(LINE_DISPATCH_GRID) || defined(MESH_NODE_ARRAY))
+#error SNOWFLAKE_UNROLLED cannot be combined with SNOWFLAKE_COALESCING, SNOWFLAKE_EXPANSION_LEVELS, LINE_STRIP, LINE_DISPATCH_GRID or MESH_NODE_ARRAY
+#endif
+
+#if defined(SNOWFLAKE_UNROLLED)
+// SnowflakeNode_0 ... SnowflakeNode_<MAX_SNOWFLAKE_RECURSIONS> are appended by shader::GenerateUnrolledSnowflakeChain
+#elif SNOWFLAKE_EXPANSION_LEVELS > 1
+// Child lines and triangles of an invocation expanding all k iterations
+static const uint snowflakeMaxChildren  = 1u << (2 * snowflakeExpansionLevels);
+static const uint snowflakeMaxTriangles = (snowflakeMaxChildren - 1) / 3;
+// Invocations of a recursion chain expanding the lines, the leaf invocation drawing the line is not counted
+static const uint snowflakeRecursionDepth = (maxSnowflakeRecursions + snowflakeExpansionLevels - 1) / snowflakeExpansionLevels;
+
+// Returns segment 'index' of the 4^iterations segments of a line after the given number of Koch iterations.
+// The segment is found by splitting the line once per iteration, using two bits of the index per iteration.
+LineRecord GetKochSegment(float2 start, float2 end, uint iterations, uint index)
+{
+    for (uint iteration = 0; iteration < iterations; ++iteration) {
+        const float2 perpendicular = float2(start.y - end.y, end.x - start.x) * sqrt(3) / 6;
+
+        const float2 points[5] = {
+            start,
+            lerp(start, end, 1./3.),
+            lerp(start, end, .5) + perpendicular,
+            lerp(start, end, 2./3.),
+            end,
+        };
+
+        const uint part = (index >> (2 * (iterations - 1 - iteration))) & 3;
+        start = points[part];
+        end   = points[part + 1];
+    }
+
+    LineRecord segment;
+    segment.start = start;
+    segment.end   = end;
+    return segment;
+}
+
+[Shader("node")]
+[NodeLaunch("thread")]
+[NodeMaxRecursionDepth(snowflakeRecursionDepth)]
+void SnowflakeNode(
+    ThreadNodeInputRecord<LineRecord> record,
+    // Lines after k Koch iterations
+    [MaxRecords(snowflakeMaxChildren)]NodeOutput<LineRecord> SnowflakeNode,
+    // Triangles of all k iterations
+    [MaxRecords(snowflakeMaxTriangles)]NodeOutput<TriangleDrawRecord> TriangleMeshNode,
+    // If recursion is not possible, draw a single line
+    [MaxRecords(1)]NodeOutput<LineRecord> LineMeshNode
+) {
+    const float2 start = record.Get().start;
+    const float2 end   = record.Get().end;
+
+    const bool hasOutput = GetRemainingRecursionLevels() != 0;
+
+    // Koch iteration of the input line and number of iterations expanded by this invocation.
+    // The last expanding invocation of a chain does the remaining maxSnowflakeRecursions % k iterations.
+    const uint iteration  = (snowflakeRecursionDepth - GetRemainingRecursionLevels()) * snowflakeExpansionLevels;
+    const uint iterations = hasOutput ? min(snowflakeExpansionLevels, maxSnowflakeRecursions - iteration) : 0;
+    const uint childCount    = hasOutput * (1u << (2 * iterations));
+    const uint triangleCount = hasOutput * ((1u << (2 * iterations)) - 1) / 3;
+
+    ThreadNodeOutputRecords<LineRecord> snowflakeRecords   = SnowflakeNode.GetThreadNodeOutputRecords(childCount);
+    ThreadNodeOutputRecords<TriangleDrawRecord> triRecords = TriangleMeshNode.GetThreadNodeOutputRecords(triangleCount);
+    ThreadNodeOutputRecords<LineRecord> lineRecord         = LineMeshNode.GetThreadNodeOutputRecords(!hasOutput);
+
+    if (hasOutput) {
+        for (uint child = 0; child < childCount; ++child) {
+            snowflakeRecords.Get(child) = GetKochSegment(start, end, iterations, child);
+        }
+
+        // Triangles of each iteration, placed on the segments of the previous iteration
+        uint triangle = 0;
+        for (uint i = 0; i < iterations; ++i) {
+            for (uint s = 0; s < (1u << (2 * i)); ++s) {
+                const LineRecord segment = GetKochSegment(start, end, i, s);
+                const float2 perpendicular = float2(segment.start.y - segment.end.y, segment.end.x - segment.start.x) * sqrt(3) / 6;
+
+                triRecords.Get(triangle).depth    = 1 + iteration + i;
+                triRecords.Get(triangle).verts[0] = lerp(segment.start, segment.end, 1./3.);
+                triRecords.Get(triangle).verts[1] = lerp(segment.start, segment.end, .5) + perpendicular;
+                triRecords.Get(triangle).verts[2] = lerp(segment.start, segment.end, 2./3.);
+                ++triangle;
+            }
+        }
+    } else {
+        lineRecord.Get(0).start = start;
+        lineRecord.Get(0).end   = end;
+    }
+
+    snowflakeRecords.OutputComplete();
+    lineRecord.OutputComplete();
+    triRecords.OutputComplete();
+
+    CountNode(SnowflakeNodeInvocations, 1);
+    CountNode(SnowflakeToSnowflakeRecords, childCount);
+    CountNode(SnowflakeToTriangleRecords, triangleCount);
+    CountNode(SnowflakeToLineRecords, !hasOutput);
+}
+#elif defined(LINE_STRIP) || defined(LINE_DISPATCH_GRID)
 [Shader("node")]
 [NodeLaunch("thread")]
 [NodeMaxRecursionDepth(maxSnowflakeRecursions)]
@@ -97,12 +489,123 @@ void SnowflakeNode(
     [MaxRecords(4)]NodeOutput<LineRecord> SnowflakeNode,
     // Two of the recursive lines form edges of a triangles, which needs to be filled
     [MaxRecords(1)]NodeOutput<TriangleDrawRecord> TriangleMeshNode,
-    // If recursion is not possible, draw a single line
-    [MaxRecords(1)]NodeOutput<LineRecord> LineMeshNode
+    // The four lines of the last Koch iteration are drawn as one strip, or by one dispatch grid of four groups
+    [MaxRecords(1)]NodeOutput<LineStripRecord> LineMeshNode
 ) {
     const float2 start = record.Get().start;
     const float2 end   = record.Get().end;
 
+    // Recursion stops one level earlier than with single lines.
+    // Without any Koch iteration, the input line is drawn as a strip of one line.
+    const bool hasChildren = GetRemainingRecursionLevels() > 1;
+    const bool hasTriangle = GetRemainingRecursionLevels() != 0;
+
+    ThreadNodeOutputRecords<LineRecord> snowflakeRecords  = SnowflakeNode.GetThreadNodeOutputRecords(hasChildren * 4);
+    ThreadNodeOutputRecords<TriangleDrawRecord> triRecord = TriangleMeshNode.GetThreadNodeOutputRecords(hasTriangle);
+    ThreadNodeOutputRecords<LineStripRecord> stripRecord  = LineMeshNode.GetThreadNodeOutputRecords(!hasChildren);
+
+    const float2 perpendicular = float2(start.y - end.y, end.x - start.x) * sqrt(3) / 6;
+
+    const float2 points[5] = {
+        start,
+        lerp(start, end, 1./3.),
+        lerp(start, end, .5) + perpendicular,
+        lerp(start, end, 2./3.),
+        end,
+    };
+
+    if (hasChildren) {
+        for (uint i = 0; i < 4; ++i) {
+            snowflakeRecords.Get(i).start = points[i];
+            snowflakeRecords.Get(i).end   = points[i + 1];
+        }
+    }
+
+    if (hasTriangle) {
+        triRecord.Get(0).depth    = 1 + (maxSnowflakeRecursions - GetRemainingRecursionLevels());
+        triRecord.Get(0).verts[0] = points[1];
+        triRecord.Get(0).verts[1] = points[2];
+        triRecord.Get(0).verts[2] = points[3];
+    }
+
+    if (!hasChildren) {
+        stripRecord.Get(0).segmentCount = hasTriangle ? 4 : 1;
+        for (uint i = 0; i < 5; ++i) {
+            stripRecord.Get(0).points[i] = hasTriangle ? points[i] : ((i == 0) ? start : end);
+        }
+    }
+
+    snowflakeRecords.OutputComplete();
+    stripRecord.OutputComplete();
+    triRecord.OutputComplete();
+
+    CountNode(SnowflakeNodeInvocations, 1);
+    CountNode(SnowflakeToSnowflakeRecords, hasChildren * 4);
+    CountNode(SnowflakeToTriangleRecords, hasTriangle);
+    CountNode(SnowflakeToLineRecords, !hasChildren);
+}
+#elif defined(MESH_NODE_ARRAY)
+[Shader("node")]
+[NodeLaunch("thread")]
+[NodeMaxRecursionDepth(maxSnowflakeRecursions)]
+void SnowflakeNode(
+    ThreadNodeInputRecord<LineRecord> record,
+    // Koch fractal recursively splits line into 4 new line segments
+    [MaxRecords(4)]NodeOutput<LineRecord> SnowflakeNode,
+    // Each invocation either fills a triangle or, if recursion is not possible, draws its line.
+    // Both are drawn by entries of the mesh node array, which are allocated through a single output.
+    [MaxRecords(1)][NodeArraySize(meshNodeCount)]NodeOutputArray<MeshNodeRecord> MeshNodes
+) {
+    const float2 start = GetLineStart(record.Get());
+    const float2 end   = GetLineEnd(record.Get());
+
+    const bool hasOutput = GetRemainingRecursionLevels() != 0;
+
+    ThreadNodeOutputRecords<LineRecord> snowflakeRecords = SnowflakeNode.GetThreadNodeOutputRecords(hasOutput * 4);
+    // The array index may differ between the threads of a wave
+    ThreadNodeOutputRecords<MeshNodeRecord> drawRecord   = MeshNodes[hasOutput? TriangleMeshNodeIndex : LineMeshNodeIndex].GetThreadNodeOutputRecords(1);
+
+    if (hasOutput) {
+        const float2 perpendicular = float2(start.y - end.y, end.x - start.x) * sqrt(3) / 6;
+
+        const float2 triangleLeft  = lerp(start, end, 1./3.);
+        const float2 triangleMid   = lerp(start, end, .5) + perpendicular;
+        const float2 triangleRight = lerp(start, end, 2./3.);
+
+        snowflakeRecords.Get(0) = MakeLineRecord(start, triangleLeft);
+        snowflakeRecords.Get(1) = MakeLineRecord(triangleLeft, triangleMid);
+        snowflakeRecords.Get(2) = MakeLineRecord(triangleMid, triangleRight);
+        snowflakeRecords.Get(3) = MakeLineRecord(triangleRight, end);
+
+        drawRecord.Get(0) = MakeTriangleRecord(triangleLeft, triangleMid, triangleRight, 1 + (maxSnowflakeRecursions - GetRemainingRecursionLevels()));
+    } else {
+        drawRecord.Get(0) = MakeLineDrawRecord(start, end);
+    }
+
+    snowflakeRecords.OutputComplete();
+    drawRecord.OutputComplete();
+
+    CountNode(SnowflakeNodeInvocations, 1);
+    CountNode(SnowflakeToSnowflakeRecords, hasOutput * 4);
+    CountNode(SnowflakeToTriangleRecords, hasOutput);
+    CountNode(SnowflakeToLineRecords, !hasOutput);
+}
+#elif !defined(SNOWFLAKE_COALESCING)
+[Shader("node")]
+[NodeLaunch("thread")]
+[NodeMaxRecursionDepth(maxSnowflakeRecursions)]
+void SnowflakeNode(
+    ThreadNodeInputRecord<LineRecord> record,
+    // Koch fractal recursively splits line into 4 new line segments
+    [MaxRecords(4)]NodeOutput<LineRecord> SnowflakeNode,
+    // Two of the recursive lines form edges of a triangles, which needs to be filled
+    [MaxRecords(1)]NodeOutput<TriangleDrawRecord> TriangleMeshNode,
+    // If recursion is not possible, draw a single line
+    [MaxRecords(1)]NodeOutput<LineRecord> LineMeshNode
+) {
+    const float2 start = GetLineStart(record.Get());
+    const float2 end   = GetLineEnd(record.Get());
+
     const bool hasOutput = GetRemainingRecursionLevels() != 0;
 
     ThreadNodeOutputRecords<LineRecord> snowflakeRecords  = SnowflakeNode.GetThreadNodeOutputRecords(hasOutput * 4);
@@ -116,28 +619,91 @@ void SnowflakeNode(
         const float2 triangleMid   = lerp(start, end, .5) + perpendicular;
         const float2 triangleRight = lerp(start, end, 2./3.);
 
-        snowflakeRecords.Get(0).start = start;
-        snowflakeRecords.Get(0).end   = triangleLeft;
-        snowflakeRecords.Get(1).start = triangleLeft;
-        snowflakeRecords.Get(1).end   = triangleMid;
-        snowflakeRecords.Get(2).start = triangleMid;
-        snowflakeRecords.Get(2).end   = triangleRight;
-        snowflakeRecords.Get(3).start = triangleRight;
-        snowflakeRecords.Get(3).end   = end;
-        
-        triRecord.Get(0).depth        = 1 + (maxSnowflakeRecursions - GetRemainingRecursionLevels());
-        triRecord.Get(0).verts[0]     = triangleLeft;
-        triRecord.Get(0).verts[1]     = triangleMid;
-        triRecord.Get(0).verts[2]     = triangleRight;
+        snowflakeRecords.Get(0) = MakeLineRecord(start, triangleLeft);
+        snowflakeRecords.Get(1) = MakeLineRecord(triangleLeft, triangleMid);
+        snowflakeRecords.Get(2) = MakeLineRecord(triangleMid, triangleRight);
+        snowflakeRecords.Get(3) = MakeLineRecord(triangleRight, end);
+
+        triRecord.Get(0) = MakeTriangleRecord(triangleLeft, triangleMid, triangleRight, 1 + (maxSnowflakeRecursions - GetRemainingRecursionLevels()));
     } else {
-        lineRecord.Get(0).start        = start;
-        lineRecord.Get(0).end          = end;
+        lineRecord.Get(0) = MakeLineRecord(start, end);
     }
 
     snowflakeRecords.OutputComplete();
     lineRecord.OutputComplete();
     triRecord.OutputComplete();
+
+    CountNode(SnowflakeNodeInvocations, 1);
+    CountNode(SnowflakeToSnowflakeRecords, hasOutput * 4);
+    CountNode(SnowflakeToTriangleRecords, hasOutput);
+    CountNode(SnowflakeToLineRecords, !hasOutput);
+}
+#else
+static const uint snowflakeGroupSize = SNOWFLAKE_COALESCING;
+
+[Shader("node")]
+[NodeLaunch("coalescing")]
+[NumThreads(snowflakeGroupSize, 1, 1)]
+[NodeMaxRecursionDepth(maxSnowflakeRecursions)]
+void SnowflakeNode(
+    uint gtid : SV_GroupThreadID,
+    [MaxRecords(snowflakeGroupSize)] GroupNodeInputRecords<LineRecord> records,
+    [MaxRecords(4 * snowflakeGroupSize)]NodeOutput<LineRecord> SnowflakeNode,
+    [MaxRecords(snowflakeGroupSize)]NodeOutput<TriangleDrawRecord> TriangleMeshNode,
+    [MaxRecords(snowflakeGroupSize)]NodeOutput<LineRecord> LineMeshNode
+) {
+    const uint recordCount = records.Count();
+    const bool hasOutput   = GetRemainingRecursionLevels() != 0;
+
+    // Outputs of all records in the group are allocated at once.
+    // Record i writes its four lines to 4 * i ... 4 * i + 3, thus the output order matches the thread launch node.
+    GroupNodeOutputRecords<LineRecord> snowflakeRecords  = SnowflakeNode.GetGroupNodeOutputRecords(hasOutput * 4 * recordCount);
+    GroupNodeOutputRecords<TriangleDrawRecord> triRecords = TriangleMeshNode.GetGroupNodeOutputRecords(hasOutput * recordCount);
+    GroupNodeOutputRecords<LineRecord> lineRecords        = LineMeshNode.GetGroupNodeOutputRecords(!hasOutput * recordCount);
+
+    if (gtid < recordCount) {
+        const float2 start = records.Get(gtid).start;
+        const float2 end   = records.Get(gtid).end;
+
+        if (hasOutput) {
+            const float2 perpendicular = float2(start.y - end.y, end.x - start.x) * sqrt(3) / 6;
+
+            const float2 triangleLeft  = lerp(start, end, 1./3.);
+            const float2 triangleMid   = lerp(start, end, .5) + perpendicular;
+            const float2 triangleRight = lerp(start, end, 2./3.);
+
+            snowflakeRecords.Get(4 * gtid + 0).start = start;
+            snowflakeRecords.Get(4 * gtid + 0).end   = triangleLeft;
+            snowflakeRecords.Get(4 * gtid + 1).start = triangleLeft;
+            snowflakeRecords.Get(4 * gtid + 1).end   = triangleMid;
+            snowflakeRecords.Get(4 * gtid + 2).start = triangleMid;
+            snowflakeRecords.Get(4 * gtid + 2).end   = triangleRight;
+            snowflakeRecords.Get(4 * gtid + 3).start = triangleRight;
+            snowflakeRecords.Get(4 * gtid + 3).end   = end;
+
+            triRecords.Get(gtid).depth    = 1 + (maxSnowflakeRecursions - GetRemainingRecursionLevels());
+            triRecords.Get(gtid).verts[0] = triangleLeft;
+            triRecords.Get(gtid).verts[1] = triangleMid;
+            triRecords.Get(gtid).verts[2] = triangleRight;
+        } else {
+            lineRecords.Get(gtid).start = start;
+            lineRecords.Get(gtid).end   = end;
+        }
+    }
+
+    snowflakeRecords.OutputComplete();
+    lineRecords.OutputComplete();
+    triRecords.OutputComplete();
+
+    // Counted once per group for all records of the group
+    if (gtid == 0) {
+        CountNode(SnowflakeNodeInvocations, recordCount);
+        CountNode(SnowflakeToSnowflakeRecords, hasOutput * 4 * recordCount);
+        CountNode(SnowflakeToTriangleRecords, hasOutput * recordCount);
+        CountNode(SnowflakeToLineRecords, !hasOutput * recordCount);
+    }
 }
+#endif
 
 // =======================================================
 // Vertex and primitive attribute structs for mesh shaders
@@ -153,6 +719,54 @@ struct Primitive {
 // ==========
 // Mesh Nodes
 
+// When compiled with MESH_NODE_CULLING=<viewport size in pixels>, TriangleMeshShader, TriangleBatchMeshShader, LineMeshShader
+// and LineStripMeshShader do not output primitives which are outside of the (square) viewport or do not cover any pixel center.
+// Triangles with an area below CULL_MIN_PIXEL_AREA pixels are culled as well.
+// Must match cpu::IsTriangleVisible, cpu::IsLineVisible and cpu::IsLineStripVisible in CpuRasterizer.cpp.
+#ifdef MESH_NODE_CULLING
+static const float cullViewportSize = MESH_NODE_CULLING;
+#ifndef CULL_MIN_PIXEL_AREA
+#define CULL_MIN_PIXEL_AREA 0
+#endif
+static const float cullMinPixelArea = CULL_MIN_PIXEL_AREA;
+
+// True if a pixel center x + .5 is within [minPixel, maxPixel].
+// firstCenter is the first pixel center which is not less than minPixel.
+bool CoversPixelCenter(float minPixel, float maxPixel)
+{
+    const float firstCenter = ceil(minPixel - .5) + .5;
+    return firstCenter <= maxPixel;
+}
+
+// Conservative visibility of the bounds [minPosition, maxPosition] in normalized device coordinates
+bool IsBoundsVisible(float2 minPosition, float2 maxPosition)
+{
+    // Viewport transform, with y pointing down in pixel coordinates
+    const float2 minPixel = float2(minPosition.x + 1, 1 - maxPosition.y) * .5 * cullViewportSize;
+    const float2 maxPixel = float2(maxPosition.x + 1, 1 - minPosition.y) * .5 * cullViewportSize;
+
+    const bool onScreen = (maxPixel.x >= 0) && (maxPixel.y >= 0) && (minPixel.x <= cullViewportSize) && (minPixel.y <= cullViewportSize);
+    return onScreen && CoversPixelCenter(minPixel.x, maxPixel.x) && CoversPixelCenter(minPixel.y, maxPixel.y);
+}
+
+bool IsTriangleVisible(float2 v0, float2 v1, float2 v2)
+{
+    const float2 edge1 = (v1 - v0) * .5 * cullViewportSize;
+    const float2 edge2 = (v2 - v0) * .5 * cullViewportSize;
+    const float  area  = abs(edge1.x * edge2.y - edge1.y * edge2.x) * .5;
+
+    return IsBoundsVisible(min(v0, min(v1, v2)), max(v0, max(v1, v2))) && (area >= cullMinPixelArea);
+}
+
+// Lines are at least a line width wide and only culled if they are off-screen or do not cover any pixel center.
+// The vertices of a line are at most 2 * lineWidth away from its end points.
+bool IsLineVisible(float2 start, float2 end, float lineWidth)
+{
+    return IsBoundsVisible(min(start, end) - 2 * lineWidth, max(start, end) + 2 * lineWidth);
+}
+#endif
+
+#ifndef LINE_STRIP
 // Mesh shader to draw a line between a start and end position.
 // As lines X degree angles, we cannot draw lines a simple 2D boxes.
 // 
@@ -174,21 +788,61 @@ struct Primitive {
 // Mesh nodes do not automatically use the function name of the node as their node id.
 // If we want to automatically add the generic program created with this mesh node to the work graph,
 // we need to explicitly define a node id for it.
+// With MESH_NODE_ARRAY, the node id is overridden when creating the work graph state object.
 [NodeId("LineMeshNode", 0)]
 // Mesh nodes can use [NodeDispatchGrid(...)] and [NodeMaxDispatchGrid(...)] in combination with SV_DispatchGrid.
+// With LINE_DISPATCH_GRID, the segmentCount of a LineStripRecord launches one group for each of its lines.
+#ifdef LINE_DISPATCH_GRID
+[NodeMaxDispatchGrid(lineMaxDispatchGrid, 1, 1)]
+#else
 [NodeDispatchGrid(1, 1, 1)]
+#endif
 // The rest of the attributes are the same as for "normal" mesh shaders.
 [NumThreads(32, 1, 1)]
 [OutputTopology("triangle")]
 void LineMeshShader(
     uint gtid : SV_GroupThreadID,
-    DispatchNodeInputRecord<LineRecord> inputRecord,
+#ifdef LINE_DISPATCH_GRID
+    uint gid : SV_GroupID,
+    DispatchNodeInputRecord<LineStripRecord> inputRecord,
+#else
+    DispatchNodeInputRecord<LineDrawRecord> inputRecord,
+#endif
     out indices uint3 triangles[4],
     out primitives Primitive prims[4],
     out vertices Vertex verts[6])
 {
-    const LineRecord record = inputRecord.Get();
-    SetMeshOutputCounts(6, 4);
+#ifdef LINE_DISPATCH_GRID
+    // Each group of the dispatch grid draws one line of the record
+    const float2 start = inputRecord.Get().points[gid];
+    const float2 end   = inputRecord.Get().points[gid + 1];
+#else
+    const float2 start = GetLineStart(inputRecord.Get());
+    const float2 end   = GetLineEnd(inputRecord.Get());
+#endif
+    const float lineWidth = 0.0075;
+
+#ifdef MESH_NODE_CULLING
+    const bool visible = IsLineVisible(start, end, lineWidth);
+#else
+    const bool visible = true;
+#endif
+    SetMeshOutputCounts(visible ? 6 : 0, visible ? 4 : 0);
+
+    // With LINE_DISPATCH_GRID, the records are counted, i.e. dispatch grids and not groups
+#ifdef LINE_DISPATCH_GRID
+    if ((gtid == 0) && (gid == 0))
+#else
+    if (gtid == 0)
+#endif
+    {
+        CountNode(LineMeshNodeInvocations, 1);
+    }
+
+    if (!visible)
+    {
+        return;
+    }
     
     // Output triangles based on triangulation above
     if (gtid < 4)
@@ -199,11 +853,9 @@ void LineMeshShader(
 
     // Output vertices
     if (gtid < 6) {
-        const float2 direction     = normalize(record.end - record.start);
+        const float2 direction     = normalize(end - start);
         const float2 perpendicular = float2(direction.y, -direction.x);
 
-        const float lineWidth = 0.0075;
-
         // Offsets for outer triangle shape
         //
         //     offsets[2] ---- ...
@@ -225,12 +877,148 @@ void LineMeshShader(
 
         // Shift entire line end outwards by sqrt(3) / 3.0 to align with connecting line
         const float2 offset   = (direction * sqrt(3) / 3.0) + offsets[gtid % 3];
-        const float2 position = (gtid < 3)? record.start - offset * lineWidth
-                                          : record.end   + offset * lineWidth;
+        const float2 position = (gtid < 3)? start - offset * lineWidth
+                                          : end   + offset * lineWidth;
+
+        verts[gtid].position = float4(position, 0.25, 1.0);
+    }
+}
+
+#else
+// Mesh shader to draw a strip of up to four lines, which share the vertices at their joints.
+// The ends of the strip are shaped like the ends of a single line (see LineMeshShader above),
+// the joints use a miter vertex on either side of the strip.
+//
+//     v2--v3------v5--...--e
+//    /                       \
+//  v1                         e+1
+//    \                       /
+//     v0--v4------v6--...--e+2
+//
+// Vertices 2 * j + 1 and 2 * j + 2 are the miter vertices of joint j (points[j]), e = 2 * pointCount - 1.
+// Each line j is a quad of two triangles, plus one triangle for each end.
+static const uint lineStripMaxPoints = 5;
+
+// Direction of line 'segment' of the strip
+float2 GetStripDirection(in LineStripRecord record, in uint segment)
+{
+    return normalize(record.points[segment + 1] - record.points[segment]);
+}
+
+// Vertex index on the perpendicular (side = 0) or the opposite side (side = 1) of point j
+uint GetStripVertex(in uint j, in uint side, in uint pointCount)
+{
+    if (j == 0) {
+        return (side == 0)? 2 : 0;
+    }
+    if (j == pointCount - 1) {
+        return 2 * pointCount - 1 + 2 * side;
+    }
+    return 2 * j + 1 + side;
+}
+
+#ifdef MESH_NODE_CULLING
+// The joints of a Koch curve turn by at most 120 degrees, so the miter vertices of a strip are at most 2 * lineWidth away from its points as well.
+bool IsLineStripVisible(in LineStripRecord record, in uint pointCount, in float lineWidth)
+{
+    float2 minPosition = record.points[0];
+    float2 maxPosition = record.points[0];
+    for (uint j = 1; j < pointCount; ++j) {
+        minPosition = min(minPosition, record.points[j]);
+        maxPosition = max(maxPosition, record.points[j]);
+    }
+    return IsBoundsVisible(minPosition - 2 * lineWidth, maxPosition + 2 * lineWidth);
+}
+#endif
+
+[Shader("node")]
+[NodeLaunch("mesh")]
+[NodeId("LineMeshNode", 0)]
+[NodeDispatchGrid(1, 1, 1)]
+[NumThreads(32, 1, 1)]
+[OutputTopology("triangle")]
+void LineStripMeshShader(
+    uint gtid : SV_GroupThreadID,
+    DispatchNodeInputRecord<LineStripRecord> inputRecord,
+    out indices uint3 triangles[2 * lineStripMaxPoints],
+    out primitives Primitive prims[2 * lineStripMaxPoints],
+    out vertices Vertex verts[2 * lineStripMaxPoints + 2])
+{
+    const LineStripRecord record = inputRecord.Get();
+
+    const uint pointCount     = record.segmentCount + 1;
+    const uint vertexCount    = 2 * pointCount + 2;
+    const uint primitiveCount = 2 * pointCount;
+    const float lineWidth     = 0.0075;
+
+#ifdef MESH_NODE_CULLING
+    const bool visible = IsLineStripVisible(record, pointCount, lineWidth);
+#else
+    const bool visible = true;
+#endif
+    SetMeshOutputCounts(visible ? vertexCount : 0, visible ? primitiveCount : 0);
+
+    if (gtid == 0)
+    {
+        CountNode(LineMeshNodeInvocations, 1);
+    }
+
+    if (!visible)
+    {
+        return;
+    }
+
+    if (gtid < primitiveCount)
+    {
+        const uint endVertex = vertexCount - 3;
+        if (gtid == 0) {
+            triangles[gtid] = uint3(0, 1, 2);
+        } else if (gtid == primitiveCount - 1) {
+            triangles[gtid] = uint3(endVertex + 2, endVertex, endVertex + 1);
+        } else {
+            const uint j = (gtid - 1) / 2;
+            triangles[gtid] = ((gtid - 1) % 2 == 0)
+                ? uint3(GetStripVertex(j, 1, pointCount), GetStripVertex(j, 0, pointCount), GetStripVertex(j + 1, 0, pointCount))
+                : uint3(GetStripVertex(j, 1, pointCount), GetStripVertex(j + 1, 0, pointCount), GetStripVertex(j + 1, 1, pointCount));
+        }
+        prims[gtid].color = float4(0.03, 0.19, 0.42, 1.0);
+    }
+
+    if (gtid < vertexCount)
+    {
+        float2 position;
+        if ((gtid < 3) || (gtid >= vertexCount - 3)) {
+            // Ends of the strip, see LineMeshShader
+            const bool   isStart   = gtid < 3;
+            const uint   i         = isStart? gtid : gtid - (vertexCount - 3);
+            const float2 direction = GetStripDirection(record, isStart? 0 : record.segmentCount - 1);
+            const float2 perpendicular = float2(direction.y, -direction.x);
+
+            const float2 offsets[3] = {
+                perpendicular,
+                direction * sqrt(3) / 3.0,
+                -perpendicular,
+            };
+
+            const float2 offset = (direction * sqrt(3) / 3.0) + offsets[i];
+            position = isStart? record.points[0] - offset * lineWidth
+                              : record.points[pointCount - 1] + offset * lineWidth;
+        } else {
+            // Miter vertex at joint j between lines j - 1 and j
+            const uint   j  = (gtid - 1) / 2;
+            const float2 d0 = GetStripDirection(record, j - 1);
+            const float2 d1 = GetStripDirection(record, j);
+            const float2 n0 = float2(d0.y, -d0.x);
+            const float2 miter = normalize(n0 + float2(d1.y, -d1.x));
+
+            const float side = ((gtid - 1) % 2 == 0)? 1.0 : -1.0;
+            position = record.points[j] + miter * side * lineWidth / dot(miter, n0);
+        }
 
         verts[gtid].position = float4(position, 0.25, 1.0);
     }
 }
+#endif
 
 // Color palette for different depth levels
 float4 GetTriangleColor(in uint depth) {
@@ -243,10 +1031,16 @@ float4 GetTriangleColor(in uint depth) {
     }
 }
 
+// TriangleMeshShader draws a single triangle with a group of three threads.
+// When compiled with TRIANGLE_BATCH_SIZE=<n> (e.g. 64), TriangleBatchNode below takes over the "TriangleMeshNode" id
+// and gathers up to <n> triangle records into one record for TriangleBatchMeshShader, which draws them with one thread per triangle.
+// When compiled with LINE_DISPATCH_GRID, TriangleBatchNode gathers up to triangleGridGatherSize triangle records instead,
+// and the record launches one TriangleBatchMeshShader group per triangleGridGroupSize triangles with SV_DispatchGrid.
+#if !defined(TRIANGLE_BATCH_SIZE) && !defined(LINE_DISPATCH_GRID)
 [Shader("node")]
 [NodeLaunch("mesh")]
 // To demonstrate how to override a mesh node id when creating the work graph, we don't specify a node id for this mesh shader.
-// The node id will be set using a mesh node launch override when creating the work graph state object (see HelloMeshNodes.cpp:160)
+// The node id will be set using a mesh node launch override when creating the work graph state object (see CreateGWGStateObject in HelloMeshNodes.cpp)
 // [NodeId("TriangleMeshNode", 0)]
 [NodeDispatchGrid(1, 1, 1)]
 [NumThreads(3, 1, 1)]
@@ -260,19 +1054,172 @@ void TriangleMeshShader(
 {
     const TriangleDrawRecord record = inputRecord.Get();
 
-    SetMeshOutputCounts(3, 1);
-    
+#ifdef MESH_NODE_CULLING
+    // The whole group culls its triangle by not outputting anything
+    const bool visible = IsTriangleVisible(GetTriangleVertex(record, 0), GetTriangleVertex(record, 1), GetTriangleVertex(record, 2));
+#else
+    const bool visible = true;
+#endif
+    SetMeshOutputCounts(visible ? 3 : 0, visible ? 1 : 0);
+
+    if (gtid < 1)
+    {
+        CountNode(TriangleMeshNodeInvocations, 1);
+    }
+
+    if (!visible)
+    {
+        return;
+    }
+
     if (gtid < 1)
     {
         triangles[0]   = uint3(0, 1, 2);
-        prims[0].color = GetTriangleColor(record.depth);
+        prims[0].color = GetTriangleColor(GetTriangleDepth(record));
     }
   
     if (gtid < 3)
     {
-        verts[gtid].position = float4(record.verts[gtid], 0.5, 1);
+        verts[gtid].position = float4(GetTriangleVertex(record, gtid), 0.5, 1);
+    }
+}
+#else
+#ifdef LINE_DISPATCH_GRID
+// Triangles drawn by one group of the dispatch grid, and [NodeMaxDispatchGrid(...)] of TriangleBatchMeshShader
+static const uint triangleGridGroupSize   = 32;
+static const uint triangleMaxDispatchGrid = 8;
+
+static const uint triangleBatchSize  = triangleGridGroupSize;
+static const uint triangleGatherSize = triangleGridGroupSize * triangleMaxDispatchGrid;
+#else
+#if (TRIANGLE_BATCH_SIZE < 1) || (TRIANGLE_BATCH_SIZE > 85)
+#error TRIANGLE_BATCH_SIZE must be within [1, 85], as mesh shaders output at most 256 vertices
+#endif
+static const uint triangleBatchSize  = TRIANGLE_BATCH_SIZE;
+static const uint triangleGatherSize = triangleBatchSize;
+#endif
+
+// Record used to draw up to triangleGatherSize triangles, see cpu::TriangleGridRecord for LINE_DISPATCH_GRID
+struct TriangleBatchRecord
+{
+#ifdef LINE_DISPATCH_GRID
+    // Groups of triangleBatchSize triangles
+    uint               groupCount : SV_DispatchGrid;
+#endif
+    uint               count;
+    TriangleDrawRecord triangles[triangleGatherSize];
+};
+
+#ifdef MESH_NODE_CULLING
+// Visible triangles of each wave of a TriangleBatchMeshShader group, for any wave size
+groupshared uint visibleTrianglesPerWave[triangleBatchSize];
+#endif
+
+// EntryNode and SnowflakeNode send their triangles to this node instead of the mesh node.
+// Coalescing launch gathers the records of a group into a single batch record.
+[Shader("node")]
+[NodeLaunch("coalescing")]
+[NodeId("TriangleMeshNode", 0)]
+[NumThreads(triangleGatherSize, 1, 1)]
+void TriangleBatchNode(
+    uint gtid : SV_GroupThreadID,
+    [MaxRecords(triangleGatherSize)] GroupNodeInputRecords<TriangleDrawRecord> records,
+    [MaxRecords(1)]NodeOutput<TriangleBatchRecord> TriangleBatchMeshNode)
+{
+    const uint recordCount = records.Count();
+
+    GroupNodeOutputRecords<TriangleBatchRecord> batchRecord = TriangleBatchMeshNode.GetGroupNodeOutputRecords(1);
+
+    if (gtid == 0) {
+        batchRecord.Get().count = recordCount;
+#ifdef LINE_DISPATCH_GRID
+        batchRecord.Get().groupCount = (recordCount + triangleBatchSize - 1) / triangleBatchSize;
+#endif
+    }
+    if (gtid < recordCount) {
+        batchRecord.Get().triangles[gtid] = records.Get(gtid);
+    }
+
+    batchRecord.OutputComplete();
+}
+
+[Shader("node")]
+[NodeLaunch("mesh")]
+[NodeId("TriangleBatchMeshNode", 0)]
+#ifdef LINE_DISPATCH_GRID
+[NodeMaxDispatchGrid(triangleMaxDispatchGrid, 1, 1)]
+#else
+[NodeDispatchGrid(1, 1, 1)]
+#endif
+[NumThreads(triangleBatchSize, 1, 1)]
+[OutputTopology("triangle")]
+void TriangleBatchMeshShader(
+    uint gtid : SV_GroupThreadID,
+#ifdef LINE_DISPATCH_GRID
+    uint gid : SV_GroupID,
+#endif
+    DispatchNodeInputRecord<TriangleBatchRecord> inputRecord,
+    out indices uint3 triangles[triangleBatchSize],
+    out primitives Primitive prims[triangleBatchSize],
+    out vertices Vertex verts[3 * triangleBatchSize])
+{
+    // With LINE_DISPATCH_GRID, each group of the grid draws the next triangleBatchSize triangles of the record
+#ifdef LINE_DISPATCH_GRID
+    const uint firstTriangle = gid * triangleBatchSize;
+#else
+    const uint firstTriangle = 0;
+#endif
+    const uint triangleCount = min(inputRecord.Get().count - firstTriangle, triangleBatchSize);
+
+#ifdef MESH_NODE_CULLING
+    // Visible triangles are compacted to the front of the output in the order of the threads
+    const TriangleDrawRecord cullRecord = inputRecord.Get().triangles[firstTriangle + min(gtid, triangleCount - 1)];
+    const bool visible = (gtid < triangleCount) && IsTriangleVisible(cullRecord.verts[0], cullRecord.verts[1], cullRecord.verts[2]);
+
+    const uint waveIndex = gtid / WaveGetLaneCount();
+    if (WaveIsFirstLane())
+    {
+        visibleTrianglesPerWave[waveIndex] = WaveActiveCountBits(visible);
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    uint outputCount  = 0;
+    uint outputOffset = 0;
+    for (uint wave = 0; wave < (triangleBatchSize + WaveGetLaneCount() - 1) / WaveGetLaneCount(); ++wave)
+    {
+        outputOffset += (wave < waveIndex) ? visibleTrianglesPerWave[wave] : 0;
+        outputCount  += visibleTrianglesPerWave[wave];
+    }
+    const uint outputIndex = outputOffset + WavePrefixCountBits(visible);
+#else
+    const bool visible     = gtid < triangleCount;
+    const uint outputCount = triangleCount;
+    const uint outputIndex = gtid;
+#endif
+
+    SetMeshOutputCounts(3 * outputCount, outputCount);
+
+    // Counted per triangle, such that the counters match the unbatched graph
+    if (gtid == 0)
+    {
+        CountNode(TriangleMeshNodeInvocations, triangleCount);
+    }
+
+    // Each thread outputs one triangle and its three vertices
+    if (visible)
+    {
+        const TriangleDrawRecord record = inputRecord.Get().triangles[firstTriangle + gtid];
+
+        triangles[outputIndex]   = 3 * outputIndex + uint3(0, 1, 2);
+        prims[outputIndex].color = GetTriangleColor(record.depth);
+
+        for (uint i = 0; i < 3; ++i)
+        {
+            verts[3 * outputIndex + i].position = float4(record.verts[i], 0.5, 1);
+        }
     }
 }
+#endif
 
 // ================================
 // Pixel Shader for both mesh nodes
@@ -282,4 +1229,93 @@ float4 MeshNodePixelShader(in float4 color : COLOR0) : SV_TARGET
     return color;
 }
     )";
+
+    // Node of the unrolled chain, which expands the Koch iteration of its recursion level.
+    // $NODE, $NEXT_NODE and $DEPTH are replaced by GenerateUnrolledSnowflakeChain.
+    static const char* const unrolledSnowflakeNodeSource = R"(
+[Shader("node")]
+[NodeLaunch("thread")]
+void $NODE(
+    ThreadNodeInputRecord<LineRecord> record,
+    // Koch fractal splits line into 4 new line segments, which are expanded by the next node of the chain
+    [MaxRecords(4)][NodeId("$NEXT_NODE")]NodeOutput<LineRecord> SnowflakeNode,
+    // Two of the recursive lines form edges of a triangles, which needs to be filled
+    [MaxRecords(1)]NodeOutput<TriangleDrawRecord> TriangleMeshNode
+) {
+    const float2 start = GetLineStart(record.Get());
+    const float2 end   = GetLineEnd(record.Get());
+
+    ThreadNodeOutputRecords<LineRecord> snowflakeRecords  = SnowflakeNode.GetThreadNodeOutputRecords(4);
+    ThreadNodeOutputRecords<TriangleDrawRecord> triRecord = TriangleMeshNode.GetThreadNodeOutputRecords(1);
+
+    const float2 perpendicular = float2(start.y - end.y, end.x - start.x) * sqrt(3) / 6;
+
+    const float2 triangleLeft  = lerp(start, end, 1./3.);
+    const float2 triangleMid   = lerp(start, end, .5) + perpendicular;
+    const float2 triangleRight = lerp(start, end, 2./3.);
+
+    snowflakeRecords.Get(0) = MakeLineRecord(start, triangleLeft);
+    snowflakeRecords.Get(1) = MakeLineRecord(triangleLeft, triangleMid);
+    snowflakeRecords.Get(2) = MakeLineRecord(triangleMid, triangleRight);
+    snowflakeRecords.Get(3) = MakeLineRecord(triangleRight, end);
+
+    triRecord.Get(0) = MakeTriangleRecord(triangleLeft, triangleMid, triangleRight, $DEPTH);
+
+    snowflakeRecords.OutputComplete();
+    triRecord.OutputComplete();
+
+    CountNode(SnowflakeNodeInvocations, 1);
+    CountNode(SnowflakeToSnowflakeRecords, 4);
+    CountNode(SnowflakeToTriangleRecords, 1);
+}
+)";
+
+    // Last node of the unrolled chain, which draws its line
+    static const char* const unrolledSnowflakeLeafSource = R"(
+[Shader("node")]
+[NodeLaunch("thread")]
+void $NODE(
+    ThreadNodeInputRecord<LineRecord> record,
+    [MaxRecords(1)]NodeOutput<LineRecord> LineMeshNode
+) {
+    ThreadNodeOutputRecords<LineRecord> lineRecord = LineMeshNode.GetThreadNodeOutputRecords(1);
+    lineRecord.Get(0) = record.Get();
+    lineRecord.OutputComplete();
+
+    CountNode(SnowflakeNodeInvocations, 1);
+    CountNode(SnowflakeToLineRecords, 1);
+}
+)";
+
+    // Generates the nodes SnowflakeNode_0 ... SnowflakeNode_<maxSnowflakeRecursions>, which replace the recursive SnowflakeNode
+    // if the work graph source is compiled with SNOWFLAKE_UNROLLED. The generated source is appended to workGraphSource.
+    // The recursion level and triangle depth of every node are constants, and the nodes do not call GetRemainingRecursionLevels().
+    inline std::string GenerateUnrolledSnowflakeChain(unsigned int maxSnowflakeRecursions)
+    {
+        const auto replace = [](std::string text, const std::string& name, const std::string& value) {
+            for (size_t position = text.find(name); position != std::string::npos; position = text.find(name, position + value.size()))
+            {
+                text.replace(position, name.size(), value);
+            }
+            return text;
+        };
+
+        std::string source = "\n// =========================================================\n"
+                             "// Unrolled SnowflakeNode chain, see GenerateUnrolledSnowflakeChain in ShaderSource.h\n";
+        for (unsigned int level = 0; level <= maxSnowflakeRecursions; ++level)
+        {
+            const std::string node = "SnowflakeNode_" + std::to_string(level);
+            if (level < maxSnowflakeRecursions)
+            {
+                std::string nodeSource = replace(unrolledSnowflakeNodeSource, "$NEXT_NODE", "SnowflakeNode_" + std::to_string(level + 1));
+                nodeSource = replace(nodeSource, "$DEPTH", std::to_string(level + 1));
+                source += replace(nodeSource, "$NODE", node);
+            }
+            else
+            {
+                source += replace(unrolledSnowflakeLeafSource, "$NODE", node);
+            }
+        }
+        return source;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,385 @@
+/**********************************************************************
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+#include "VideoWriter.h"
+
+#include "Profiling.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define VIDEO_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace video {
+    namespace {
+        // Limited range BT.601 in 8 bit fixed point, Y in [16, 235] and Cb, Cr in [16, 240]
+        constexpr int LumaWeights[3] = {  66, 129,  25 };
+        constexpr int CbWeights[3]   = { -38, -74, 112 };
+        constexpr int CrWeights[3]   = { 112, -94, -18 };
+
+        uint8_t Luma(uint32_t pixel)
+        {
+            const int r = pixel & 0xFF;
+            const int g = (pixel >> 8) & 0xFF;
+            const int b = (pixel >> 16) & 0xFF;
+            return static_cast<uint8_t>(((LumaWeights[0] * r + LumaWeights[1] * g + LumaWeights[2] * b + 128) >> 8) + 16);
+        }
+
+        // r, g and b are averages of 2x2 pixels
+        uint8_t Chroma(const int (&weights)[3], int r, int g, int b)
+        {
+            return static_cast<uint8_t>(((weights[0] * r + weights[1] * g + weights[2] * b + 128) >> 8) + 128);
+        }
+
+        const uint32_t* Row(const void* pixels, uint32_t rowPitch, uint32_t y)
+        {
+            return reinterpret_cast<const uint32_t*>(static_cast<const uint8_t*>(pixels) + static_cast<size_t>(y) * rowPitch);
+        }
+
+        void LumaRowScalar(const uint32_t* row, uint32_t begin, uint32_t end, uint8_t* y)
+        {
+            for (uint32_t x = begin; x < end; ++x)
+            {
+                y[x] = Luma(row[x]);
+            }
+        }
+
+        // Chroma samples [begin, end) of the rows top and bottom, which have width pixels
+        void ChromaRowScalar(const uint32_t* top, const uint32_t* bottom, uint32_t width, uint32_t begin, uint32_t end, uint8_t* u, uint8_t* v)
+        {
+            for (uint32_t x = begin; x < end; ++x)
+            {
+                const uint32_t left  = 2 * x;
+                const uint32_t right = (left + 1 < width) ? left + 1 : left;
+                const uint32_t pixels[4] = { top[left], top[right], bottom[left], bottom[right] };
+
+                int sum[3] = { 0, 0, 0 };
+                for (const uint32_t pixel : pixels)
+                {
+                    sum[0] += pixel & 0xFF;
+                    sum[1] += (pixel >> 8) & 0xFF;
+                    sum[2] += (pixel >> 16) & 0xFF;
+                }
+                const int r = (sum[0] + 2) >> 2;
+                const int g = (sum[1] + 2) >> 2;
+                const int b = (sum[2] + 2) >> 2;
+                u[x] = Chroma(CbWeights, r, g, b);
+                v[x] = Chroma(CrWeights, r, g, b);
+            }
+        }
+
+#ifdef VIDEO_SSE2
+        // Sums of the adjacent 32 bit lanes of a and b: { a0 + a1, a2 + a3, b0 + b1, b2 + b3 }
+        __m128i AddPairs(__m128i a, __m128i b)
+        {
+            const __m128 fa = _mm_castsi128_ps(a);
+            const __m128 fb = _mm_castsi128_ps(b);
+            return _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0))),
+                                 _mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1))));
+        }
+
+        // Weighted sums of 4 RGBA pixels, given as 16 bit channels of 2 pixels each. weights holds { r, g, b, 0 } twice.
+        __m128i Weight(__m128i pixels01, __m128i pixels23, __m128i weights, __m128i offset)
+        {
+            const __m128i sum = AddPairs(_mm_madd_epi16(pixels01, weights), _mm_madd_epi16(pixels23, weights));
+            return _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(128)), 8), offset);
+        }
+
+        // Same as LumaRowScalar for 16 pixels at a time, returns the first pixel which is left
+        uint32_t LumaRowSse2(const uint32_t* row, uint32_t width, uint8_t* y)
+        {
+            const __m128i zero    = _mm_setzero_si128();
+            const __m128i weights = _mm_setr_epi16(LumaWeights[0], LumaWeights[1], LumaWeights[2], 0, LumaWeights[0], LumaWeights[1], LumaWeights[2], 0);
+            const __m128i offset  = _mm_set1_epi32(16);
+
+            uint32_t x = 0;
+            for (; x + 16 <= width; x += 16)
+            {
+                __m128i luma[4];
+                for (uint32_t i = 0; i < 4; ++i)
+                {
+                    const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x + 4 * i));
+                    luma[i] = Weight(_mm_unpacklo_epi8(pixels, zero), _mm_unpackhi_epi8(pixels, zero), weights, offset);
+                }
+                const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(luma[0], luma[1]), _mm_packs_epi32(luma[2], luma[3]));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(y + x), packed);
+            }
+            return x;
+        }
+
+        // Averages of the 2x2 blocks of 4 pixels of the rows top and bottom, as 16 bit channels { rgba0, rgba1 }
+        __m128i Average2x2(__m128i top, __m128i bottom)
+        {
+            const __m128i zero  = _mm_setzero_si128();
+            const __m128i lo    = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+            const __m128i hi    = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+            const __m128i sum   = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+            return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+        }
+
+        // Same as ChromaRowScalar for 8 chroma samples (16 pixels) at a time, returns the first sample which is left
+        uint32_t ChromaRowSse2(const uint32_t* top, const uint32_t* bottom, uint32_t width, uint8_t* u, uint8_t* v)
+        {
+            const __m128i cbWeights = _mm_setr_epi16(CbWeights[0], CbWeights[1], CbWeights[2], 0, CbWeights[0], CbWeights[1], CbWeights[2], 0);
+            const __m128i crWeights = _mm_setr_epi16(CrWeights[0], CrWeights[1], CrWeights[2], 0, CrWeights[0], CrWeights[1], CrWeights[2], 0);
+            const __m128i offset    = _mm_set1_epi32(128);
+
+            uint32_t x = 0;
+            for (; 2 * x + 16 <= width; x += 8)
+            {
+                __m128i average[4];
+                for (uint32_t i = 0; i < 4; ++i)
+                {
+                    average[i] = Average2x2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(top + 2 * x + 4 * i)),
+                                            _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + 2 * x + 4 * i)));
+                }
+                const __m128i cb = _mm_packs_epi32(Weight(average[0], average[1], cbWeights, offset), Weight(average[2], average[3], cbWeights, offset));
+                const __m128i cr = _mm_packs_epi32(Weight(average[0], average[1], crWeights, offset), Weight(average[2], average[3], crWeights, offset));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(u + x), _mm_packus_epi16(cb, cb));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(v + x), _mm_packus_epi16(cr, cr));
+            }
+            return x;
+        }
+#endif
+
+        const char* FrameMarker = "FRAME\n";
+    }
+
+    bool HasSimdConversion()
+    {
+#ifdef VIDEO_SSE2
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void ConvertToI420(const void* pixels, uint32_t width, uint32_t height, uint32_t rowPitch,
+        uint8_t* y, uint8_t* u, uint8_t* v, bool simd)
+    {
+        simd = simd && HasSimdConversion();
+        const uint32_t chromaWidth  = (width + 1) / 2;
+        const uint32_t chromaHeight = (height + 1) / 2;
+
+        for (uint32_t row = 0; row < height; ++row)
+        {
+            const uint32_t* source = Row(pixels, rowPitch, row);
+            uint8_t*        luma   = y + static_cast<size_t>(row) * width;
+            uint32_t        begin  = 0;
+#ifdef VIDEO_SSE2
+            if (simd)
+            {
+                begin = LumaRowSse2(source, width, luma);
+            }
+#endif
+            LumaRowScalar(source, begin, width, luma);
+        }
+
+        for (uint32_t row = 0; row < chromaHeight; ++row)
+        {
+            const uint32_t* top    = Row(pixels, rowPitch, 2 * row);
+            const uint32_t* bottom = Row(pixels, rowPitch, (2 * row + 1 < height) ? 2 * row + 1 : 2 * row);
+            uint8_t*        cb     = u + static_cast<size_t>(row) * chromaWidth;
+            uint8_t*        cr     = v + static_cast<size_t>(row) * chromaWidth;
+            uint32_t        begin  = 0;
+#ifdef VIDEO_SSE2
+            if (simd)
+            {
+                begin = ChromaRowSse2(top, bottom, width, cb, cr);
+            }
+#endif
+            ChromaRowScalar(top, bottom, width, begin, chromaWidth, cb, cr);
+        }
+    }
+
+    Y4mWriter::Y4mWriter(uint32_t maxQueuedFrames)
+        : maxQueuedFrames_(std::max(maxQueuedFrames, 1u))
+    {
+    }
+
+    Y4mWriter::~Y4mWriter()
+    {
+        Close();
+    }
+
+    bool Y4mWriter::Open(const std::string& path, uint32_t width, uint32_t height, uint32_t framesPerSecond)
+    {
+        Close();
+
+        stdout_ = (path == "-");
+        if (stdout_)
+        {
+#ifdef _WIN32
+            // Line ending translation would corrupt the frames
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            file_ = stdout;
+        }
+        else
+        {
+            file_ = fopen(path.c_str(), "wb");
+        }
+        if (!file_)
+        {
+            fprintf(stderr, "ERROR: Failed to open %s for writing\n", path.c_str());
+            return false;
+        }
+
+        // C420jpeg is 4:2:0 with chroma centered between the 2x2 pixels it was averaged from
+        char header[128];
+        const int headerSize = snprintf(header, sizeof(header), "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n",
+            width, height, framesPerSecond);
+
+        width_      = width;
+        height_     = height;
+        failed_     = (fwrite(header, 1, headerSize, file_) != static_cast<size_t>(headerSize));
+        exit_       = false;
+        statistics_ = {};
+        statistics_.bytes = headerSize;
+
+        thread_ = std::thread(&Y4mWriter::WriterLoop, this);
+        return !failed_;
+    }
+
+    bool Y4mWriter::Close()
+    {
+        if (!file_)
+        {
+            return true;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            exit_ = true;
+        }
+        queued_.notify_all();
+        thread_.join();
+
+        bool success = !failed_ && (fflush(file_) == 0);
+        if (!stdout_)
+        {
+            success = (fclose(file_) == 0) && success;
+        }
+        file_ = nullptr;
+
+        if (!success)
+        {
+            fprintf(stderr, "ERROR: Failed to write the video stream\n");
+        }
+        return success;
+    }
+
+    void Y4mWriter::Submit(const void* pixels, uint32_t rowPitch)
+    {
+        std::vector<uint32_t> frame;
+        {
+            const profiling::CpuTimer stallTimer;
+            std::unique_lock<std::mutex> lock(mutex_);
+            written_.wait(lock, [&] { return queue_.size() < maxQueuedFrames_; });
+            statistics_.submitStallMs += stallTimer.ElapsedMs();
+
+            if (!freeBuffers_.empty())
+            {
+                frame = std::move(freeBuffers_.back());
+                freeBuffers_.pop_back();
+            }
+        }
+
+        // Rows are copied without the lock, the writer thread does not wait for them
+        frame.resize(static_cast<size_t>(width_) * height_);
+        for (uint32_t y = 0; y < height_; ++y)
+        {
+            std::memcpy(&frame[static_cast<size_t>(y) * width_], Row(pixels, rowPitch, y), width_ * sizeof(uint32_t));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(std::move(frame));
+        }
+        queued_.notify_one();
+    }
+
+    void Y4mWriter::Submit(const cpu::Image& image)
+    {
+        Submit(image.color.data(), image.width * sizeof(uint32_t));
+    }
+
+    void Y4mWriter::WriterLoop()
+    {
+        const size_t lumaSize   = static_cast<size_t>(width_) * height_;
+        const size_t chromaSize = static_cast<size_t>((width_ + 1) / 2) * ((height_ + 1) / 2);
+        const size_t markerSize = std::strlen(FrameMarker);
+
+        // Frame marker followed by the Y, U and V planes, written with one call
+        std::vector<uint8_t> frame(markerSize + lumaSize + 2 * chromaSize);
+        std::memcpy(frame.data(), FrameMarker, markerSize);
+        uint8_t* planes = frame.data() + markerSize;
+
+        for (;;)
+        {
+            std::vector<uint32_t> pixels;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                queued_.wait(lock, [&] { return exit_ || !queue_.empty(); });
+                if (queue_.empty())
+                {
+                    return;
+                }
+                pixels = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            // A queue slot is free
+            written_.notify_all();
+
+            const profiling::CpuTimer convertTimer;
+            ConvertToI420(pixels.data(), width_, height_, width_ * sizeof(uint32_t), planes, planes + lumaSize, planes + lumaSize + chromaSize);
+            const double convertMs = convertTimer.ElapsedMs();
+
+            // After a failed write, e.g. the encoder closed the pipe, the remaining frames are dropped
+            const profiling::CpuTimer writeTimer;
+            const bool written = !failed_ && (fwrite(frame.data(), 1, frame.size(), file_) == frame.size());
+            const double writeMs = writeTimer.ElapsedMs();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                failed_ = failed_ || !written;
+                if (written)
+                {
+                    statistics_.frames += 1;
+                    statistics_.bytes  += frame.size();
+                }
+                statistics_.convertMs += convertMs;
+                statistics_.writeMs   += writeMs;
+                freeBuffers_.push_back(std::move(pixels));
+            }
+            written_.notify_all();
+        }
+    }
+}
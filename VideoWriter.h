@@ -0,0 +1,109 @@
+/**********************************************************************
+Copyright (c) 2024 Advanced Micro Devices, Inc. All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+********************************************************************/
+
+#pragma once
+
+// Raw video output of rendered frames as YUV4MPEG2 (Y4M), which is read by ffmpeg, x264 and most other encoders
+// from a file or a pipe. This file does not depend on D3D12 and builds on Windows and POSIX systems.
+//
+// Frames are converted from RGBA8 to 8 bit YUV 4:2:0 with the limited range BT.601 matrix, the default of the
+// encoders for Y4M input. The conversion uses SSE2 where available and a scalar loop otherwise, both produce
+// the same bytes.
+
+#include "CpuRasterizer.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace video {
+    // True if ConvertToI420 has a SIMD path on this target
+    bool HasSimdConversion();
+
+    // Converts RGBA8 pixels (see cpu::PackColor) to the planes of an I420 frame. rowPitch is the distance between rows in bytes.
+    // The y plane has width * height bytes, the u and v planes (width + 1) / 2 * (height + 1) / 2 bytes.
+    // Chroma is the average of 2x2 pixels, odd sizes repeat the last row or column. With simd false the scalar loop is used throughout.
+    void ConvertToI420(const void* pixels, uint32_t width, uint32_t height, uint32_t rowPitch,
+        uint8_t* y, uint8_t* u, uint8_t* v, bool simd = true);
+
+    // Writes frames to a Y4M stream on a background thread, which converts them while the next frame is rendered.
+    // Submit copies the frame into a recycled buffer and returns, unless maxQueuedFrames frames wait for the writer.
+    class Y4mWriter
+    {
+    public:
+        struct Statistics
+        {
+            uint64_t frames        = 0;
+            uint64_t bytes         = 0;
+            // Time spent in ConvertToI420 and writing on the writer thread
+            double   convertMs     = 0.0;
+            double   writeMs       = 0.0;
+            // Time the render thread waited in Submit because maxQueuedFrames frames were queued
+            double   submitStallMs = 0.0;
+        };
+
+        explicit Y4mWriter(uint32_t maxQueuedFrames = 2);
+        // Closes the stream
+        ~Y4mWriter();
+
+        Y4mWriter(const Y4mWriter&) = delete;
+        Y4mWriter& operator=(const Y4mWriter&) = delete;
+
+        // Writes the stream header to path, or to stdout if path is "-", and starts the writer thread.
+        // All frames have width x height pixels.
+        bool Open(const std::string& path, uint32_t width, uint32_t height, uint32_t framesPerSecond);
+        // Writes all queued frames and closes the file, returns false if writing any of them failed
+        bool Close();
+
+        void Submit(const void* pixels, uint32_t rowPitch);
+        void Submit(const cpu::Image& image);
+
+        // Only consistent after Close
+        const Statistics& GetStatistics() const { return statistics_; }
+
+    private:
+        void WriterLoop();
+
+        const uint32_t maxQueuedFrames_;
+
+        FILE*    file_   = nullptr;
+        bool     stdout_ = false;
+        uint32_t width_  = 0;
+        uint32_t height_ = 0;
+
+        std::mutex              mutex_;
+        std::condition_variable queued_;
+        std::condition_variable written_;
+        std::deque<std::vector<uint32_t>> queue_;
+        // Pixel buffers of written frames, reused by Submit
+        std::vector<std::vector<uint32_t>> freeBuffers_;
+        bool       failed_ = false;
+        bool       exit_   = false;
+        Statistics statistics_;
+
+        std::thread thread_;
+    };
+}
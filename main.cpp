@@ -20,31 +20,381 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
 ********************************************************************/
 
+#include "GeometryFile.h"
 #include "HelloMeshNodes.h"
 
+#include <algorithm>
 
 extern "C" { __declspec(dllexport) extern const UINT D3D12SDKVersion = 715; }
 extern "C" { __declspec(dllexport) extern const char* D3D12SDKPath = u8".\\D3D12\\"; }
 
-int main()
+namespace {
+    // Short description of the work graph variants selected by the settings, e.g. "thread, line strips"
+    std::string GetVariantName(const Settings& settings)
+    {
+        std::string variant = (settings.snowflakeGroupSize > 0) ? "coalescing " + std::to_string(settings.snowflakeGroupSize) : "thread";
+        if (settings.expansionLevels > 1)
+        {
+            variant = "expansion " + std::to_string(settings.expansionLevels);
+        }
+        if (settings.lineStrips)
+        {
+            variant += ", line strips";
+        }
+        if (settings.lineDispatchGrid)
+        {
+            variant += ", line dispatch grid";
+        }
+        if (settings.triangleBatchSize > 0)
+        {
+            variant += ", triangle batch " + std::to_string(settings.triangleBatchSize);
+        }
+        if (settings.compactRecords)
+        {
+            variant += ", compact records";
+        }
+        if (settings.meshNodeArray)
+        {
+            variant += ", mesh node array";
+        }
+        if (settings.unrolledChain)
+        {
+            variant += ", unrolled chain";
+        }
+        if (settings.meshNodeCulling)
+        {
+            variant += ", culling";
+        }
+        return variant;
+    }
+
+    // Compiles the work graph library and the pixel shader of every supported combination of variants with DXC,
+    // including the node output limits checked by the DXIL validator, and prints the errors of each combination that fails.
+    // Returns the number of failed combinations.
+    uint32_t ValidateShaderVariants()
+    {
+        // Shaders compiled for every variant, see HelloMeshNodes::Initialize
+        struct ShaderTarget
+        {
+            const wchar_t* entryPoint;
+            const wchar_t* targetProfile;
+        };
+        const ShaderTarget targets[] = { { nullptr, L"lib_6_9" }, { L"MeshNodePixelShader", L"ps_6_9" } };
+
+        // Boolean options are enumerated as the bits of a mask
+        constexpr uint32_t FlagCount = 7;
+
+        uint32_t variants = 0;
+        uint32_t failures = 0;
+        for (const uint32_t snowflakeGroupSize : { 0u, 32u, shader::MaxSnowflakeGroupSize })
+        {
+            for (uint32_t expansionLevels = 1; expansionLevels <= shader::MaxSnowflakeExpansionLevels; ++expansionLevels)
+            {
+                for (const uint32_t triangleBatchSize : { 0u, 1u, shader::MaxTriangleBatchSize })
+                {
+                    for (uint32_t flags = 0; flags < (1u << FlagCount); ++flags)
+                    {
+                        Settings settings = {};
+                        settings.snowflakeGroupSize = snowflakeGroupSize;
+                        settings.expansionLevels    = expansionLevels;
+                        settings.triangleBatchSize  = triangleBatchSize;
+                        settings.lineStrips         = (flags & (1u << 0)) != 0;
+                        settings.lineDispatchGrid   = (flags & (1u << 1)) != 0;
+                        settings.compactRecords     = (flags & (1u << 2)) != 0;
+                        settings.meshNodeArray      = (flags & (1u << 3)) != 0;
+                        settings.unrolledChain      = (flags & (1u << 4)) != 0;
+                        settings.meshNodeCulling    = (flags & (1u << 5)) != 0;
+                        settings.nodeCounters       = (flags & (1u << 6)) != 0;
+                        if (GetUnsupportedVariantReason(settings))
+                        {
+                            continue;
+                        }
+
+                        const ShaderVariant variant = GetShaderVariant(settings);
+                        const std::vector<DxcDefine> defines = variant.GetDxcDefines();
+
+                        std::string errors;
+                        for (const ShaderTarget& target : targets)
+                        {
+                            std::string targetErrors;
+                            CComPtr<ID3DBlob> blob;
+                            blob.Attach(d3d12::TryCompileShader(variant.source, target.entryPoint, target.targetProfile, defines, targetErrors));
+                            if (!blob)
+                            {
+                                errors += targetErrors;
+                            }
+                        }
+
+                        const std::string name = GetVariantName(settings) + (settings.nodeCounters ? ", node counters" : "");
+                        printf("%-6s %s\n", errors.empty() ? "ok" : "FAILED", name.c_str());
+                        if (!errors.empty())
+                        {
+                            printf("%s\n", errors.c_str());
+                            failures++;
+                        }
+                        variants++;
+                    }
+                }
+            }
+        }
+
+        printf("%u of %u shader variants failed to compile\n", failures, variants);
+        return failures;
+    }
+
+    // Renders frames without a window as fast as possible and writes frame time percentiles to frame_benchmark.json
+    void RunHeadlessBenchmark(HelloMeshNodes& helloMeshNodes, const Settings& settings, uint32_t frames)
+    {
+        const profiling::CpuTimer startupTimer;
+        helloMeshNodes.Initialize(nullptr);
+
+        // Warm up, the first frame includes deferred driver work
+        helloMeshNodes.Render();
+        const double startupMs = startupTimer.ElapsedMs();
+
+        std::vector<double> frameSamples;
+        std::vector<double> dispatchGraphSamples;
+        for (uint32_t frame = 0; frame < frames; ++frame)
+        {
+            helloMeshNodes.Render();
+
+            const profiling::FrameTimingRing& timings = helloMeshNodes.GetFrameTimings();
+            const profiling::FrameTimings& latest = timings[timings.Size() - 1];
+            frameSamples.push_back(latest.cpuTotalMs);
+            dispatchGraphSamples.push_back(latest.gpuDispatchGraphMs);
+        }
+
+        const cpu::NodeCounters expected = cpu::ExpectedNodeCounters(shader::MaxSnowflakeRecursions, settings.expansionLevels,
+            settings.lineStrips || settings.lineDispatchGrid);
+
+        profiling::FrameBenchmarkReport report;
+        report.backend      = "d3d12";
+        report.variant      = GetVariantName(settings);
+        report.depth        = shader::MaxSnowflakeRecursions;
+        report.frameMs      = profiling::ComputeLatencyStatistics(frameSamples);
+        report.generationMs = profiling::ComputeLatencyStatistics(dispatchGraphSamples);
+        report.rasterMs     = report.generationMs;
+        report.drawRecords  = expected[cpu::TriangleMeshNodeInvocations] + expected[cpu::LineMeshNodeInvocations];
+        // TriangleMeshShader outputs 1 and LineMeshShader 4 primitives, LineStripMeshShader 10 for a strip of 4 lines.
+        // A line dispatch grid launches a LineMeshShader group for each of its 4 lines.
+        // Primitives culled by the mesh nodes are included.
+        uint64_t linePrimitives = (settings.lineStrips && (shader::MaxSnowflakeRecursions > 0)) ? 10 : 4;
+        if (settings.lineDispatchGrid && (shader::MaxSnowflakeRecursions > 0))
+        {
+            linePrimitives = 16;
+        }
+        report.primitives   = expected[cpu::TriangleMeshNodeInvocations] + expected[cpu::LineMeshNodeInvocations] * linePrimitives;
+        report.startupMs    = startupMs;
+
+        report.Print();
+        profiling::WriteFrameBenchmarks("frame_benchmark.json", { report });
+    }
+}
+
+int main(int argc, char** argv)
 {
+    Settings settings = {};
+    // Number of frames rendered offscreen by the headless benchmark, 0 to open the window
+    uint32_t benchmarkFrames = 0;
+    // If set, the geometry of exportDepth Koch iterations is written to this file instead of running the sample
+    std::string exportGeometryPath;
+    uint32_t    exportDepth = shader::MaxSnowflakeRecursions;
+    // If set, every supported shader variant is compiled instead of running the sample
+    bool validateShaders = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+        if (argument == "--node-counters")
+        {
+            settings.nodeCounters = true;
+        }
+        else if ((argument == "--cpu-trace") && (i + 1 < argc))
+        {
+            settings.cpuTracePath = argv[++i];
+        }
+        else if ((argument == "--graphviz") && (i + 1 < argc))
+        {
+            settings.graphvizPath = argv[++i];
+        }
+        else if (argument == "--memory-report")
+        {
+            settings.memoryReport = true;
+        }
+        else if (argument == "--startup-profile")
+        {
+            settings.startupProfile = true;
+        }
+        else if ((argument == "--snowflake-coalescing") && (i + 1 < argc))
+        {
+            settings.snowflakeGroupSize = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if ((argument == "--expansion-levels") && (i + 1 < argc))
+        {
+            settings.expansionLevels = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if ((argument == "--triangle-batch") && (i + 1 < argc))
+        {
+            settings.triangleBatchSize = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (argument == "--line-strips")
+        {
+            settings.lineStrips = true;
+        }
+        else if (argument == "--line-dispatch-grid")
+        {
+            settings.lineDispatchGrid = true;
+        }
+        else if (argument == "--compact-records")
+        {
+            settings.compactRecords = true;
+        }
+        else if (argument == "--mesh-node-array")
+        {
+            settings.meshNodeArray = true;
+        }
+        else if (argument == "--unrolled-chain")
+        {
+            settings.unrolledChain = true;
+        }
+        else if (argument == "--mesh-node-culling")
+        {
+            settings.meshNodeCulling = true;
+        }
+        else if ((argument == "--cull-min-area") && (i + 1 < argc))
+        {
+            settings.cullMinPixelArea = std::stof(argv[++i]);
+        }
+        else if ((argument == "--benchmark") && (i + 1 < argc))
+        {
+            benchmarkFrames = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if ((argument == "--write-frames") && (i + 1 < argc))
+        {
+            settings.framePathPrefix = argv[++i];
+        }
+        else if (argument == "--validate-shaders")
+        {
+            validateShaders = true;
+        }
+        else if ((argument == "--export-geometry") && (i + 1 < argc))
+        {
+            exportGeometryPath = argv[++i];
+        }
+        else if ((argument == "--export-depth") && (i + 1 < argc))
+        {
+            exportDepth = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+    }
+
+    if (!exportGeometryPath.empty())
+    {
+        geometry::ExportReport report;
+        const profiling::CpuTimer timer;
+        if (!geometry::ExportGeometry(exportGeometryPath, exportDepth, std::thread::hardware_concurrency(), &report))
+        {
+            printf("ERROR: Failed to export geometry to %s\n", exportGeometryPath.c_str());
+            return 1;
+        }
+        printf("Exported %llu lines and %llu triangles of depth %u to %s (%llu bytes in %u chunks) in %.1f ms\n",
+            static_cast<unsigned long long>(report.lines), static_cast<unsigned long long>(report.triangles), exportDepth, exportGeometryPath.c_str(),
+            static_cast<unsigned long long>(report.fileBytes), report.chunks, timer.ElapsedMs());
+        return 0;
+    }
+
+    // Headless runs are scripted, errors only terminate with a non-zero exit code
+    d3d12::sWaitForKeyOnError = (benchmarkFrames == 0) && !validateShaders;
+
+    if (validateShaders)
+    {
+        uint32_t failures = 1;
+        try
+        {
+            d3d12::LoadCompiler();
+            failures = ValidateShaderVariants();
+        }
+        catch (...)
+        {
+        }
+        d3d12::ReleaseCompiler();
+        return (failures == 0) ? 0 : 1;
+    }
+
+    // Checked before the CPU executor runs the selected variant below, HelloMeshNodes::Initialize checks it again
+    if (const char* unsupportedVariant = GetUnsupportedVariantReason(settings))
+    {
+        printf("ERROR: %s\n", unsupportedVariant);
+        return 1;
+    }
+
+    // With node counters, the Graphviz file is written from the GPU counters (see HelloMeshNodes::CheckNodeCounters)
+    const bool cpuGraphviz = !settings.graphvizPath.empty() && !settings.nodeCounters;
+
+    if (!settings.cpuTracePath.empty() || cpuGraphviz)
+    {
+        cpu::ExecutorDesc executorDesc = GetExecutorDesc(settings);
+        executorDesc.threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+        cpu::Executor executor(executorDesc);
+        cpu::TraceRecorder trace(executorDesc.threadCount);
+        if (!settings.cpuTracePath.empty())
+        {
+            executor.SetTraceRecorder(&trace);
+        }
+
+        cpu::GraphOutput output;
+        executor.Run(output);
+
+        if (!settings.cpuTracePath.empty() && !trace.WriteJson(settings.cpuTracePath))
+        {
+            printf("ERROR: Failed to write CPU trace to %s\n", settings.cpuTracePath.c_str());
+        }
+
+        if (cpuGraphviz && !cpu::WriteGraphviz(settings.graphvizPath, "CPU executor", executorDesc, executor.GetNodeCounters(), executor.GetNodeTimings()))
+        {
+            printf("ERROR: Failed to write Graphviz file to %s\n", settings.graphvizPath.c_str());
+        }
+    }
+
+    // Errors (ERROR_QUIT) are reported with a non-zero exit code, e.g. a node counter mismatch with --node-counters
+    int exitCode = 0;
     try
     {
         d3d12::LoadCompiler();
 
-        HelloMeshNodes helloMeshNodes = {};
+        HelloMeshNodes helloMeshNodes(settings);
+
+        if (benchmarkFrames > 0)
+        {
+            RunHeadlessBenchmark(helloMeshNodes, settings, benchmarkFrames);
+        }
+        else
+        {
+            HWND hwnd;
+            {
+                profiling::ScopedZone zone("window::Initialize");
+                hwnd = window::Initialize(&helloMeshNodes);
+            }
 
-        HWND hwnd = window::Initialize(&helloMeshNodes);
+            helloMeshNodes.Initialize(hwnd);
 
-        helloMeshNodes.Initialize(hwnd);
+            {
+                profiling::ScopedZone zone("ShowWindow");
+                ShowWindow(hwnd, SW_SHOW);
+            }
 
-        ShowWindow(hwnd, SW_SHOW);
+            window::MessageLoop();
 
-        window::MessageLoop();
+            // Dump timings of the last rendered frames
+            helloMeshNodes.GetFrameTimings().WriteCsv("frame_timings.csv");
+            helloMeshNodes.GetFrameTimings().WriteJson("frame_timings.json");
+        }
+    }
+    catch (...)
+    {
+        exitCode = 1;
     }
-    catch (...) {}
 
     d3d12::ReleaseCompiler();
 
-    return 0;
+    return exitCode;
 }
\ No newline at end of file